@@ -0,0 +1,347 @@
+//
+// C++ Implementation: muir-allocator
+//
+// Description: Aligned, huge page and NUMA aware allocation for the Muir multi_arrays.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-allocator.h"
+#include "muir-global.h"
+#include "muir-partition.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// Linux memory mapping and policy
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Macros
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num() 0
+#define omp_get_num_threads() 1
+#endif
+
+// From <numaif.h>, called through syscall() so libnuma isn't needed
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED  1
+#define MPOL_INTERLEAVE 3
+#define MPOL_MF_MOVE    (1 << 1)
+#endif
+
+/// Constants
+// Smaller blocks come from the heap, placing them isn't worth a mapping each
+static const std::size_t NumaMinBytes = 1 << 20;
+static const std::size_t DefaultHugePageBytes = 2 << 20;
+
+// A large block as mapped, which may start before and run past what was asked for
+struct Mapping
+{
+    void *base;
+    std::size_t length;
+};
+
+static std::mutex allocator_mutex;
+static MuirAllocatorStats allocator_stats = MuirAllocatorStats();
+static std::map<void *, Mapping> mappings;
+
+static void* map_block(std::size_t bytes, Mapping &mapping, bool &huge);
+static void record_allocation(std::size_t bytes);
+static std::size_t round_up(std::size_t bytes, std::size_t multiple);
+static std::size_t page_size(void);
+static std::size_t huge_page_size(void);
+static std::size_t read_huge_page_size(void);
+static long set_policy(void *p, std::size_t bytes, int mode, const std::vector<int> &nodes, unsigned int flags);
+
+
+void* muir_allocate(std::size_t bytes)
+{
+    if (bytes < NumaMinBytes)
+    {
+        void *p = NULL;
+        if (posix_memalign(&p, MuirAlignment, bytes ? bytes : 1) != 0)
+            throw std::bad_alloc();
+
+        std::memset(p, 0, bytes);
+        record_allocation(bytes);
+        return p;
+    }
+
+    // Fresh anonymous pages read as zero and are only placed when first written
+    Mapping mapping;
+    bool huge = false;
+    void *p = map_block(bytes, mapping, huge);
+
+    if (MUIR_NumaPolicy == NUMA_INTERLEAVE)
+    {
+        std::vector<int> nodes = numa_nodes();
+        if (nodes.size() > 1)
+            set_policy(mapping.base, mapping.length, MPOL_INTERLEAVE, nodes, 0);
+    }
+
+    if (MUIR_NumaPolicy == NUMA_FIRST_TOUCH)
+    {
+        // Each worker writes its static share, the kernel places it on the worker's node
+        char *bytes_p = static_cast<char *>(p);
+        const std::size_t page = page_size();
+        const std::size_t pages = (bytes + page - 1) / page;
+
+        #pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < pages; i++)
+            bytes_p[i * page] = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    mappings[p] = mapping;
+    allocator_stats.mapped_blocks++;
+    if (huge)
+        allocator_stats.huge_bytes += bytes;
+    allocator_stats.allocations++;
+    allocator_stats.bytes_in_use += bytes;
+    allocator_stats.peak_bytes = std::max(allocator_stats.peak_bytes, allocator_stats.bytes_in_use);
+
+    return p;
+}
+
+
+void muir_deallocate(void *p, std::size_t bytes)
+{
+    if (p == NULL)
+        return;
+
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    allocator_stats.deallocations++;
+    allocator_stats.bytes_in_use -= bytes;
+
+    if (bytes < NumaMinBytes)
+    {
+        std::free(p);
+        return;
+    }
+
+    std::map<void *, Mapping>::iterator iter = mappings.find(p);
+    if (iter != mappings.end())
+    {
+        munmap(iter->second.base, iter->second.length);
+        mappings.erase(iter);
+    }
+}
+
+
+MuirAllocatorStats muir_allocator_stats(void)
+{
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    return allocator_stats;
+}
+
+
+void numa_place(const void *p, std::size_t bytes)
+{
+    if (MUIR_NumaPolicy != NUMA_FIRST_TOUCH || bytes < NumaMinBytes || numa_nodes().size() < 2)
+        return;
+
+    // Same split as the page loop in muir_allocate()
+    char *bytes_p = static_cast<char *>(const_cast<void *>(p));
+    const std::size_t page = page_size();
+    const std::size_t pages = (bytes + page - 1) / page;
+
+    #pragma omp parallel
+    {
+        std::size_t threads = omp_get_num_threads();
+        std::size_t thread = omp_get_thread_num();
+        std::size_t first = thread * pages / threads;
+        std::size_t last = (thread + 1) * pages / threads;
+
+        int cpu = sched_getcpu();
+        if (last > first && cpu >= 0)
+        {
+            std::vector<int> node(1, numa_node_of_cpu(cpu));
+            set_policy(bytes_p + first * page, (last - first) * page, MPOL_PREFERRED, node, MPOL_MF_MOVE);
+        }
+    }
+}
+
+
+NUMA_Policy numa_policy_from_string(const std::string &name)
+{
+    if (name == "none")
+        return NUMA_NONE;
+    if (name == "first-touch")
+        return NUMA_FIRST_TOUCH;
+    if (name == "interleave")
+        return NUMA_INTERLEAVE;
+
+    throw std::invalid_argument("Unknown NUMA policy: " + name + " (expecting none, first-touch or interleave)");
+}
+
+
+std::string numa_policy_name(NUMA_Policy policy)
+{
+    switch (policy)
+    {
+      case NUMA_FIRST_TOUCH: return "first-touch";
+      case NUMA_INTERLEAVE:  return "interleave";
+      default:               return "none";
+    }
+}
+
+
+HugePage_Policy huge_page_policy_from_string(const std::string &name)
+{
+    if (name == "none")
+        return HUGE_PAGES_NONE;
+    if (name == "transparent")
+        return HUGE_PAGES_TRANSPARENT;
+    if (name == "hugetlb")
+        return HUGE_PAGES_HUGETLB;
+
+    throw std::invalid_argument("Unknown huge page policy: " + name + " (expecting none, transparent or hugetlb)");
+}
+
+
+std::string huge_page_policy_name(HugePage_Policy policy)
+{
+    switch (policy)
+    {
+      case HUGE_PAGES_TRANSPARENT: return "transparent";
+      case HUGE_PAGES_HUGETLB:     return "hugetlb";
+      default:                     return "none";
+    }
+}
+
+
+// Map a large block backed as MUIR_HugePages asks.  Returns the start of the block, the
+// whole mapping (to unmap later) goes in mapping.
+static void* map_block(std::size_t bytes, Mapping &mapping, bool &huge)
+{
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    const std::size_t huge_page = huge_page_size();
+
+    if (MUIR_HugePages == HUGE_PAGES_HUGETLB)
+    {
+        mapping.length = round_up(bytes, huge_page);
+        mapping.base = mmap(NULL, mapping.length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (mapping.base != MAP_FAILED)
+        {
+            huge = true;
+            return mapping.base;
+        }
+
+        // Pool empty or not configured, base pages it is
+        std::lock_guard<std::mutex> lock(allocator_mutex);
+        allocator_stats.hugetlb_fallbacks++;
+    }
+
+    if (MUIR_HugePages == HUGE_PAGES_TRANSPARENT)
+    {
+        // Over map, then trim to a huge page aligned start so whole huge pages fit
+        std::size_t length = bytes + huge_page;
+        char *raw = static_cast<char *>(mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0));
+        if (raw == MAP_FAILED)
+            throw std::bad_alloc();
+
+        char *start = raw + (round_up(reinterpret_cast<std::size_t>(raw), huge_page) - reinterpret_cast<std::size_t>(raw));
+        mapping.base = start;
+        mapping.length = round_up(bytes, page_size());
+
+        if (start > raw)
+            munmap(raw, start - raw);
+        if (raw + length > start + mapping.length)
+            munmap(start + mapping.length, (raw + length) - (start + mapping.length));
+
+#ifdef MADV_HUGEPAGE
+        huge = (madvise(mapping.base, mapping.length, MADV_HUGEPAGE) == 0);
+#endif
+        return mapping.base;
+    }
+
+    mapping.length = bytes;
+    mapping.base = mmap(NULL, mapping.length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapping.base == MAP_FAILED)
+        throw std::bad_alloc();
+
+    return mapping.base;
+}
+
+
+static void record_allocation(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    allocator_stats.allocations++;
+    allocator_stats.bytes_in_use += bytes;
+    allocator_stats.peak_bytes = std::max(allocator_stats.peak_bytes, allocator_stats.bytes_in_use);
+}
+
+
+static std::size_t round_up(std::size_t bytes, std::size_t multiple)
+{
+    return (bytes + multiple - 1) / multiple * multiple;
+}
+
+
+static std::size_t page_size(void)
+{
+    static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+
+// Default huge page size from /proc/meminfo.  Read once.
+static std::size_t huge_page_size(void)
+{
+    static const std::size_t size = read_huge_page_size();
+    return size;
+}
+
+// Ex: "Hugepagesize:    2048 kB"
+static std::size_t read_huge_page_size(void)
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+
+    while (std::getline(meminfo, line))
+    {
+        std::string key;
+        std::size_t kb = 0;
+        std::stringstream stream(line);
+        if (stream >> key >> kb && key == "Hugepagesize:" && kb)
+            return kb * 1024;
+    }
+
+    return DefaultHugePageBytes;
+}
+
+
+// mbind() a page aligned range to a set of nodes.  Failures (no NUMA support) are
+// ignored, the pages just stay where the kernel puts them.
+static long set_policy(void *p, std::size_t bytes, int mode, const std::vector<int> &nodes, unsigned int flags)
+{
+    const std::size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(1);
+
+    for (std::size_t i = 0; i < nodes.size(); i++)
+    {
+        std::size_t node = static_cast<std::size_t>(nodes[i]);
+        if (node / bits >= mask.size())
+            mask.resize(node / bits + 1, 0);
+        mask[node / bits] |= 1UL << (node % bits);
+    }
+
+    return syscall(SYS_mbind, p, bytes, mode, mask.data(), mask.size() * bits + 1, flags);
+}
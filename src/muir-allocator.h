@@ -0,0 +1,103 @@
+#ifndef MUIR_ALLOCATOR_H
+#define MUIR_ALLOCATOR_H
+//
+// C++ Interface: muir-allocator
+//
+// Description: Aligned, huge page and NUMA aware allocation for the Muir multi_arrays.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <utility>
+
+// Every block starts on a cache line, enough for any SIMD load
+static const std::size_t MuirAlignment = 64;
+
+// Where the pages of large arrays end up (see MUIR_NumaPolicy)
+enum NUMA_Policy
+{
+    NUMA_NONE,          // Wherever the first thread to write them runs (the loading thread)
+    NUMA_FIRST_TOUCH,   // Spread over the nodes of the OpenMP team that decodes them, with
+                        // the same static split as the decoding loops
+    NUMA_INTERLEAVE     // Round robin over every node
+};
+
+// What backs large arrays (see MUIR_HugePages)
+enum HugePage_Policy
+{
+    HUGE_PAGES_NONE,        // Base pages
+    HUGE_PAGES_TRANSPARENT, // Huge page aligned and madvise(MADV_HUGEPAGE), the kernel
+                            // promotes them when it can
+    HUGE_PAGES_HUGETLB      // Reserved hugetlbfs pages (MAP_HUGETLB), falls back to base
+                            // pages when the pool is empty
+};
+
+// Counters over every block handed out since the program started
+struct MuirAllocatorStats
+{
+    std::size_t allocations;
+    std::size_t deallocations;
+    std::size_t bytes_in_use;
+    std::size_t peak_bytes;
+    std::size_t mapped_blocks;      // Large blocks mapped from the kernel
+    std::size_t huge_bytes;         // Of those, bytes requested huge
+    std::size_t hugetlb_fallbacks;  // MAP_HUGETLB requests the pool couldn't satisfy
+};
+
+// Returns zeroed memory aligned to MuirAlignment.  Blocks of at least NumaMinBytes are
+// mapped straight from the kernel, backed by MUIR_HugePages and placed by
+// MUIR_NumaPolicy, first touch placement uses the calling thread's OpenMP team.
+void* muir_allocate(std::size_t bytes);
+void  muir_deallocate(void *p, std::size_t bytes);
+
+MuirAllocatorStats muir_allocator_stats(void);
+
+// Move the pages of an already written block so each of the calling thread's OpenMP
+// workers holds the static share it will decode, for arrays filled by another thread
+// (Ex: loaded by a reader thread).  Only done under NUMA_FIRST_TOUCH.
+void numa_place(const void *p, std::size_t bytes);
+
+// Parse and name policies: none, first-touch, interleave.  Throws std::invalid_argument.
+NUMA_Policy numa_policy_from_string(const std::string &name);
+std::string numa_policy_name(NUMA_Policy policy);
+
+// Parse and name policies: none, transparent, hugetlb.  Throws std::invalid_argument.
+HugePage_Policy huge_page_policy_from_string(const std::string &name);
+std::string huge_page_policy_name(HugePage_Policy policy);
+
+// Allocator for the Muir multi_arrays.  muir_allocate() already zeroes the memory, so
+// elements are default constructed (left alone) instead of being zeroed again by the
+// allocating thread, which would fault every page in on its node.
+template<typename T>
+class MuirAllocator
+{
+  public:
+    typedef T value_type;
+
+    MuirAllocator() noexcept {}
+    template<typename U> MuirAllocator(const MuirAllocator<U> &) noexcept {}
+
+    T* allocate(std::size_t n)
+        { return static_cast<T *>(muir_allocate(n * sizeof(T))); }
+    void deallocate(T *p, std::size_t n) noexcept
+        { muir_deallocate(p, n * sizeof(T)); }
+
+    template<typename U> void construct(U *p)
+        { ::new(static_cast<void *>(p)) U; }
+    template<typename U, typename... Args> void construct(U *p, Args&&... args)
+        { ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+};
+
+template<typename T, typename U>
+bool operator==(const MuirAllocator<T> &, const MuirAllocator<U> &) noexcept { return true; }
+template<typename T, typename U>
+bool operator!=(const MuirAllocator<T> &, const MuirAllocator<U> &) noexcept { return false; }
+
+#endif //MUIR_ALLOCATOR_H
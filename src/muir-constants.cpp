@@ -29,9 +29,14 @@ const std::string RTI_DECODEDRADAC_PATH("/Decoded/RadacTime");
 const std::string RTI_DECODEDFRAME_PATH("/Decoded/FrameCount");
 
 const std::string RTI_DECODEDFFTSIZE_PATH("/Decoded/FFTSize");
+const std::string RTI_DECODEDDOPPLERSTART_PATH("/Decoded/DopplerStart");
+const std::string RTI_DECODEDDOPPLERBINS_PATH("/Decoded/DopplerBins");
+const std::string RTI_DECODEDRANGEOFFSET_PATH("/Decoded/RangeOffset");
+const std::string RTI_DECODEDSETOFFSET_PATH("/Decoded/SetOffset");
 const std::string RTI_DECODEDTIMEINTEGRATION_PATH("/Decoded/TimeIntegration");
 const std::string RTI_DECODEDPHASECODEMUTING_PATH("/Decoded/PhasecodeMuting");
 const std::string RTI_DECODEDDECODINGTHREADS_PATH("/Decoded/DecodingThreads");
+const std::string RTI_DECODEDDECODINGCPUS_PATH("/Decoded/DecodingCPUs");
 const std::string RTI_DECODEDDECODINGPLATFORM_PATH("/Decoded/DecodingPlatform");
 const std::string RTI_DECODEDDECODINGDEVICE_PATH("/Decoded/DecodingDevice");
 const std::string RTI_DECODEDDECODINGPROCESS_PATH("/Decoded/DecodingProcess");
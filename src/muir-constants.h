@@ -31,9 +31,14 @@ extern const std::string RTI_DECODEDRADAC_PATH;
 extern const std::string RTI_DECODEDFRAME_PATH;
 
 extern const std::string RTI_DECODEDFFTSIZE_PATH;
+extern const std::string RTI_DECODEDDOPPLERSTART_PATH;
+extern const std::string RTI_DECODEDDOPPLERBINS_PATH;
+extern const std::string RTI_DECODEDRANGEOFFSET_PATH;
+extern const std::string RTI_DECODEDSETOFFSET_PATH;
 extern const std::string RTI_DECODEDTIMEINTEGRATION_PATH;
 extern const std::string RTI_DECODEDPHASECODEMUTING_PATH;
 extern const std::string RTI_DECODEDDECODINGTHREADS_PATH;
+extern const std::string RTI_DECODEDDECODINGCPUS_PATH;
 extern const std::string RTI_DECODEDDECODINGPLATFORM_PATH;
 extern const std::string RTI_DECODEDDECODINGDEVICE_PATH;
 extern const std::string RTI_DECODEDDECODINGPROCESS_PATH;
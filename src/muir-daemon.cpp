@@ -0,0 +1,193 @@
+//
+// C++ Implementation: muir-daemon
+//
+// Description: Decode jobs sent to the muir-decoded service and the replies it sends.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-daemon.h"
+#include "muir-socket.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void config_set(DecodingConfig &config, const std::string &name, std::istream &value);
+static std::string private_directory(void);
+
+
+std::string daemon_default_address(void)
+{
+    // Only this user can use it, and no one else can create anything in it
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && runtime_dir[0] == '/')
+        return "unix:" + std::string(runtime_dir) + "/muir-decoded.sock";
+
+    return "unix:" + private_directory() + "/socket";
+}
+
+
+void daemon_prepare_address(const std::string &address)
+{
+    std::string path;
+    if (!socket_unix_path(address, path) || path.substr(0, path.rfind('/')) != private_directory())
+        return;
+
+    std::string directory = private_directory();
+    if (mkdir(directory.c_str(), S_IRWXU) != 0 && errno != EEXIST)
+        throw std::runtime_error("Unable to create " + directory + ": " + strerror(errno));
+
+    // Anyone may have made it first in /tmp
+    struct stat info;
+    if (lstat(directory.c_str(), &info) != 0)
+        throw std::runtime_error("Unable to check " + directory + ": " + strerror(errno));
+    if (!S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & (S_IRWXG | S_IRWXO)))
+        throw std::runtime_error(directory + " isn't a directory only this user can use");
+}
+
+
+void daemon_check_address(const std::string &address)
+{
+    std::string path;
+    if (!socket_unix_path(address, path))
+        return;
+
+    // A missing socket is left for connect() to report
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && info.st_uid != getuid())
+        throw std::runtime_error(path + " belongs to another user");
+}
+
+
+static std::string private_directory(void)
+{
+    return "/tmp/muir-decoded-" + std::to_string(getuid());
+}
+
+
+bool daemon_send_job(int fd, const DecodeJob &job)
+{
+    const DecodingConfig &config = job.config;
+    std::ostringstream out;
+    out << std::setprecision(17);
+
+    // Only what a job chooses, the service decides threads, devices and memory
+    out << "JOB\n";
+    out << "CONFIG fft_size " << config.fft_size << "\n";
+    out << "CONFIG fft_engine " << fft_engine_name(config.fft_engine) << "\n";
+    out << "CONFIG phasecode_muting " << config.phasecode_muting << "\n";
+    out << "CONFIG time_integration " << config.time_integration << "\n";
+    out << "CONFIG range_tile " << config.range_tile << "\n";
+    out << "CONFIG doppler_start " << config.doppler_start << "\n";
+    out << "CONFIG doppler_bins " << config.doppler_bins << "\n";
+    out << "CONFIG doppler_low_hz " << config.doppler_low_hz << "\n";
+    out << "CONFIG doppler_high_hz " << config.doppler_high_hz << "\n";
+    out << "CONFIG range_start " << config.range_start << "\n";
+    out << "CONFIG range_bins " << config.range_bins << "\n";
+    out << "CONFIG range_low_km " << config.range_low_km << "\n";
+    out << "CONFIG range_high_km " << config.range_high_km << "\n";
+    out << "CONFIG time_start " << config.time_start << "\n";
+    out << "CONFIG time_end " << config.time_end << "\n";
+
+    if (!job.output_dir.empty())
+        out << "OUTPUT " << job.output_dir << "\n";
+
+    for (std::size_t i = 0; i < job.files.size(); i++)
+        out << "FILE " << job.files[i] << "\n";
+
+    out << "END\n";
+
+    return socket_send(fd, out.str());
+}
+
+
+bool daemon_receive_job(int fd, std::string &buffer, DecodeJob &job)
+{
+    std::string line;
+    while (socket_receive_line(fd, buffer, line))
+    {
+        std::size_t space = line.find(' ');
+        std::string word = line.substr(0, space);
+        std::string rest = (space == std::string::npos) ? std::string() : line.substr(space + 1);
+
+        if (word == "END")
+            return true;
+
+        if (word == "FILE")
+        {
+            job.files.push_back(rest);
+        }
+        else if (word == "OUTPUT")
+        {
+            job.output_dir = rest;
+        }
+        else if (word == "CONFIG")
+        {
+            std::istringstream stream(rest);
+            std::string name;
+            stream >> name;
+            config_set(job.config, name, stream);
+        }
+        else
+        {
+            throw std::invalid_argument("Unexpected line in job: " + line);
+        }
+    }
+
+    return false;
+}
+
+
+static void config_set(DecodingConfig &config, const std::string &name, std::istream &value)
+{
+    if (name == "fft_size")
+        value >> config.fft_size;
+    else if (name == "fft_engine")
+    {
+        std::string engine;
+        value >> engine;
+        config.fft_engine = fft_engine_from_string(engine);
+    }
+    else if (name == "phasecode_muting")
+        value >> config.phasecode_muting;
+    else if (name == "time_integration")
+        value >> config.time_integration;
+    else if (name == "range_tile")
+        value >> config.range_tile;
+    else if (name == "doppler_start")
+        value >> config.doppler_start;
+    else if (name == "doppler_bins")
+        value >> config.doppler_bins;
+    else if (name == "doppler_low_hz")
+        value >> config.doppler_low_hz;
+    else if (name == "doppler_high_hz")
+        value >> config.doppler_high_hz;
+    else if (name == "range_start")
+        value >> config.range_start;
+    else if (name == "range_bins")
+        value >> config.range_bins;
+    else if (name == "range_low_km")
+        value >> config.range_low_km;
+    else if (name == "range_high_km")
+        value >> config.range_high_km;
+    else if (name == "time_start")
+        value >> config.time_start;
+    else if (name == "time_end")
+        value >> config.time_end;
+    else
+        throw std::invalid_argument("Unknown decoding option in job: " + name);
+
+    if (value.fail())
+        throw std::invalid_argument("Bad value for decoding option " + name);
+}
@@ -0,0 +1,60 @@
+#ifndef MUIR_DAEMON_H
+#define MUIR_DAEMON_H
+//
+// C++ Interface: muir-daemon
+//
+// Description: Decode jobs sent to the muir-decoded service and the replies it sends.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-process.h"
+
+#include <string>
+#include <vector>
+
+// Protocol, one connection per job, client first:
+//   JOB
+//   CONFIG name value     Decoding options, Ex: CONFIG fft_engine dft
+//   OUTPUT dir            Where the decoded files go
+//   FILE path             Each file to decode (absolute, the service has its own directory)
+//   END
+// then one reply per file as it finishes, in any order, and a summary:
+//   DONE seconds output   Decoded and saved
+//   SKIPPED path          No sets in the time window
+//   FAILED path           Couldn't load, decode or save it, see the service's log
+//   END decoded failed
+// or, to stop the service once its queued files are done:
+//   SHUTDOWN           -> BYE
+
+struct DecodeJob
+{
+    DecodingConfig config;
+    std::string    output_dir;   // Empty for the service's directory
+    std::vector<std::string> files;
+};
+
+// Per user, so users of a shared machine each get their own service:
+// $XDG_RUNTIME_DIR/muir-decoded.sock, or /tmp/muir-decoded-<uid>/socket without one
+std::string daemon_default_address(void);
+
+// Before listening on a Unix socket address.  Creates the /tmp/muir-decoded-<uid>
+// directory of the default address (0700), or throws std::runtime_error if it is there
+// but another user owns it or can use it.
+void daemon_prepare_address(const std::string &address);
+
+// Before connecting to a Unix socket address.  Throws std::runtime_error if the socket
+// belongs to another user, who would be sent the job.
+void daemon_check_address(const std::string &address);
+
+bool daemon_send_job(int fd, const DecodeJob &job);
+
+// Reads the rest of a job after its JOB line.  False if the client went away, throws
+// std::invalid_argument for a line or option it doesn't understand.
+bool daemon_receive_job(int fd, std::string &buffer, DecodeJob &job);
+
+#endif //MUIR_DAEMON_H
@@ -15,22 +15,50 @@
 #include "muir-constants.h"
 #include "muir-utility.h"
 #include "muir-process.h"
+#include "muir-schedule.h"
 #include "muir-config.h"
+#include "muir-global.h"
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <iostream>  // std::cout
 #include <iomanip>   // std::setprecision()
 #include <cmath>
 #include <complex>
+#include <stdexcept>
 
 #include <cassert>
 
+
+// Keep rows first .. first+count-1 of a per-set array
+template<typename Array2D>
+static void keep_rows(Array2D &array, std::size_t first, std::size_t count)
+{
+    std::size_t cols = array.shape()[1];
+    if (first + count > array.shape()[0])
+        throw std::logic_error("keep_rows(): Rows fall outside of the array");
+
+    Array2D rows(boost::extents[count][cols]);
+    for (std::size_t row = 0; row < count; row++)
+        rows[row] = array[first + row];
+
+    array.resize(boost::extents[count][cols]);
+    array = rows;
+}
+
 // Constructor
-MuirData::MuirData(const std::string &filename_in, int option)
+MuirData::MuirData(const std::string &filename_in, int option, const DecodingConfig &window_config)
 : _filename(filename_in),
   _pulsewidth(0),
   _txbaud(0),
   _phasecode(),
   _sample_data(boost::extents[1][1][1][2]),
+  _sample_layout(1, 1, 1),
+  _sample_block(0),
+  _sample_count({1, 1, 1, 2}),
+  _range_offset(0),
+  _set_offset(0),
   _decoded_data(boost::extents[1][1][1]),
   _sample_range(boost::extents[1][1]),
   _framecount(boost::extents[1][1]),
@@ -38,7 +66,7 @@ MuirData::MuirData(const std::string &filename_in, int option)
   _decode_timing_strings(),
   _decode_timings(boost::extents[1][1])
 {
-    if (option == 0)
+    if (option == 0 || option == 2)
     {
         MuirHD5 file_in(_filename, H5F_ACC_RDONLY);
         // Read Pulsewidth
@@ -51,12 +79,44 @@ MuirData::MuirData(const std::string &filename_in, int option)
         if (!read_phasecode(file_in, _phasecode))
             std::cout << "File: " << _filename << ", doesn't contain a phase code!" << std::endl;
 
-        // Read in experiment data
-        file_in.read_4D_float (RTI_RAWSAMPLEDATA_PATH , _sample_data);
-        file_in.read_2D_double(RTI_RADACTIME_PATH     , _time);
+        // Read in experiment data, the ranges first since they can set the range window
         file_in.read_2D_float (RTI_RAWSAMPLERANGE_PATH, _sample_range);
+        file_in.read_2D_double(RTI_RADACTIME_PATH     , _time);
         file_in.read_2D_uint  (RTI_RAWFRAMECOUNT_PATH , _framecount);
 
+        DecodingConfig window = window_config;
+        process_range_window_km(window, _sample_range);
+
+        std::vector<hsize_t> dims = file_in.read_dims(RTI_RAWSAMPLEDATA_PATH);
+        if (dims.size() != 4)
+            throw std::runtime_error("MuirData::MuirData(): Expecting 4 dimensions in " + RTI_RAWSAMPLEDATA_PATH + " from " + _filename);
+
+        // Only the sets overlapping the time window, with their radac and framecount rows
+        std::size_t first_set = 0;
+        std::size_t sets = dims[0];
+        if (window.time_start < window.time_end)
+        {
+            if (!sets_in_range(_time, window.time_start, window.time_end, first_set, sets))
+                throw std::runtime_error("MuirData::MuirData(): No sets in the time window in " + _filename);
+
+            keep_rows(_time, first_set, sets);
+            keep_rows(_framecount, first_set, sets);
+            _set_offset = first_set;
+        }
+
+        // Decoding range gate g reads samples g .. g+phasecode-1, only read those
+        unsigned int range_start = 0;
+        unsigned int range_bins = dims[2];
+        if (window.range_start != 0 || window.range_bins != 0)
+            process_range_window(window, dims[2], range_start, range_bins);
+
+        hsize_t samples = std::min<hsize_t>(range_bins + std::max<std::size_t>(_phasecode.size(), 1) - 1, dims[2] - range_start);
+        _range_offset = range_start;
+        _sample_count = {sets, dims[1], samples, dims[3]};
+
+        // Streaming reads the samples a chunk at a time
+        if (option == 0)
+            read_sample_sets(file_in, 0, sets);
     }
 
     if (option == 1)
@@ -147,6 +207,72 @@ void MuirData::print_stats()
 
 }
 
+void MuirData::set_sample_block(std::size_t block)
+{
+    // Remembered for samples loaded later by decode_stream()
+    _sample_block = block;
+
+    if (block == 0)
+        return;
+
+    if (!_sample_layout.is_natural())
+        throw std::logic_error("MuirData::set_sample_block(): Sample data has already been re-laid out");
+
+    SampleLayout layout(_sample_layout.sets, _sample_layout.cols, _sample_layout.rangebins, block);
+    if (layout.is_natural())
+        return;
+
+    // Done once per file, the decoding passes then read it many times
+    Muir4DArrayF blocked;
+    sample_layout_transform(_sample_data, layout, blocked);
+
+    _sample_data.resize(boost::extents[0][0][0][0]);
+    _sample_data.resize(boost::extents[layout.blocks()][layout.frames()][layout.block][2]);
+    _sample_data = blocked;
+    _sample_layout = layout;
+}
+
+void MuirData::read_sample_sets(const MuirHD5 &file_in, std::size_t first, std::size_t sets)
+{
+    std::array<hsize_t,4> count = _sample_count;
+    count[0] = sets;
+
+    // Let go of the previous chunk before reading the next
+    _sample_data.resize(boost::extents[0][0][0][0]);
+
+    file_in.read_4D_float(RTI_RAWSAMPLEDATA_PATH, _sample_data, {_set_offset + first, 0, _range_offset, 0}, count);
+
+    _sample_layout = SampleLayout(_sample_data);
+    set_sample_block(_sample_block);
+}
+
+std::size_t MuirData::stream_chunk_sets(std::size_t max_memory) const
+{
+    std::size_t sets = _sample_count[0];
+    if (max_memory == 0)
+        return sets;
+
+    // Samples (twice over while being re-laid out into blocks), the time integrated
+    // samples and the decoded data are held at the same time
+    std::size_t integration = std::max(_decode_config.time_integration, 1u);
+    std::size_t frame_samples = _sample_count[2] * _sample_count[3];
+    std::size_t sample_bytes = _sample_count[1] * frame_samples * sizeof(float);
+    std::size_t set_bytes = sample_bytes * (_sample_block ? 2 : 1);
+    if (integration > 1)
+        set_bytes += _sample_count[1] / integration * frame_samples * sizeof(float);
+    set_bytes += _sample_count[1] / integration * _sample_count[2] * sizeof(float);
+
+    std::size_t chunk = max_memory / set_bytes;
+    if (chunk == 0)
+    {
+        std::cout << "MuirData: WARNING! Memory budget of " << max_memory << " bytes is less than one set ("
+                  << set_bytes << " bytes) of " << _filename << ", decoding one set at a time." << std::endl;
+        chunk = 1;
+    }
+
+    return std::min(chunk, sets);
+}
+
 int MuirData::decode(int id)
 {
     if(_phasecode.empty())
@@ -155,12 +281,32 @@ int MuirData::decode(int id)
         return 1;
     }
 
+    // Doppler window given in Hz depends on the sample rate of this file
+    process_doppler_window_hz(_decode_config, _txbaud);
+
+    // Range window given in km depends on the ranges of this file.  Range gates are
+    // counted from the start of the file, the samples in memory start at _range_offset.
+    process_range_window_km(_decode_config, _sample_range);
+    if (_decode_config.intermediate_stage == STAGE_ALL && _decode_config.range_start < _range_offset)
+        throw std::logic_error("MuirData::decode(): Range window starts before the samples that were loaded");
+    if (_decode_config.intermediate_stage == STAGE_ALL)
+        _decode_config.range_start -= _range_offset;
+
+    // Samples were written by the loading thread, move them next to the workers that decode them
+    numa_place(_sample_data.data(), _sample_data.num_elements() * sizeof(float));
+
     // Call general decoding process
     Muir4DArrayF complex_intermediate;
     //_decode_config.intermediate_row = 300;
     //_decode_config.intermediate_stage = STAGE_PHASECODE;
 
-    int err = process_data(id, _sample_data, _phasecode, _decoded_data, _decode_config, _decode_timing_strings, _decode_timings, complex_intermediate);
+    int err = 0;
+    if (_decode_config.schedule_rows)
+        err = process_data_scheduled(_sample_data, _sample_layout, _phasecode, _decoded_data, _decode_config, _decode_timing_strings, _decode_timings, complex_intermediate);
+    else
+        err = process_data(id, _sample_data, _sample_layout, _phasecode, _decoded_data, _decode_config, _decode_timing_strings, _decode_timings, complex_intermediate);
+
+    _decode_config.range_start += _range_offset;
 
     return err;
 }
@@ -177,8 +323,111 @@ void MuirData::save_decoded_data(const std::string &output_file)
     // Prepare and write decoded sample data
     h5file.write_3D_float(RTI_DECODEDDATA_PATH, _decoded_data);
 
-    // Prepare and write range data
-    h5file.write_2D_float(RTI_DECODEDRANGE_PATH, _sample_range);
+    write_decoded_info(h5file, _decoded_data.shape()[2]);
+
+    h5file.close();
+    return;
+
+
+}
+
+int MuirData::decode_stream(int id, const std::string &output_file, std::size_t max_memory)
+{
+    std::size_t sets = _sample_count[0];
+    std::size_t chunk = stream_chunk_sets(max_memory);
+
+    std::unique_ptr<MuirHD5> file_in;
+    std::unique_ptr<MuirHD5> h5file;
+    {
+        std::lock_guard<std::mutex> lock(hdf5_mutex());
+        file_in.reset(new MuirHD5(_filename, H5F_ACC_RDONLY));
+        h5file.reset(new MuirHD5(output_file, H5F_ACC_TRUNC));
+        h5file->createGroup(RTI_DECODEDDIR_PATH);
+    }
+
+    // Every chunk starts from the same configuration, time and row timings add up
+    DecodingConfig config = _decode_config;
+    double decoding_time = 0;
+    Muir2DArrayD timings(boost::extents[0][0]);
+
+    int err = 0;
+    for (std::size_t first = 0; first < sets && !err; first += chunk)
+    {
+        std::size_t count = std::min(chunk, sets - first);
+
+        {
+            std::lock_guard<std::mutex> lock(hdf5_mutex());
+            read_sample_sets(*file_in, first, count);
+        }
+
+        _decode_config = config;
+        err = decode(id);
+        if (err)
+            break;
+
+        decoding_time += _decode_config.decoding_time;
+        if (timings.num_elements() == 0)
+        {
+            timings.resize(boost::extents[_decode_timings.shape()[0]][_decode_timings.shape()[1]]);
+            timings = _decode_timings;
+        }
+        else
+        {
+            for (std::size_t stage = 0; stage < timings.shape()[0]; stage++)
+                for (std::size_t row = 0; row < timings.shape()[1]; row++)
+                    timings[stage][row] += _decode_timings[stage][row];
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(hdf5_mutex());
+            h5file->append_3D_float(RTI_DECODEDDATA_PATH, _decoded_data);
+        }
+
+        std::cout << "Thread[" << id << "] Decoded sets " << _set_offset + first << "-" << _set_offset + first + count - 1
+                  << " of " << _filename << std::endl;
+    }
+
+    std::size_t range_bins = _decoded_data.shape()[2];
+    _decoded_data.resize(boost::extents[0][0][0]);
+    _sample_data.resize(boost::extents[0][0][0][0]);
+
+    {
+        std::lock_guard<std::mutex> lock(hdf5_mutex());
+        if (!err)
+        {
+            _decode_config.decoding_time = decoding_time;
+            _decode_timings.resize(boost::extents[timings.shape()[0]][timings.shape()[1]]);
+            _decode_timings = timings;
+
+            write_decoded_info(*h5file, range_bins);
+        }
+
+        h5file.reset();
+        file_in.reset();
+    }
+
+    return err;
+}
+
+// Everything but the decoded data: ranges, times and how it was decoded
+void MuirData::write_decoded_info(MuirHD5 &h5file, std::size_t range_bins)
+{
+    // Prepare and write range data, just the range gates decoded
+    std::size_t range_start = _decode_config.range_start;
+    const Muir2DArrayF::size_type *range_dims = _sample_range.shape();
+    if (range_start + range_bins <= range_dims[1] && range_bins != range_dims[1])
+    {
+        Muir2DArrayF decoded_range(boost::extents[range_dims[0]][range_bins]);
+        for (std::size_t row = 0; row < range_dims[0]; row++)
+            for (std::size_t gate = 0; gate < range_bins; gate++)
+                decoded_range[row][gate] = _sample_range[row][range_start + gate];
+
+        h5file.write_2D_float(RTI_DECODEDRANGE_PATH, decoded_range);
+    }
+    else
+    {
+        h5file.write_2D_float(RTI_DECODEDRANGE_PATH, _sample_range);
+    }
 
     // Prepare and write radac data
     h5file.write_2D_double(RTI_DECODEDRADAC_PATH, _time);
@@ -188,9 +437,14 @@ void MuirData::save_decoded_data(const std::string &output_file)
 
     // Write Decoding Config
     h5file.write_scalar_uint(RTI_DECODEDFFTSIZE_PATH, _decode_config.fft_size);
+    h5file.write_scalar_uint(RTI_DECODEDDOPPLERSTART_PATH, _decode_config.doppler_start);
+    h5file.write_scalar_uint(RTI_DECODEDDOPPLERBINS_PATH, _decode_config.doppler_bins);
+    h5file.write_scalar_uint(RTI_DECODEDRANGEOFFSET_PATH, _decode_config.range_start);
+    h5file.write_scalar_uint(RTI_DECODEDSETOFFSET_PATH, _set_offset);
     h5file.write_scalar_uint(RTI_DECODEDTIMEINTEGRATION_PATH, _decode_config.time_integration);
     h5file.write_scalar_uint(RTI_DECODEDPHASECODEMUTING_PATH, _decode_config.phasecode_muting);
     h5file.write_scalar_uint(RTI_DECODEDDECODINGTHREADS_PATH, _decode_config.threads);
+    h5file.write_string(RTI_DECODEDDECODINGCPUS_PATH, _decode_config.cpus);
     h5file.write_string(RTI_DECODEDDECODINGPLATFORM_PATH, _decode_config.platform);
     h5file.write_string(RTI_DECODEDDECODINGDEVICE_PATH, _decode_config.device);
     h5file.write_string(RTI_DECODEDDECODINGPROCESS_PATH, _decode_config.process);
@@ -206,11 +460,6 @@ void MuirData::save_decoded_data(const std::string &output_file)
     h5file.write_2D_double(RTI_DECODEDROWTIMINGDATA_PATH, _decode_timings);
 
     h5file.write_1D_string(RTI_DECODEDROWTIMINGCOLUMNS_PATH, _decode_timing_strings);
-    
-    h5file.close();
-    return;
-
-
 }
 
 void MuirData::read_decoded_data(const std::string &input_file)
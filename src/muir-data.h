@@ -13,14 +13,16 @@
 //
 
 #include "H5Cpp.h"
+#include <array>
 #include <string>
 #include <vector>
 
 #include "muir-hd5.h"
 #include "muir-process.h"
+#include "muir-phasecode.h"
 
-typedef boost::multi_array<float , 4> SampleDataArray;
-typedef boost::multi_array<float , 3> DecodedDataArray;
+typedef Muir4DArrayF SampleDataArray;
+typedef Muir3DArrayF DecodedDataArray;
 
 
 
@@ -32,9 +34,14 @@ class MuirData
     float       _txbaud;
 
     void        print_onesamplecolumn(float (&sample)[1100][2], float (&range)[1100]);
-    std::vector<float> _phasecode;
+    PhaseCode   _phasecode;
 
     Muir4DArrayF _sample_data;
+    SampleLayout _sample_layout;
+    std::size_t  _sample_block;       // Range bins per block requested by set_sample_block()
+    std::array<hsize_t,4> _sample_count; // Shape of the samples in the time and range windows
+    unsigned int _range_offset;       // File range gate of the first sample loaded
+    std::size_t  _set_offset;         // File set of the first set loaded
     Muir3DArrayF _decoded_data;
 
     Muir2DArrayF  _sample_range;
@@ -47,30 +54,57 @@ class MuirData
     std::vector<std::string> _decode_timing_strings;
     Muir2DArrayD             _decode_timings;
 
+    // Load sets first .. first+sets-1 of the time window, re-laid out as set_sample_block() asked
+    void        read_sample_sets(const MuirHD5 &file_in, std::size_t first, std::size_t sets);
+    // Sets per chunk that keep decode_stream() within max_memory bytes
+    std::size_t stream_chunk_sets(std::size_t max_memory) const;
+    void        write_decoded_info(MuirHD5 &h5file, std::size_t range_bins);
+
    public:
-    MuirData(const std::string &filename_in, int option = 0);
+    // Option 0 loads a raw file, 1 a decoded file and 2 a raw file without its samples
+    // (for decode_stream()).  Only the samples needed to decode the time (set) and range
+    // windows of window_config are loaded.
+    MuirData(const std::string &filename_in, int option = 0, const DecodingConfig &window_config = DecodingConfig());
     virtual ~MuirData();
 
     void print_onesamplecolumn(const std::size_t run, const std::size_t column);
     void print_stats();
 
+    // Re-lay the sample data out in blocks of block range bins (see SampleLayout),
+    // 0 leaves the layout unchanged.
+    void set_sample_block(std::size_t block);
+    void set_decode_config(const DecodingConfig &config)
+        { _decode_config = config; };
     int  decode(int id = 0);
     void save_decoded_data(const std::string &output_file);
+    // Decode and save a chunk of sets at a time, holding roughly max_memory bytes of
+    // samples and decoded data (0 for the whole file in one chunk).  Chunks are appended
+    // to an extendible decoded data set, neither samples nor decoded data are kept.
+    int  decode_stream(int id, const std::string &output_file, std::size_t max_memory);
     void read_decoded_data(const std::string &input_file);
 
-    // read only accessors
+    // read only accessors (sample data is [set][col][range][2] unless set_sample_block() was used,
+    // starting at set get_set_offset() and range gate get_range_offset() of the file)
     const Muir4DArrayF&  get_sample_data() const
         { return _sample_data; };
+    const SampleLayout&  get_sample_layout() const
+        { return _sample_layout; };
     const Muir3DArrayF&  get_decoded_data() const
         { return _decoded_data; };
     const Muir2DArrayF&  get_sample_range() const
         { return _sample_range; };
+    unsigned int         get_range_offset() const
+        { return _range_offset; };
+    std::size_t          get_set_offset() const
+        { return _set_offset; };
     const Muir2DArrayUI& get_framecount() const
         { return _framecount; };
     const Muir2DArrayD&  get_time() const
         { return _time; };
     const std::string& get_filename() const
         { return _filename; };
+    const DecodingConfig& get_decode_config() const
+        { return _decode_config; };
 
    private:
     // No copying
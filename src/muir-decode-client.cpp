@@ -0,0 +1,303 @@
+//
+// C++ Executable: muir-decode-client
+//
+// Description: Sends files to the muir-decoded service to decode and reports each one as
+//              it is saved.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "muir-utility.h"
+#include "muir-process.h"
+#include "muir-config.h"
+#include "muir-socket.h"
+#include "muir-daemon.h"
+
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+namespace BST_PT = boost::posix_time;
+
+// Prototypes
+void print_help (void);
+
+int main (const int argc, const char * argv[])
+{
+    std::cout << "MUIR Decode Client, Version " << PACKAGE_VERSION << std::endl;
+
+    // There must at least be a file specified
+    if ( argc < 2 )
+    {
+        print_help();
+        return 1;
+    }
+
+    std::string address = daemon_default_address();
+    bool shutdown = false;
+    DecodeJob job;
+
+    for (int argi = 1; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi],"--socket"))
+        {
+            argi++;
+            address = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--shutdown"))
+        {
+            shutdown = true;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--output"))
+        {
+            argi++;
+            job.output_dir = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range"))  // Expects two more arguments
+        {
+            BST_PT::ptime t1,t2;
+            try
+            {
+                argi++;
+                t1 = BST_PT::from_iso_string(argv[argi]);
+                argi++;
+                t2 = BST_PT::from_iso_string(argv[argi]);
+            }
+            catch(...)
+            {
+                std::cout << "ERROR! Bad Date: " << argv[argi] << std::endl;
+                return 1;
+            }
+
+            job.config.time_start = radac_time(t1);
+            job.config.time_end = radac_time(t2);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fft-engine"))
+        {
+            argi++;
+            try
+            {
+                job.config.fft_engine = fft_engine_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--time-integration"))
+        {
+            argi++;
+            int pulses = atoi(argv[argi]);
+
+            if (pulses < 1)
+            {
+                std::cout << "ERROR! Time integration must be at least 1 pulse." << std::endl;
+                return 1;
+            }
+            job.config.time_integration = pulses;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range-tile"))
+        {
+            argi++;
+            job.config.range_tile = atoi(argv[argi]);
+
+            if (job.config.range_tile < 1)
+            {
+                std::cout << "ERROR! Range tile must be at least 1." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range-gates"))  // Expects two more arguments
+        {
+            argi++;
+            job.config.range_start = atoi(argv[argi]);
+            argi++;
+            job.config.range_bins = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range-km"))  // Expects two more arguments
+        {
+            argi++;
+            job.config.range_low_km = atof(argv[argi]);
+            argi++;
+            job.config.range_high_km = atof(argv[argi]);
+
+            if (!(job.config.range_low_km < job.config.range_high_km))
+            {
+                std::cout << "ERROR! Range window low altitude must be below the high altitude." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--doppler-bins"))  // Expects two more arguments
+        {
+            argi++;
+            job.config.doppler_start = atoi(argv[argi]);
+            argi++;
+            job.config.doppler_bins = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--doppler-hz"))  // Expects two more arguments
+        {
+            argi++;
+            job.config.doppler_low_hz = atof(argv[argi]);
+            argi++;
+            job.config.doppler_high_hz = atof(argv[argi]);
+
+            if (!(job.config.doppler_low_hz < job.config.doppler_high_hz))
+            {
+                std::cout << "ERROR! Doppler window low frequency must be below the high frequency." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--help") || !strcmp(argv[argi],"-h"))
+        {
+            print_help();
+            return 0;
+        }
+
+        // The service runs in its own directory
+        fs::path path1 = fs::absolute(fs::path(argv[argi]));
+
+        // If not a command, must be a file, or a directory of them (not its subdirectories)
+        if (fs::is_directory(path1))
+        {
+            for (fs::directory_iterator dirI(path1); dirI!=fs::directory_iterator(); ++dirI)
+            {
+                if (!fs::is_directory(*dirI))
+                    job.files.push_back(dirI->path().string());
+            }
+        }
+        else
+        {
+            job.files.push_back(path1.string());
+        }
+    }
+
+    // Decoded files go where they would from muir-decode run here
+    fs::path output_dir = fs::absolute(fs::path(job.output_dir));
+    if (!shutdown && !fs::exists(output_dir))
+    {
+        std::cout << "Output directory doesn't exist, creating: " << output_dir.string() << std::endl;
+
+        if (!fs::create_directories(output_dir))
+        {
+            std::cout << "ERROR: Cannot create output dir: " << output_dir.string() << std::endl;
+            return 1;
+        }
+    }
+    job.output_dir = output_dir.string();
+
+    // Never send a job to a socket someone else put at the address
+    try
+    {
+        daemon_check_address(address);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "ERROR! " << e.what() << std::endl;
+        return 1;
+    }
+
+    int fd;
+    try
+    {
+        fd = socket_open(address, false);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "ERROR! " << e.what() << " (is muir-decoded running?)" << std::endl;
+        return 1;
+    }
+
+    std::string buffer, line;
+
+    if (shutdown)
+    {
+        bool stopped = socket_send(fd, "SHUTDOWN\n") && socket_receive_line(fd, buffer, line) && line == "BYE";
+        close(fd);
+
+        std::cout << (stopped ? "muir-decoded is stopping" : "ERROR! No answer from muir-decoded") << std::endl;
+        return stopped ? 0 : 1;
+    }
+
+    if (!daemon_send_job(fd, job))
+    {
+        std::cout << "ERROR! Unable to send job to muir-decoded" << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    // One line per file as each finishes, then the summary
+    int status = 1;
+    while (socket_receive_line(fd, buffer, line))
+    {
+        if (line.compare(0, 5, "DONE ") == 0)
+        {
+            std::size_t space = line.find(' ', 5);
+            std::cout << "Decoded: " << line.substr(space + 1) << " (" << line.substr(5, space - 5) << "s)" << std::endl;
+        }
+        else if (line.compare(0, 8, "SKIPPED ") == 0)
+        {
+            std::cout << "Skipped, not in range: " << line.substr(8) << std::endl;
+        }
+        else if (line.compare(0, 7, "FAILED ") == 0)
+        {
+            std::cout << "ERROR! Unable to decode " << line.substr(7) << " (see the muir-decoded log)" << std::endl;
+        }
+        else if (line.compare(0, 4, "END ") == 0)
+        {
+            unsigned long decoded = 0, failed = 0;
+            sscanf(line.c_str(), "END %lu %lu", &decoded, &failed);
+            std::cout << decoded << " decoded, " << failed << " failed" << std::endl;
+            status = failed ? 1 : 0;
+            break;
+        }
+        else
+        {
+            std::cout << "ERROR! muir-decoded: " << line << std::endl;
+            break;
+        }
+    }
+
+    close(fd);
+    return status;
+}
+
+
+void print_help ()
+{
+    std::cout << "usage: muir-decode-client [--socket address] [--output dir] [decoding options] hdf5files|dirs..." << std::endl;
+    std::cout << "       muir-decode-client [--socket address] --shutdown" << std::endl;
+    std::cout << "  Decodes files with a running muir-decoded, which has its devices initialized and FFTs planned," << std::endl;
+    std::cout << "  printing each decoded file as it is saved.  Exits 1 if any file failed.  For a directory, the" << std::endl;
+    std::cout << "  files directly in it are decoded, not those in its subdirectories." << std::endl;
+    std::cout << "  --socket         : Address of muir-decoded (default " << daemon_default_address() << ")." << std::endl;
+    std::cout << "  --output         : Directory for the decoded files (default the current directory)." << std::endl;
+    std::cout << "  --shutdown       : Stop muir-decoded once the files it has queued are decoded." << std::endl;
+    std::cout << "  Decoding options, as for muir-decode: --range, --fft-engine, --time-integration, --range-tile," << std::endl;
+    std::cout << "  --range-gates, --range-km, --doppler-bins and --doppler-hz." << std::endl;
+}
@@ -1,10 +1,16 @@
 // 
 //
 //
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
+#include <iomanip>
+#include <stdexcept>
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -17,7 +23,15 @@
 #include "muir-hd5.h"
 #include "muir-utility.h"
 #include "muir-process.h"
+#include "muir-global.h"
+#include "muir-fftw.h"
 #include "muir-config.h"
+#include "muir-queue.h"
+#include "muir-partition.h"
+#include "muir-distribute.h"
+#include "muir-plan.h"
+#include "muir-taskpool.h"
+#include "muir-timer.h"
 
 namespace fs = boost::filesystem;
 namespace BST_PT = boost::posix_time;
@@ -47,13 +61,70 @@ struct Flags
 
 fs::path output_dir;
 int processing_threads = -1;  // Max out resources
+DecodingConfig decode_config; // Decoding options applied to every file
+std::size_t sample_block = 0; // Range bins per sample layout block, 0 for the file layout
+std::size_t max_memory = 0;   // Bytes of samples and decoded data per file, 0 loads whole files
+bool partition_cores = true;  // Give each decoding thread its own CPUs
+bool use_task_pool = true;    // Decode the rows of every CPU file on one shared pool of threads
+bool plan_only = false;       // Print the decoding plan and stop
+ShardSpec shard;              // This process's share of the files, see --shard
+std::string shard_manifest;   // Where to write every file's shard, empty for none
+DeviceThroughput throughput;  // Decoding speed of each device over this run
+std::string coordinator_address;      // Serve the files to workers instead of decoding them
+std::string worker_address;           // Decode files handed out by the coordinator
+double heartbeat_timeout = 30.0;      // Seconds before a silent worker's files are requeued
+MUIR::WorkClient *work_client = NULL; // Connection to the coordinator, while a worker
+std::atomic<std::size_t> files_failed(0); // Not loaded, decoded or saved, see file_finished()
 
 // Prototypes
 void print_help (void);
-void process_expfiles(std::vector<fs::path> files, const Flags& flags);  // No reference, want copies
+int  process_expfiles(std::vector<fs::path> files, const Flags& flags);  // No reference, want copies
+int  coordinate_expfiles(std::vector<fs::path> files, const Flags& flags);  // No reference, want copies
 void process_decfiles(std::vector<fs::path> files, const Flags& flags);  // No reference, want copies
 void cull_files_range(std::vector<fs::path> &files, const Flags& flags);
-void process_thread(int id, std::vector<fs::path> files, int *position);
+
+// A file passing through the reader, decoding and writer stages
+struct PipelineFile
+{
+    std::string expfile;
+    fs::path    datafile;
+    double      cost;      // Planned cost, see plan_files()
+    long        task;      // Coordinator's task, -1 for files from the command line
+    MuirData   *data;
+    int         err;
+};
+
+// Seconds a stage's threads spent working and waiting on their queues
+struct PipelineStage
+{
+    std::string name;
+    int         threads;
+    double      busy;      // Loading, decoding or saving
+    double      starved;   // Waiting for a file from the previous stage
+    double      blocked;   // Waiting for room in the next stage's queue
+    std::mutex  mutex;
+
+    PipelineStage(const std::string &name_in, int threads_in)
+    : name(name_in), threads(threads_in), busy(0), starved(0), blocked(0), mutex()
+    {}
+
+    void add(double busy_in, double starved_in, double blocked_in)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy += busy_in;
+        starved += starved_in;
+        blocked += blocked_in;
+    }
+};
+
+void read_stage(std::vector<PlanFile> files, MUIR::BoundedQueue<PipelineFile> *loaded, PipelineStage *stage);  // No reference, want copies
+void decode_stage(int id, const CorePartition *partition, MUIR::BoundedQueue<PipelineFile> *loaded, MUIR::BoundedQueue<PipelineFile> *decoded, PipelineStage *stage);
+void write_stage(MUIR::BoundedQueue<PipelineFile> *decoded, PipelineStage *stage);
+std::string save_path(const PipelineFile &item);
+void file_finished(const PipelineFile &item, bool saved);
+void print_pipeline_utilization(double seconds, const std::vector<PipelineStage *> &stages);
+void print_allocator_stats(void);
+void print_device_throughput(const std::vector<PlanFile> &planned);
 
 int main (const int argc, const char * argv[])
 {
@@ -101,9 +172,11 @@ int main (const int argc, const char * argv[])
                 return 1;
             }
 
-           // Date range specified
+           // Date range specified, files are culled and then only the sets in range are decoded
             flags.option_range = true;
             flags.range = BST_PT::time_period(t1, t2);
+            decode_config.time_start = radac_time(t1);
+            decode_config.time_end = radac_time(t2);
 
             continue;
         }
@@ -144,6 +217,220 @@ int main (const int argc, const char * argv[])
             processing_threads = atoi(argv[argi]);
             continue;
         }
+        if (!strcmp(argv[argi],"--plan"))
+        {
+            plan_only = true;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--shard"))
+        {
+            argi++;
+            try
+            {
+                shard = shard_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--shard-manifest"))
+        {
+            argi++;
+            shard_manifest = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--coordinator"))
+        {
+            argi++;
+            coordinator_address = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--worker"))
+        {
+            argi++;
+            worker_address = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--heartbeat"))
+        {
+            argi++;
+            heartbeat_timeout = atof(argv[argi]);
+
+            if (!(heartbeat_timeout > 0))
+            {
+                std::cout << "ERROR! Heartbeat timeout must be more than 0 seconds." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--no-task-pool"))
+        {
+            use_task_pool = false;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--no-partition"))
+        {
+            partition_cores = false;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--numa"))
+        {
+            argi++;
+            try
+            {
+                MUIR_NumaPolicy = numa_policy_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--huge-pages"))
+        {
+            argi++;
+            try
+            {
+                MUIR_HugePages = huge_page_policy_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--schedule"))
+        {
+            decode_config.schedule_rows = true;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fftw-wisdom"))
+        {
+            argi++;
+            MUIR_FFTWWisdomFile = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fftw-planner"))
+        {
+            argi++;
+            try
+            {
+                MUIR_FFTWPlannerFlags = planner_flags_from_string(argv[argi]);
+            }
+            catch(std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fft-engine"))
+        {
+            argi++;
+            try
+            {
+                decode_config.fft_engine = fft_engine_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--time-integration"))
+        {
+            argi++;
+            int pulses = atoi(argv[argi]);
+
+            if (pulses < 1)
+            {
+                std::cout << "ERROR! Time integration must be at least 1 pulse." << std::endl;
+                return 1;
+            }
+            decode_config.time_integration = pulses;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range-tile"))
+        {
+            argi++;
+            decode_config.range_tile = atoi(argv[argi]);
+
+            if (decode_config.range_tile < 1)
+            {
+                std::cout << "ERROR! Range tile must be at least 1." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--sample-block"))
+        {
+            argi++;
+            sample_block = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--max-memory"))
+        {
+            argi++;
+            double megabytes = atof(argv[argi]);
+
+            if (!(megabytes > 0))
+            {
+                std::cout << "ERROR! Memory budget must be more than 0 MB." << std::endl;
+                return 1;
+            }
+            max_memory = static_cast<std::size_t>(megabytes * 1024 * 1024);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range-gates"))  // Expects two more arguments
+        {
+            argi++;
+            decode_config.range_start = atoi(argv[argi]);
+            argi++;
+            decode_config.range_bins = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--range-km"))  // Expects two more arguments
+        {
+            argi++;
+            decode_config.range_low_km = atof(argv[argi]);
+            argi++;
+            decode_config.range_high_km = atof(argv[argi]);
+
+            if (!(decode_config.range_low_km < decode_config.range_high_km))
+            {
+                std::cout << "ERROR! Range window low altitude must be below the high altitude." << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--doppler-bins"))  // Expects two more arguments
+        {
+            argi++;
+            decode_config.doppler_start = atoi(argv[argi]);
+            argi++;
+            decode_config.doppler_bins = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--doppler-hz"))  // Expects two more arguments
+        {
+            argi++;
+            decode_config.doppler_low_hz = atof(argv[argi]);
+            argi++;
+            decode_config.doppler_high_hz = atof(argv[argi]);
+
+            if (!(decode_config.doppler_low_hz < decode_config.doppler_high_hz))
+            {
+                std::cout << "ERROR! Doppler window low frequency must be below the high frequency." << std::endl;
+                return 1;
+            }
+            continue;
+        }
         if (!strcmp(argv[argi],"--gpu-cuda"))
         {
             flags.option_dec_cuda = true;
@@ -182,13 +469,31 @@ int main (const int argc, const char * argv[])
         }
     }
 
-    process_expfiles(files, flags);
+    if (!coordinator_address.empty() && !worker_address.empty())
+    {
+        std::cout << "ERROR! A process is either the coordinator or a worker, not both." << std::endl;
+        return 1;
+    }
+
+    // First touch places pages by each file's own OpenMP team, which the pool's workers
+    // (unpinned, in steal order) are not
+    if (MUIR_NumaPolicy == NUMA_FIRST_TOUCH && use_task_pool)
+    {
+        std::cout << "WARNING! --numa first-touch needs each file decoded by its own OpenMP team, using --no-task-pool." << std::endl;
+        use_task_pool = false;
+    }
+
+    // A campaign with files given up on is a failure, for the scheduler scripts running it
+    // (as is any file a standalone, --shard or --worker process couldn't decode)
+    if (!coordinator_address.empty())
+        return coordinate_expfiles(files, flags);
 
-    return 0;  // successfully terminated
+    return process_expfiles(files, flags) ? 1 : 0;
 }
 
 
-void process_expfiles(std::vector<fs::path> files, const Flags& flags)
+// Number of files that failed, or 1 if nothing could be decoded at all
+int process_expfiles(std::vector<fs::path> files, const Flags& flags)
 {
     // Initialize decoding context
     int methods = flags.option_dec_opencl*MUIR_DECODE_GPU_OPENCL | flags.option_dec_cuda*MUIR_DECODE_GPU_CUDA | flags.option_dec_cpu*MUIR_DECODE_CPU;
@@ -196,41 +501,185 @@ void process_expfiles(std::vector<fs::path> files, const Flags& flags)
     if(devices == 0)
     {
         std::cout << "NO DEVICES FOUND!" << std::endl;
-        return;
+        return 1;
     }
     else
     {
         std::cout << "Processing devices initialized: " << devices << std::endl;
     }
  
+    // Files come from the coordinator instead of the command line
+    std::unique_ptr<MUIR::WorkClient> client;
+    if (!worker_address.empty())
+    {
+        try
+        {
+            client.reset(new MUIR::WorkClient(worker_address));
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << "ERROR! " << e.what() << std::endl;
+            process_cleanup();
+            return 1;
+        }
+        work_client = client.get();
+
+        if (!files.empty())
+            std::cout << "Worker: Ignoring the " << files.size() << " files given, decoding the coordinator's." << std::endl;
+        files.clear();
+    }
+
     if (flags.option_range)
     {
         cull_files_range(files, flags);
     }
 
-    int position = 0;
-
-
     if (processing_threads == -1)
         processing_threads = process_get_num_devices();
 
-    // Create threads
+    // Every device works on the same file, one file at a time
+    if (decode_config.schedule_rows && processing_threads != 1)
+    {
+        std::cout << "Decoding each file on all " << process_get_num_devices() << " devices, one file at a time." << std::endl;
+        processing_threads = 1;
+    }
+
+    // Largest files first (LPT), so a big file isn't left to run alone at the end.  Free
+    // decoding threads take the next file, so faster devices take more of them.
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; i < files.size(); i++)
+        paths.push_back(files[i].string());
+
+    std::vector<PlanFile> planned = plan_files(paths, decode_config);
+
+    // Every process given the same files and --shard i/N takes its own part of them
+    if (!shard_manifest.empty())
+    {
+        try
+        {
+            write_shard_manifest(shard_manifest, planned, shard.count);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << "ERROR! " << e.what() << std::endl;
+            process_cleanup();
+            return 1;
+        }
+    }
+    if (shard.count > 1)
+        planned = plan_shard(planned, shard);
+
+    if (plan_only || MUIR_Verbose)
+    {
+        bool measured = false;
+        std::vector<double> rates = throughput.rates(processing_threads, &measured);
+        print_plan(std::cout, planned, plan_dispatch(planned, rates), measured);
+    }
+
+    if (plan_only)
+    {
+        process_cleanup();
+        return 0;
+    }
+
+    // Reader -> decoding threads -> writer.  Each queue holds one file per decoding
+    // thread, so the next files are loaded while the current ones decode and decoded
+    // files are saved in the background.
+    MUIR::Timer pipeline_timer;
+    MUIR::BoundedQueue<PipelineFile> loaded(processing_threads);
+    MUIR::BoundedQueue<PipelineFile> decoded(processing_threads);
+
+    PipelineStage reading("Read", 1);
+    PipelineStage decoding("Decode", processing_threads);
+    PipelineStage writing("Write", 1);
+
+    boost::thread reader(boost::bind(read_stage, planned, &loaded, &reading));
+    boost::thread writer(boost::bind(write_stage, &decoded, &writing));
+
+    std::vector<bool> host_workers(processing_threads);
+    for (int i = 0; i < processing_threads; i++)
+        host_workers[i] = process_device_is_host(i);
+
+    // Rows of every file decoded on the host become tasks of one pool with a worker per
+    // CPU, so concurrent files don't oversubscribe the CPUs and the last file gets them all
+    bool pooled = use_task_pool && std::count(host_workers.begin(), host_workers.end(), true) > 0;
+    if (pooled)
+        task_pool_start(0);
+
+    // Otherwise each decoding thread's OpenMP team gets its own CPUs, instead of every
+    // thread starting a team the size of the machine
+    std::vector<CorePartition> partitions;
+    if (partition_cores && !pooled && processing_threads > 1)
+        partitions = core_partitions(host_workers);
+
+    // Create decoding threads
     boost::thread_group g;
 
     for (int i = 1; i < processing_threads; i++)
     {
-        boost::thread *t = new boost::thread(boost::bind(process_thread, i, files, &position));
+        const CorePartition *partition = partitions.empty() ? NULL : &partitions[i];
+        boost::thread *t = new boost::thread(boost::bind(decode_stage, i, partition, &loaded, &decoded, &decoding));
         g.add_thread(t);
     }
 
-    // Proces sin main thread as well.
-    process_thread(0, files, &position);
+    // Decode in main thread as well.
+    decode_stage(0, partitions.empty() ? NULL : &partitions[0], &loaded, &decoded, &decoding);
     g.join_all();
-    
+
+    // Nothing more to save once every decoding thread is done
+    decoded.close();
+    writer.join();
+    reader.join();
+
+    task_pool_stop();
+    print_pipeline_utilization(pipeline_timer.elapsed(), {&reading, &decoding, &writing});
+    print_allocator_stats();
+    print_device_throughput(planned);
+
+    work_client = NULL;
+    client.reset();
+
+    // Release decoding context
+    process_cleanup();
+
+    if (files_failed)
+        std::cout << "ERROR! " << files_failed << " files could not be decoded." << std::endl;
+
+    return static_cast<int>(files_failed);
 }
 
 
 
+// 1 if any file was given up on or the coordinator couldn't run
+int coordinate_expfiles(std::vector<fs::path> files, const Flags& flags)
+{
+    if (flags.option_range)
+    {
+        cull_files_range(files, flags);
+    }
+
+    // Handed out largest first, the same order a single process decodes them in
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; i < files.size(); i++)
+        paths.push_back(files[i].string());
+
+    std::vector<PlanFile> planned = plan_files(paths, decode_config);
+    if (shard.count > 1)
+        planned = plan_shard(planned, shard);
+
+    try
+    {
+        MUIR::WorkCoordinator coordinator(planned, heartbeat_timeout);
+        return coordinator.serve(coordinator_address) ? 1 : 0;
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "ERROR! " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+
 void cull_files_range(std::vector<fs::path> &files, const Flags& flags)
 {
     std::cout << "Scanning for files in range: " << BST_PT::to_simple_string(flags.range) << std::endl;
@@ -258,65 +707,364 @@ void cull_files_range(std::vector<fs::path> &files, const Flags& flags)
 
 }
 
-boost::mutex thread_mutex;
-//boost::shared_lock threadlock(m);
-
-void process_thread(int id, std::vector<fs::path> files, int *position)
+void read_stage(std::vector<PlanFile> files, MUIR::BoundedQueue<PipelineFile> *loaded, PipelineStage *stage)
 {
-    int i = 0;
-    {
-        boost::mutex::scoped_lock lock(thread_mutex);
-        if (id != 0)
-            i = ++(*position);
-    }
+    std::size_t next = 0;
 
-    while (i < static_cast<int>(files.size()))
+    while (true)
     {
-        
-        std::string expfile =  files[i].string();
+        MUIR::Timer timer;
+
+        // The planned files, or whatever the coordinator hands out next
+        PipelineFile item;
+        item.task = -1;
+        if (work_client)
+        {
+            MUIR::WorkTask task;
+            if (!work_client->next(task))
+                break;
+
+            item.expfile = task.path;
+            item.cost = task.cost;
+            item.task = task.id;
+        }
+        else
+        {
+            if (next == files.size())
+                break;
+
+            item.expfile = files[next].path;
+            item.cost = files[next].cost;
+            next++;
+        }
 
         // Strips .h5 from file
-        std::string base = fs::basename(files[i]);
+        item.datafile = output_dir / fs::path(fs::basename(fs::path(item.expfile)) + std::string(".decoded.h5"));
+        item.data = NULL;
+        item.err = 0;
 
-        // Loading file
-        MuirData *data;
+        double starved = timer.elapsed();
+        timer.restart();
+
+        try
+        {
+            // Streaming decodes load their samples a chunk at a time themselves
+            std::lock_guard<std::mutex> hdf5_lock(hdf5_mutex());
+            std::cout << "Reader: Loading Experiment Data: " << item.expfile << std::endl;
+            item.data = new MuirData(item.expfile, max_memory ? 2 : 0, decode_config);
+        }
+        catch (std::exception &e)
+        {
+            std::cout << "Reader: ERROR! Unable to load " << item.expfile << ": " << e.what() << std::endl;
+            file_finished(item, false);
+            stage->add(timer.elapsed(), starved, 0);
+            continue;
+        }
+        catch (const H5::Exception &e)
         {
-            boost::mutex::scoped_lock lock(thread_mutex);
-            std::cout << "Thread[" << id << "] Loading Experiment Data: " << expfile << std::endl;
-            data = new MuirData(expfile);
+            // Not a std::exception, Ex: a truncated or non-HDF5 file
+            std::cout << "Reader: ERROR! Unable to load " << item.expfile << ": " << e.getDetailMsg() << std::endl;
+            file_finished(item, false);
+            stage->add(timer.elapsed(), starved, 0);
+            continue;
         }
 
-        std::cout << "Thread[" << id << "] Decoding: " << expfile << std::endl;
-        int err = data->decode(id);
+        // Re-laid out here so it overlaps decoding too
+        item.data->set_sample_block(sample_block);
+        item.data->set_decode_config(decode_config);
+
+        double busy = timer.elapsed();
+        timer.restart();
 
-        fs::path datafile = output_dir / fs::path(base + std::string(".decoded.h5"));
+        if (!loaded->push(item))
         {
-            boost::mutex::scoped_lock lock(thread_mutex);
-            if (!err)
+            file_finished(item, false);
+            delete item.data;
+            break;
+        }
+
+        stage->add(busy, starved, timer.elapsed());
+    }
+
+    loaded->close();
+}
+
+void decode_stage(int id, const CorePartition *partition, MUIR::BoundedQueue<PipelineFile> *loaded, MUIR::BoundedQueue<PipelineFile> *decoded, PipelineStage *stage)
+{
+    // Before any parallel region, so the OpenMP team is created on the partition
+    if (partition)
+    {
+        std::cout << "Thread[" << id << "] Bound to " << partition->to_string() << std::endl;
+        core_partition_bind(*partition);
+    }
+
+    // Pin the team's workers so the pages they first touch stay on their node.  Pooled
+    // rows are decoded by the pool's workers, a pinned team would only compete with them.
+    if (MUIR_NumaPolicy != NUMA_NONE && !task_pool())
+        numa_bind_team();
+
+    PipelineFile item;
+
+    while (true)
+    {
+        MUIR::Timer timer;
+        if (!loaded->pop(item))
+            break;
+
+        double starved = timer.elapsed();
+        timer.restart();
+
+        try
+        {
+            if (max_memory)
             {
-                std::cout << "Thread[" << id << "] Saving decoded data: " << datafile.string() << std::endl;
-                data->save_decoded_data(datafile.string());
+                // Reads, decodes and saves a chunk of sets at a time, nothing left for the writer
+                std::cout << "Thread[" << id << "] Streaming: " << item.expfile << " to " << item.datafile.string() << std::endl;
+                item.err = item.data->decode_stream(id, save_path(item), max_memory);
             }
-            delete data;
- 
-            i = ++(*position);
+            else
+            {
+                std::cout << "Thread[" << id << "] Decoding: " << item.expfile << std::endl;
+                item.err = item.data->decode(id);
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::cout << "Thread[" << id << "] ERROR! Unable to decode " << item.expfile << ": " << e.what() << std::endl;
+            item.err = 1;
+        }
+
+        double busy = timer.elapsed();
+        timer.restart();
+
+        if (!item.err)
+            throughput.record(id, item.cost, busy);
+
+        if (max_memory || item.err || !decoded->push(item))
+        {
+            // Streamed files are already saved
+            file_finished(item, max_memory && !item.err);
+            delete item.data;
         }
 
+        stage->add(busy, starved, timer.elapsed());
     }
 
     std::cout << "Thread[" << id << "] Done! " << std::endl;
 }
 
+void write_stage(MUIR::BoundedQueue<PipelineFile> *decoded, PipelineStage *stage)
+{
+    PipelineFile item;
+
+    while (true)
+    {
+        MUIR::Timer timer;
+        if (!decoded->pop(item))
+            break;
+
+        double starved = timer.elapsed();
+        timer.restart();
+
+        bool saved = true;
+        try
+        {
+            std::lock_guard<std::mutex> hdf5_lock(hdf5_mutex());
+            std::cout << "Writer: Saving decoded data: " << item.datafile.string() << std::endl;
+            item.data->save_decoded_data(save_path(item));
+        }
+        catch (std::exception &e)
+        {
+            std::cout << "Writer: ERROR! Unable to save " << item.datafile.string() << ": " << e.what() << std::endl;
+            saved = false;
+        }
+
+        file_finished(item, saved);
+        delete item.data;
+
+        stage->add(timer.elapsed(), starved, 0);
+    }
+}
+
+// Workers save under a name of their own and rename it into place once it is complete,
+// so a file requeued from a worker that only seemed dead is never half written by two
+std::string save_path(const PipelineFile &item)
+{
+    if (!work_client || item.task < 0)
+        return item.datafile.string();
+
+    return item.datafile.string() + ".part-" + work_client->name();
+}
+
+// Count a file that failed and tell the coordinator how a file it handed out went
+void file_finished(const PipelineFile &item, bool saved)
+{
+    if (!work_client || item.task < 0)
+    {
+        if (!saved)
+            files_failed++;
+        return;
+    }
+
+    boost::system::error_code error;
+    if (saved)
+    {
+        fs::rename(fs::path(save_path(item)), item.datafile, error);
+        if (error)
+        {
+            std::cout << "Worker: ERROR! Unable to rename " << save_path(item) << ": " << error.message() << std::endl;
+            saved = false;
+        }
+    }
+
+    if (!saved)
+        files_failed++;
+
+    if (saved)
+    {
+        work_client->finished(item.task);
+    }
+    else
+    {
+        fs::remove(fs::path(save_path(item)), error);
+        work_client->failed(item.task);
+    }
+}
+
+void print_pipeline_utilization(double seconds, const std::vector<PipelineStage *> &stages)
+{
+    if (!(seconds > 0))
+        return;
+
+    std::cout << std::setprecision(1);
+    std::cout.setf(std::ios::fixed,std::ios::floatfield);
+
+    // Busy time of the stage's threads over the run, the busiest stage sets the pace
+    const PipelineStage *busiest = NULL;
+    double busiest_utilization = -1;
+
+    std::cout << "Pipeline: " << seconds << "s" << std::endl;
+    for (std::size_t i = 0; i < stages.size(); i++)
+    {
+        const PipelineStage *stage = stages[i];
+        double utilization = stage->busy / (seconds * stage->threads) * 100;
+
+        std::cout << "Pipeline: " << std::setw(6) << stage->name << " (" << stage->threads << " thread" << (stage->threads == 1 ? "" : "s") << ") "
+                  << std::setw(5) << utilization << "% busy, "
+                  << stage->starved << "s waiting for input, "
+                  << stage->blocked << "s waiting for the next stage" << std::endl;
+
+        if (utilization > busiest_utilization)
+        {
+            busiest = stage;
+            busiest_utilization = utilization;
+        }
+    }
+
+    if (busiest)
+        std::cout << "Pipeline: " << busiest->name << " bound" << std::endl;
+}
+
+void print_device_throughput(const std::vector<PlanFile> &planned)
+{
+    bool measured = false;
+    std::vector<double> rates = throughput.rates(processing_threads, &measured);
+    if (!measured)
+        return;
+
+    for (std::size_t i = 0; i < rates.size(); i++)
+        std::cout << "Plan: Thread[" << i << "] " << std::setprecision(3) << std::scientific << rates[i]
+                  << " cost/s" << std::fixed << std::endl;
+
+    // What the same batch would be expected to take, now the speeds are known
+    if (MUIR_Verbose)
+        print_plan(std::cout, planned, plan_dispatch(planned, rates), true);
+}
+
+void print_allocator_stats(void)
+{
+    const double MB = 1024.0 * 1024.0;
+    MuirAllocatorStats stats = muir_allocator_stats();
+
+    std::cout << std::setprecision(1);
+    std::cout.setf(std::ios::fixed,std::ios::floatfield);
+
+    std::cout << "Allocator: " << stats.allocations << " arrays allocated, " << stats.peak_bytes / MB << " MB peak, "
+              << stats.bytes_in_use / MB << " MB still in use" << std::endl;
+    std::cout << "Allocator: " << stats.mapped_blocks << " large arrays mapped, " << stats.huge_bytes / MB << " MB on huge pages ("
+              << huge_page_policy_name(MUIR_HugePages) << ")";
+    if (stats.hugetlb_fallbacks)
+        std::cout << ", " << stats.hugetlb_fallbacks << " fell back to base pages";
+    std::cout << std::endl;
+}
+
 
 
 void print_help ()
 {
     std::cout << "usage: muir-decode [--range yyyymmddThhmmss yyyymmddThhmmss] hdf5files... " << std::endl;
-    std::cout << "  --range          : Only process files that fall within a specified ISO date range in GMT." << std::endl;
+    std::cout << "  Exits 1 if any file couldn't be loaded, decoded or saved (or, with --coordinator, was given up on)." << std::endl;
+    std::cout << "  --range          : Only process the sets (and files) that fall within a specified ISO date range" << std::endl;
+    std::cout << "                     in GMT.  Only those sets are read and written to the decoded files." << std::endl;
     std::cout << "  --gpu-cuda       : Force GPU CUDA decoding method." << std::endl;
     std::cout << "  --gpu-opencl     : Froce GPU OpenCL decoding method." << std::endl;
     std::cout << "  --cpu            : Force CPU decoding method. (May be combined with one other gpu method)" << std::endl;
     std::cout << "  --output         : Specify a directory for output files" << std::endl;
     std::cout << "  --threads        : Specify the number of files to process simultaniously. Default is" << std::endl;
     std::cout << "                     one file per device. (Ex: GPU, CPU).  Extra threads goto CPU device." << std::endl;
+    std::cout << "                     Files are loaded ahead and saved behind the decoding threads by one reader" << std::endl;
+    std::cout << "                     and one writer thread, with utilization of each stage reported at the end." << std::endl;
+    std::cout << "  --plan           : Print the order files would be decoded in (largest first, by sets x columns x" << std::endl;
+    std::cout << "                     range bins x FFT size) and the expected spread over the decoding threads," << std::endl;
+    std::cout << "                     then stop without decoding." << std::endl;
+    std::cout << "  --shard          : Decode only shard i of N (Ex: 0/4 .. 3/4), for N processes given the same files," << std::endl;
+    std::cout << "                     on one machine or many.  Files are dealt largest first to the shard with the" << std::endl;
+    std::cout << "                     least work so far, the same way in every process whatever order they are listed." << std::endl;
+    std::cout << "  --shard-manifest : Write every file's shard and cost to the specified file, to check coverage." << std::endl;
+    std::cout << "  --coordinator    : Don't decode, serve the files (largest first) to worker processes on an address," << std::endl;
+    std::cout << "                     host:port, :port (localhost only) or unix:/path.  Workers that disconnect or" << std::endl;
+    std::cout << "                     miss their heartbeats have their files handed to others (3 attempts a file)." << std::endl;
+    std::cout << "                     There is no authentication, anyone who can connect can take files or report" << std::endl;
+    std::cout << "                     them decoded, so only listen on a host other machines can reach (Ex: 0.0.0.0:port)" << std::endl;
+    std::cout << "                     on a trusted network." << std::endl;
+    std::cout << "  --worker         : Decode the files handed out by the coordinator at the address, until there" << std::endl;
+    std::cout << "                     are none left.  Give workers the same decoding options (and --output)." << std::endl;
+    std::cout << "  --heartbeat      : Seconds the coordinator waits to hear from a worker before requeueing its" << std::endl;
+    std::cout << "                     files (default 30).  Workers send a heartbeat every third of that." << std::endl;
+    std::cout << "  --no-task-pool   : Decode each CPU file with its own OpenMP team.  By default the range rows of" << std::endl;
+    std::cout << "                     every file decoding on the CPU are tasks of one work stealing pool with a" << std::endl;
+    std::cout << "                     thread per CPU, so threads that finish early help with the files still running." << std::endl;
+    std::cout << "                     Implied by --numa first-touch." << std::endl;
+    std::cout << "  --no-partition   : With --no-task-pool, let every decoding thread use all CPUs.  By default the" << std::endl;
+    std::cout << "                     CPUs (grouped by NUMA node) are split between the decoding threads, with one CPU" << std::endl;
+    std::cout << "                     per GPU thread." << std::endl;
+    std::cout << "  --numa           : Placement of sample and decoded arrays on NUMA machines: none (default)," << std::endl;
+    std::cout << "                     first-touch (each page on the node of the CPU thread decoding it, with those" << std::endl;
+    std::cout << "                     threads pinned, turns off the task pool) or interleave (pages spread round" << std::endl;
+    std::cout << "                     robin over all nodes)." << std::endl;
+    std::cout << "  --huge-pages     : Back large sample and decoded arrays with huge pages: none (default)," << std::endl;
+    std::cout << "                     transparent (madvise, kernel promotes when it can) or hugetlb (reserved" << std::endl;
+    std::cout << "                     pool, see /proc/sys/vm/nr_hugepages; base pages when it runs out)." << std::endl;
+    std::cout << "  --schedule       : Decode one file at a time on all devices together, in blocks of range rows" << std::endl;
+    std::cout << "                     sized by each device's speed, instead of one file per device." << std::endl;
+    std::cout << "  --fft-engine     : CPU FFT engine: auto (default), fftw, pruned or dft.  The pruned engine skips" << std::endl;
+    std::cout << "                     the zero padding past the phasecode, auto uses it for short codes.  The dft" << std::endl;
+    std::cout << "                     engine computes only the Doppler window, auto uses it for narrow windows." << std::endl;
+    std::cout << "  --time-integration: Coherently average this many consecutive pulses before decoding (Ex: 4)." << std::endl;
+    std::cout << "                     Decoded output has that many times fewer columns.  Default is 1 (none)." << std::endl;
+    std::cout << "  --range-tile     : Number of consecutive range offsets each CPU thread decodes per batched FFT" << std::endl;
+    std::cout << "                     (default 1).  Each thread's buffers grow by the same factor." << std::endl;
+    std::cout << "  --sample-block   : Re-lay each file's samples out in blocks of this many range bins after" << std::endl;
+    std::cout << "                     loading, so decoding reads fewer pages (Ex: 64).  Default is the file layout." << std::endl;
+    std::cout << "  --max-memory     : Decode each file a chunk of sets at a time, holding about this many MB of" << std::endl;
+    std::cout << "                     samples and decoded data, and append each chunk to the decoded file." << std::endl;
+    std::cout << "  --range-gates    : Only decode range gates first .. first+count-1 (first count), count 0 for the rest." << std::endl;
+    std::cout << "  --range-km       : Only decode the range gates between two ranges in km (low high), resolved with" << std::endl;
+    std::cout << "                     each file's sample ranges.  Only the samples needed are read from the file." << std::endl;
+    std::cout << "  --doppler-bins   : Only search Doppler bins first .. first+count-1 for the peak (first count)." << std::endl;
+    std::cout << "  --doppler-hz     : Only search the Doppler window between two frequencies in Hz (low high)," << std::endl;
+    std::cout << "                     negative frequencies allowed.  Converted to bins using each file's TxBaud." << std::endl;
+    std::cout << "  --fftw-wisdom    : Load FFTW wisdom from, and save new wisdom to, the specified file." << std::endl;
+    std::cout << "  --fftw-planner   : FFTW planner rigor: estimate, measure (default), patient or exhaustive." << std::endl;
+    std::cout << "                     Use patient or exhaustive with --fftw-wisdom to plan once and reuse the result." << std::endl;
 }
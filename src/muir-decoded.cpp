@@ -0,0 +1,615 @@
+//
+// C++ Executable: muir-decoded
+//
+// Description: Decoding service.  Initializes the devices once (OpenCL programs built,
+//              FFTW planned, decoding threads and their buffers started) and then decodes
+//              the jobs muir-decode-client sends it until told to stop.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/convenience.hpp>
+
+#include "muir-data.h"
+#include "muir-hd5.h"
+#include "muir-constants.h"
+#include "muir-utility.h"
+#include "muir-process.h"
+#include "muir-global.h"
+#include "muir-allocator.h"
+#include "muir-fftw.h"
+#include "muir-config.h"
+#include "muir-queue.h"
+#include "muir-partition.h"
+#include "muir-taskpool.h"
+#include "muir-socket.h"
+#include "muir-daemon.h"
+#include "muir-timer.h"
+
+// POSIX sockets
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+/// Constants
+static const std::string SectionName("Daemon");
+
+std::string socket_address = daemon_default_address();
+int processing_threads = -1;  // One per device
+std::size_t sample_block = 0; // Range bins per sample layout block, 0 for the file layout
+std::size_t max_memory = 0;   // Bytes of samples and decoded data per file, 0 loads whole files
+bool partition_cores = true;  // Give each decoding thread its own CPUs
+bool use_task_pool = true;    // Decode the rows of every CPU file on one shared pool of threads
+std::string warm_file;        // Decoded once by every thread at startup, Ex: a typical experiment file
+static std::atomic<bool> stopping(false);
+
+// Client threads are detached when they start, shutdown waits for this to reach zero
+static std::mutex clients_mutex;
+static std::condition_variable clients_finished;
+static std::size_t clients_running = 0;
+
+// A client's job.  Decoding threads post a reply as each of its files finishes, the
+// client's thread sends them on.
+struct DaemonJob
+{
+    DecodeJob               request;
+    std::mutex              mutex;
+    std::condition_variable changed;
+    std::deque<std::string> replies;
+    std::size_t             pending;
+
+    DaemonJob() : pending(0) {}
+
+    void reply(const std::string &line)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        replies.push_back(line);
+        pending--;
+        changed.notify_all();
+    }
+};
+
+// A file of a job, waiting for a decoding thread
+struct DaemonFile
+{
+    std::shared_ptr<DaemonJob> job;
+    std::string                expfile;
+};
+
+// Prototypes
+void print_help (void);
+int  serve(void);
+void decode_thread(int id, const CorePartition *partition, MUIR::BoundedQueue<DaemonFile> *queue);
+void decode_file(int id, const DaemonFile &file);
+void warm_thread(int id);
+void client_thread(int fd, MUIR::BoundedQueue<DaemonFile> *queue);
+void client_start(int fd, MUIR::BoundedQueue<DaemonFile> *queue);
+void stop_signal(int signal);
+
+int main (const int argc, const char * argv[])
+{
+    std::cout << "MUIR Decode Daemon, Version " << PACKAGE_VERSION << std::endl;
+
+    unsigned int methods = 0;
+
+    for (int argi = 1; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi],"--socket"))
+        {
+            argi++;
+            socket_address = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--cpu"))
+        {
+            methods |= MUIR_DECODE_CPU;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--gpu-opencl"))
+        {
+            methods |= MUIR_DECODE_GPU_OPENCL;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--gpu-cuda"))
+        {
+            methods |= MUIR_DECODE_GPU_CUDA;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--threads"))
+        {
+            argi++;
+            processing_threads = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--warm"))
+        {
+            argi++;
+            warm_file = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--sample-block"))
+        {
+            argi++;
+            sample_block = atoi(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--max-memory"))
+        {
+            argi++;
+            double megabytes = atof(argv[argi]);
+
+            if (!(megabytes > 0))
+            {
+                std::cout << "ERROR! Memory budget must be more than 0 MB." << std::endl;
+                return 1;
+            }
+            max_memory = static_cast<std::size_t>(megabytes * 1024 * 1024);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--no-task-pool"))
+        {
+            use_task_pool = false;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--no-partition"))
+        {
+            partition_cores = false;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--numa"))
+        {
+            argi++;
+            try
+            {
+                MUIR_NumaPolicy = numa_policy_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--huge-pages"))
+        {
+            argi++;
+            try
+            {
+                MUIR_HugePages = huge_page_policy_from_string(argv[argi]);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fftw-wisdom"))
+        {
+            argi++;
+            MUIR_FFTWWisdomFile = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fftw-planner"))
+        {
+            argi++;
+            try
+            {
+                MUIR_FFTWPlannerFlags = planner_flags_from_string(argv[argi]);
+            }
+            catch(std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--help") || !strcmp(argv[argi],"-h"))
+        {
+            print_help();
+            return 0;
+        }
+
+        std::cout << "ERROR! Unknown option: " << argv[argi] << std::endl;
+        print_help();
+        return 1;
+    }
+
+    // First touch places pages by each file's own OpenMP team, which the pool's workers
+    // (unpinned, in steal order) are not
+    if (MUIR_NumaPolicy == NUMA_FIRST_TOUCH && use_task_pool)
+    {
+        std::cout << "WARNING! --numa first-touch needs each file decoded by its own OpenMP team, using --no-task-pool." << std::endl;
+        use_task_pool = false;
+    }
+
+    // Everything a muir-decode run pays for before its first file, paid once
+    int devices = process_init(methods, NULL);
+    if (devices == 0)
+    {
+        std::cout << "NO DEVICES FOUND!" << std::endl;
+        return 1;
+    }
+    std::cout << "Processing devices initialized: " << devices << std::endl;
+
+    if (processing_threads == -1)
+        processing_threads = process_get_num_devices();
+
+    int status = serve();
+
+    // Release decoding context, saving any FFTW wisdom learned
+    process_cleanup();
+
+    return status;
+}
+
+
+int serve(void)
+{
+    int listen_fd;
+    try
+    {
+        daemon_prepare_address(socket_address);
+        listen_fd = socket_open(socket_address, true);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "ERROR! " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, stop_signal);
+    std::signal(SIGTERM, stop_signal);
+
+    std::vector<bool> host_workers(processing_threads);
+    for (int i = 0; i < processing_threads; i++)
+        host_workers[i] = process_device_is_host(i);
+
+    // Same layout of threads as muir-decode, started once for every job
+    bool pooled = use_task_pool && std::count(host_workers.begin(), host_workers.end(), true) > 0;
+    if (pooled)
+        task_pool_start(0);
+
+    std::vector<CorePartition> partitions;
+    if (partition_cores && !pooled && processing_threads > 1)
+        partitions = core_partitions(host_workers);
+
+    // Files of every job, in the order they came.  Only bounds how far ahead clients queue.
+    MUIR::BoundedQueue<DaemonFile> queue(1024);
+
+    std::vector<std::thread> decoders;
+    for (int i = 0; i < processing_threads; i++)
+        decoders.push_back(std::thread(decode_thread, i, partitions.empty() ? NULL : &partitions[i], &queue));
+
+    std::cout << SectionName << ": " << processing_threads << " decoding threads, listening on " << socket_address << std::endl;
+
+    while (!stopping)
+    {
+        pollfd fd;
+        fd.fd = listen_fd;
+        fd.events = POLLIN;
+        fd.revents = 0;
+
+        // Wakes now and then to notice a SHUTDOWN from a client's thread
+        if (poll(&fd, 1, 250) > 0 && (fd.revents & POLLIN))
+        {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client >= 0)
+                client_start(client, &queue);
+        }
+    }
+
+    std::cout << SectionName << ": Stopping, finishing the queued files" << std::endl;
+
+    close(listen_fd);
+    std::string path;
+    if (socket_unix_path(socket_address, path))
+        unlink(path.c_str());
+
+    // Queued files are still decoded and their clients answered
+    queue.close();
+    for (std::size_t i = 0; i < decoders.size(); i++)
+        decoders[i].join();
+    {
+        std::unique_lock<std::mutex> lock(clients_mutex);
+        clients_finished.wait(lock, []{ return clients_running == 0; });
+    }
+
+    task_pool_stop();
+
+    return 0;
+}
+
+
+void decode_thread(int id, const CorePartition *partition, MUIR::BoundedQueue<DaemonFile> *queue)
+{
+    // Before any parallel region, so the OpenMP team is created on the partition
+    if (partition)
+    {
+        std::cout << "Thread[" << id << "] Bound to " << partition->to_string() << std::endl;
+        core_partition_bind(*partition);
+    }
+
+    // Pin the team's workers so the pages they first touch stay on their node.  Pooled
+    // rows are decoded by the pool's workers, a pinned team would only compete with them.
+    if (MUIR_NumaPolicy != NUMA_NONE && !task_pool())
+        numa_bind_team();
+
+    if (!warm_file.empty())
+        warm_thread(id);
+
+    // This thread's FFT plans and decoding buffers stay allocated from file to file
+    DaemonFile file;
+    while (queue->pop(file))
+    {
+        decode_file(id, file);
+        file.job.reset();
+    }
+}
+
+
+void decode_file(int id, const DaemonFile &file)
+{
+    const DecodeJob &request = file.job->request;
+
+    // Strips .h5 from file
+    fs::path datafile = fs::path(request.output_dir) / fs::path(fs::basename(fs::path(file.expfile)) + std::string(".decoded.h5"));
+
+    MUIR::Timer timer;
+    try
+    {
+        std::unique_ptr<MuirData> data;
+        {
+            std::lock_guard<std::mutex> hdf5_lock(hdf5_mutex());
+
+            // Like muir-decode --range, files without a set in the window aren't an error
+            if (request.config.time_start < request.config.time_end)
+            {
+                MuirHD5 file_in(file.expfile, H5F_ACC_RDONLY);
+                Muir2DArrayD time;
+                file_in.read_2D_double(RTI_RADACTIME_PATH, time);
+
+                std::size_t first_set, sets;
+                if (!sets_in_range(time, request.config.time_start, request.config.time_end, first_set, sets))
+                {
+                    file.job->reply("SKIPPED " + file.expfile);
+                    return;
+                }
+            }
+
+            std::cout << "Thread[" << id << "] Loading Experiment Data: " << file.expfile << std::endl;
+            data.reset(new MuirData(file.expfile, max_memory ? 2 : 0, request.config));
+        }
+
+        data->set_sample_block(sample_block);
+        data->set_decode_config(request.config);
+
+        int err;
+        if (max_memory)
+        {
+            // Reads, decodes and saves a chunk of sets at a time
+            err = data->decode_stream(id, datafile.string(), max_memory);
+        }
+        else
+        {
+            err = data->decode(id);
+            if (!err)
+            {
+                std::lock_guard<std::mutex> hdf5_lock(hdf5_mutex());
+                data->save_decoded_data(datafile.string());
+            }
+        }
+
+        if (err)
+            throw std::runtime_error("decoding failed");
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "Thread[" << id << "] ERROR! Unable to decode " << file.expfile << ": " << e.what() << std::endl;
+        file.job->reply("FAILED " + file.expfile);
+        return;
+    }
+    catch (const H5::Exception &e)
+    {
+        // Not a std::exception, Ex: a truncated or non-HDF5 file
+        std::cout << "Thread[" << id << "] ERROR! Unable to decode " << file.expfile << ": " << e.getDetailMsg() << std::endl;
+        file.job->reply("FAILED " + file.expfile);
+        return;
+    }
+
+    std::ostringstream reply;
+    reply << "DONE " << std::setprecision(3) << std::fixed << timer.elapsed() << " " << datafile.string();
+    std::cout << "Thread[" << id << "] Decoded " << file.expfile << " in " << timer.elapsed() << "s" << std::endl;
+    file.job->reply(reply.str());
+}
+
+
+// Plans this thread's FFTs and sizes its buffers before the first job, nothing is saved
+void warm_thread(int id)
+{
+    MUIR::Timer timer;
+    try
+    {
+        std::unique_ptr<MuirData> data;
+        {
+            std::lock_guard<std::mutex> hdf5_lock(hdf5_mutex());
+            data.reset(new MuirData(warm_file));
+        }
+        data->set_sample_block(sample_block);
+        data->decode(id);
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "Thread[" << id << "] ERROR! Unable to warm up with " << warm_file << ": " << e.what() << std::endl;
+        return;
+    }
+    catch (const H5::Exception &e)
+    {
+        std::cout << "Thread[" << id << "] ERROR! Unable to warm up with " << warm_file << ": " << e.getDetailMsg() << std::endl;
+        return;
+    }
+
+    std::cout << "Thread[" << id << "] Warmed up with " << warm_file << " in " << timer.elapsed() << "s" << std::endl;
+}
+
+
+// Runs a client's thread detached, so a long running service doesn't keep a finished
+// thread for every job it has answered
+void client_start(int fd, MUIR::BoundedQueue<DaemonFile> *queue)
+{
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        clients_running++;
+    }
+
+    std::thread([fd, queue]()
+    {
+        client_thread(fd, queue);
+
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        clients_running--;
+        clients_finished.notify_all();
+    }).detach();
+}
+
+
+void client_thread(int fd, MUIR::BoundedQueue<DaemonFile> *queue)
+{
+    // A client that connects and says nothing can't hold up a shutdown for long
+    timeval timeout = {30, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string buffer, line;
+    if (!socket_receive_line(fd, buffer, line))
+    {
+        close(fd);
+        return;
+    }
+
+    if (line == "SHUTDOWN")
+    {
+        std::cout << SectionName << ": Shutdown requested" << std::endl;
+        stopping = true;
+        socket_send(fd, "BYE\n");
+        close(fd);
+        return;
+    }
+
+    std::shared_ptr<DaemonJob> job(new DaemonJob);
+    try
+    {
+        if (line != "JOB")
+            throw std::invalid_argument("Expecting JOB or SHUTDOWN, not: " + line);
+
+        if (!daemon_receive_job(fd, buffer, job->request))
+        {
+            close(fd);
+            return;
+        }
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cout << SectionName << ": ERROR! " << e.what() << std::endl;
+        socket_send(fd, std::string("ERROR ") + e.what() + "\n");
+        close(fd);
+        return;
+    }
+
+    std::cout << SectionName << ": Job of " << job->request.files.size() << " files" << std::endl;
+
+    job->pending = job->request.files.size();
+    for (std::size_t i = 0; i < job->request.files.size(); i++)
+    {
+        DaemonFile file;
+        file.job = job;
+        file.expfile = job->request.files[i];
+
+        // Stopping, nothing more is decoded
+        if (!queue->push(file))
+            job->reply("FAILED " + file.expfile);
+    }
+
+    // Pass replies on as they come, the files are decoded even if the client has gone
+    std::size_t decoded = 0, failed = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->changed.wait(lock, [&job]{ return !job->replies.empty() || job->pending == 0; });
+
+            if (job->replies.empty())
+                break;
+
+            line = job->replies.front();
+            job->replies.pop_front();
+        }
+
+        if (line.compare(0, 4, "DONE") == 0)
+            decoded++;
+        else if (line.compare(0, 6, "FAILED") == 0)
+            failed++;
+
+        socket_send(fd, line + "\n");
+    }
+
+    std::cout << SectionName << ": Job done, " << decoded << " decoded, " << failed << " failed" << std::endl;
+
+    socket_send(fd, "END " + std::to_string(decoded) + " " + std::to_string(failed) + "\n");
+    close(fd);
+}
+
+
+void stop_signal(int)
+{
+    stopping = true;
+}
+
+
+void print_help ()
+{
+    std::cout << "usage: muir-decoded [--socket address] [--cpu] [--gpu-opencl] [--threads n] [--warm file]" << std::endl;
+    std::cout << "  Initializes the decoding devices once and decodes the jobs muir-decode-client sends it, so each" << std::endl;
+    std::cout << "  file costs only its decoding.  Stops on SIGINT, SIGTERM or muir-decode-client --shutdown," << std::endl;
+    std::cout << "  after the files already queued." << std::endl;
+    std::cout << "  --socket         : Address to listen on, unix:/path (default " << daemon_default_address() << ")" << std::endl;
+    std::cout << "                     or host:port (:port is localhost only).  There is no authentication, anyone who" << std::endl;
+    std::cout << "                     can connect can have any file this user can read decoded into any directory" << std::endl;
+    std::cout << "                     it can write, so only listen on a host others can reach on a trusted network." << std::endl;
+    std::cout << "  --gpu-cuda       : Force GPU CUDA decoding method." << std::endl;
+    std::cout << "  --gpu-opencl     : Force GPU OpenCL decoding method." << std::endl;
+    std::cout << "  --cpu            : Force CPU decoding method. (May be combined with one other gpu method)" << std::endl;
+    std::cout << "  --threads        : Number of files decoded at once.  Default is one per device." << std::endl;
+    std::cout << "  --warm           : Decode this file on every thread at startup (nothing saved), so FFTs are" << std::endl;
+    std::cout << "                     planned and buffers sized before the first job." << std::endl;
+    std::cout << "  --max-memory     : Bound the memory each file takes, see muir-decode." << std::endl;
+    std::cout << "  --sample-block   : Range bins per sample block, see muir-decode." << std::endl;
+    std::cout << "  --no-task-pool   : Decode each CPU file with its own OpenMP team, see muir-decode." << std::endl;
+    std::cout << "  --no-partition   : With --no-task-pool, let every decoding thread use all CPUs." << std::endl;
+    std::cout << "  --numa           : Placement of sample and decoded arrays: none (default), first-touch (turns off" << std::endl;
+    std::cout << "                     the task pool) or interleave." << std::endl;
+    std::cout << "  --huge-pages     : Back large arrays with huge pages: none (default), transparent or hugetlb." << std::endl;
+    std::cout << "  --fftw-wisdom    : Load FFTW wisdom from, and save new wisdom to, the specified file." << std::endl;
+    std::cout << "  --fftw-planner   : FFTW planner rigor: estimate, measure (default), patient or exhaustive." << std::endl;
+}
@@ -0,0 +1,424 @@
+//
+// C++ Implementation: muir-distribute
+//
+// Description: Hand files out to decoding processes over a socket, one at a time as
+//              each asks, requeueing the files of workers that stop answering.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-distribute.h"
+#include "muir-socket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX sockets
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Constants
+static const std::string SectionName("Coordinator");
+static const std::string WorkerSectionName("Worker");
+
+static double now_seconds(void);
+
+namespace MUIR
+{
+
+WorkCoordinator::WorkCoordinator(const std::vector<PlanFile> &files, double heartbeat_timeout, unsigned int max_attempts)
+: _finished(0),
+  _failed(0),
+  _heartbeat_timeout(heartbeat_timeout),
+  _max_attempts(std::max(max_attempts, 1u))
+{
+    // In the order given, largest first if planned
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        Task task;
+        task.file = files[i];
+        task.state = TASK_QUEUED;
+        task.worker = -1;
+        task.attempts = 0;
+
+        _tasks.push_back(task);
+        _queued.insert(i);
+    }
+}
+
+
+std::size_t WorkCoordinator::serve(const std::string &address)
+{
+    int listen_fd = socket_open(address, true);
+
+    std::cout << SectionName << ": Serving " << _tasks.size() << " files on " << address
+              << ", workers silent for " << _heartbeat_timeout << "s are dropped" << std::endl;
+
+    double finished_at = -1;
+    while (true)
+    {
+        double now = now_seconds();
+
+        // Workers are told to exit as they next ask, give them a timeout to do so
+        if (_finished == _tasks.size())
+        {
+            if (finished_at < 0)
+                finished_at = now;
+            if (_connections.empty() || now - finished_at > _heartbeat_timeout)
+                break;
+        }
+
+        std::vector<pollfd> fds(1);
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (std::map<int, Connection>::iterator iter = _connections.begin(); iter != _connections.end(); ++iter)
+        {
+            pollfd fd;
+            fd.fd = iter->first;
+            fd.events = POLLIN;
+            fds.push_back(fd);
+        }
+
+        if (poll(&fds[0], fds.size(), 250) < 0 && errno != EINTR)
+        {
+            close(listen_fd);
+            throw std::runtime_error(std::string("Coordinator poll failed: ") + strerror(errno));
+        }
+
+        now = now_seconds();
+
+        for (std::size_t i = 1; i < fds.size(); i++)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            Connection &connection = _connections[fds[i].fd];
+            if (!receive(connection, now))
+                drop(connection, "disconnected");
+        }
+
+        if (fds[0].revents & POLLIN)
+            accept_worker(listen_fd, now);
+
+        // Alive but stuck, Ex: hung on a file system, or a node that dropped off the network
+        std::vector<int> silent;
+        for (std::map<int, Connection>::iterator iter = _connections.begin(); iter != _connections.end(); ++iter)
+            if (now - iter->second.heard > _heartbeat_timeout)
+                silent.push_back(iter->first);
+
+        for (std::size_t i = 0; i < silent.size(); i++)
+            drop(_connections[silent[i]], "missed its heartbeats");
+    }
+
+    while (!_connections.empty())
+        drop(_connections.begin()->second, "still connected at exit");
+
+    close(listen_fd);
+
+    std::string path;
+    if (socket_unix_path(address, path))
+        unlink(path.c_str());
+
+    std::cout << SectionName << ": " << _finished - _failed << " of " << _tasks.size() << " files decoded, "
+              << _failed << " failed" << std::endl;
+
+    return _failed;
+}
+
+
+void WorkCoordinator::accept_worker(int listen_fd, double now)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    // Replies are a line at a time, so a send only blocks on a worker that stopped
+    // reading, which is then dropped instead of stalling every other worker
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    Connection connection;
+    connection.fd = fd;
+    connection.name = "fd " + std::to_string(fd);
+    connection.heard = now;
+    _connections[fd] = connection;
+}
+
+
+bool WorkCoordinator::receive(Connection &connection, double now)
+{
+    char buffer[4096];
+    ssize_t bytes = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return true;
+    if (bytes <= 0)
+        return false;
+
+    connection.buffer.append(buffer, bytes);
+    connection.heard = now;
+
+    std::size_t end;
+    while ((end = connection.buffer.find('\n')) != std::string::npos)
+    {
+        std::string line = connection.buffer.substr(0, end);
+        connection.buffer.erase(0, end + 1);
+
+        if (!command(connection, line))
+            return false;
+    }
+
+    return true;
+}
+
+
+bool WorkCoordinator::command(Connection &connection, const std::string &line)
+{
+    std::istringstream stream(line);
+    std::string word;
+    stream >> word;
+
+    if (word == "BEAT")
+        return true;
+
+    if (word == "HELLO")
+    {
+        stream >> connection.name;
+        std::cout << SectionName << ": Worker " << connection.name << " connected" << std::endl;
+
+        std::ostringstream reply;
+        reply << "HEARTBEAT " << _heartbeat_timeout / 3 << "\n";
+        return socket_send(connection.fd, reply.str());
+    }
+
+    if (word == "GET")
+    {
+        if (_queued.empty())
+            return socket_send(connection.fd, (_finished == _tasks.size()) ? "EXIT\n" : "WAIT\n");
+
+        std::size_t index = *_queued.begin();
+        _queued.erase(_queued.begin());
+
+        Task &task = _tasks[index];
+        task.state = TASK_RUNNING;
+        task.worker = connection.fd;
+        task.attempts++;
+
+        std::cout << SectionName << ": " << task.file.path << " to " << connection.name
+                  << (task.attempts > 1 ? " (again)" : "") << std::endl;
+
+        std::ostringstream reply;
+        reply << "TASK " << index << " " << std::setprecision(6) << std::scientific << task.file.cost << " " << task.file.path << "\n";
+        return socket_send(connection.fd, reply.str());
+    }
+
+    if (word == "DONE" || word == "FAILED")
+    {
+        long index = -1;
+        stream >> index;
+        if (index < 0 || static_cast<std::size_t>(index) >= _tasks.size())
+            return true;
+
+        Task &task = _tasks[index];
+
+        // Done by whoever gets there first, even a worker it was taken from
+        if (word == "DONE" && task.state != TASK_DONE && task.state != TASK_FAILED)
+        {
+            _queued.erase(index);
+            task.state = TASK_DONE;
+            _finished++;
+
+            std::cout << SectionName << ": " << connection.name << " decoded " << task.file.path
+                      << " (" << _finished << " of " << _tasks.size() << ")" << std::endl;
+        }
+
+        if (word == "FAILED" && task.state == TASK_RUNNING && task.worker == connection.fd)
+        {
+            std::cout << SectionName << ": " << connection.name << " failed to decode " << task.file.path << std::endl;
+            release(index, true);
+        }
+
+        return true;
+    }
+
+    std::cout << SectionName << ": Unexpected \"" << line << "\" from " << connection.name << std::endl;
+    return false;
+}
+
+
+void WorkCoordinator::drop(Connection &connection, const std::string &why)
+{
+    int fd = connection.fd;
+
+    std::size_t requeued = 0;
+    for (std::size_t i = 0; i < _tasks.size(); i++)
+    {
+        if (_tasks[i].state == TASK_RUNNING && _tasks[i].worker == fd)
+        {
+            release(i, false);
+            requeued++;
+        }
+    }
+
+    if (_finished != _tasks.size() || requeued)
+        std::cout << SectionName << ": Worker " << connection.name << " " << why << ", "
+                  << requeued << " of its files requeued" << std::endl;
+
+    close(fd);
+    _connections.erase(fd);
+}
+
+
+// Back to the front of the queue (by size), unless it has had all its attempts
+void WorkCoordinator::release(std::size_t index, bool failed)
+{
+    Task &task = _tasks[index];
+    task.worker = -1;
+
+    if (task.attempts >= _max_attempts)
+    {
+        std::cout << SectionName << ": Giving up on " << task.file.path << " after " << task.attempts
+                  << " attempts" << (failed ? "" : " (workers lost)") << std::endl;
+        task.state = TASK_FAILED;
+        _finished++;
+        _failed++;
+        return;
+    }
+
+    task.state = TASK_QUEUED;
+    _queued.insert(index);
+}
+
+
+WorkClient::WorkClient(const std::string &address)
+: _fd(-1),
+  _interval(10.0),
+  _stopping(false)
+{
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    _name = std::string(host) + ":" + std::to_string(getpid());
+
+    _fd = socket_open(address, false);
+
+    std::string reply, word;
+    if (!send_line("HELLO " + _name) || !receive_line(reply))
+    {
+        close(_fd);
+        throw std::runtime_error("No answer from coordinator " + address);
+    }
+
+    std::istringstream stream(reply);
+    stream >> word >> _interval;
+    if (word != "HEARTBEAT" || !(_interval > 0))
+    {
+        close(_fd);
+        throw std::runtime_error("Unexpected answer from coordinator " + address + ": " + reply);
+    }
+
+    std::cout << WorkerSectionName << ": " << _name << " connected to " << address << std::endl;
+
+    _heartbeat = std::thread(&WorkClient::heartbeat, this);
+}
+
+
+WorkClient::~WorkClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _stop.notify_all();
+    _heartbeat.join();
+
+    close(_fd);
+}
+
+
+bool WorkClient::next(WorkTask &task)
+{
+    while (true)
+    {
+        std::string line, word;
+        if (!send_line("GET") || !receive_line(line))
+        {
+            std::cout << WorkerSectionName << ": Lost the coordinator" << std::endl;
+            return false;
+        }
+
+        std::istringstream stream(line);
+        stream >> word;
+
+        if (word == "TASK")
+        {
+            stream >> task.id >> task.cost;
+            std::getline(stream >> std::ws, task.path);
+            return true;
+        }
+
+        if (word != "WAIT")
+            return false;
+
+        // The last files are still being decoded, one may come back
+        std::this_thread::sleep_for(std::chrono::duration<double>(std::min(_interval, 1.0)));
+    }
+}
+
+
+void WorkClient::finished(long id)
+{
+    send_line("DONE " + std::to_string(id));
+}
+
+
+void WorkClient::failed(long id)
+{
+    send_line("FAILED " + std::to_string(id));
+}
+
+
+bool WorkClient::send_line(const std::string &line)
+{
+    std::lock_guard<std::mutex> lock(_send_mutex);
+    return socket_send(_fd, line + "\n");
+}
+
+
+// Only next() reads, heartbeats and results don't get a reply
+bool WorkClient::receive_line(std::string &line)
+{
+    return socket_receive_line(_fd, _buffer, line);
+}
+
+
+void WorkClient::heartbeat()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop.wait_for(lock, std::chrono::duration<double>(_interval), [this]{ return _stopping; }))
+    {
+        lock.unlock();
+        send_line("BEAT");
+        lock.lock();
+    }
+}
+
+} // namespace MUIR
+
+
+static double now_seconds(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
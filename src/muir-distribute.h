@@ -0,0 +1,149 @@
+#ifndef MUIR_DISTRIBUTE_H
+#define MUIR_DISTRIBUTE_H
+//
+// C++ Interface: muir-distribute
+//
+// Description: Hand files out to decoding processes over a socket, one at a time as
+//              each asks, requeueing the files of workers that stop answering.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-plan.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MUIR
+{
+
+// Addresses are TCP or Unix sockets, see muir-socket.h.
+//
+// Protocol, one line each way, worker first:
+//   HELLO name      -> HEARTBEAT seconds   Interval to send BEAT at
+//   GET             -> TASK id cost path   Decode this file
+//                   -> WAIT                Nothing queued now, others still running, ask again
+//                   -> EXIT                Everything is decoded
+//   BEAT                                   Still alive (no reply)
+//   DONE id                                Decoded and saved (no reply)
+//   FAILED id                              Couldn't decode it (no reply)
+
+// A file handed out to a worker
+struct WorkTask
+{
+    long        id;
+    double      cost;
+    std::string path;
+};
+
+// Serves a batch of files, largest first, to whichever worker asks next.  A worker that
+// disconnects or is silent for the heartbeat timeout has its files put back at the front
+// of the queue, as does one that stops reading its replies.  Files are tried max_attempts
+// times.
+class WorkCoordinator
+{
+  public:
+    WorkCoordinator(const std::vector<PlanFile> &files, double heartbeat_timeout, unsigned int max_attempts = 3);
+
+    // Serve until every file is decoded or has failed, then tell the workers to exit.
+    // Returns the number of files that failed.  Throws std::runtime_error if the address
+    // can't be listened on.
+    std::size_t serve(const std::string &address);
+
+  private:
+    enum Task_State
+    {
+        TASK_QUEUED,
+        TASK_RUNNING,
+        TASK_DONE,
+        TASK_FAILED
+    };
+
+    struct Task
+    {
+        PlanFile     file;
+        Task_State   state;
+        int          worker;      // Connection running it
+        unsigned int attempts;
+    };
+
+    struct Connection
+    {
+        int         fd;
+        std::string name;
+        std::string buffer;       // Received, not yet a whole line
+        double      heard;        // When anything was last received
+    };
+
+    void accept_worker(int listen_fd, double now);
+    bool receive(Connection &connection, double now);   // False once it is gone
+    bool command(Connection &connection, const std::string &line);
+    void drop(Connection &connection, const std::string &why);
+    void release(std::size_t task, bool failed);
+
+    std::vector<Task> _tasks;
+    std::set<std::size_t> _queued;                 // Indices into _tasks, largest first
+    std::map<int, Connection> _connections;        // By fd
+    std::size_t _finished;
+    std::size_t _failed;
+    double _heartbeat_timeout;
+    unsigned int _max_attempts;
+
+    // No copying
+    WorkCoordinator(const WorkCoordinator &);
+    WorkCoordinator& operator=(const WorkCoordinator &);
+};
+
+// A worker's connection to the coordinator.  Sends heartbeats from its own thread for as
+// long as it is connected, so long decodes don't look like dead workers.
+class WorkClient
+{
+  public:
+    // Throws std::runtime_error if the coordinator can't be reached
+    explicit WorkClient(const std::string &address);
+    ~WorkClient();
+
+    // Blocks until there is a file to decode.  False when there is no more work or the
+    // coordinator has gone away.
+    bool next(WorkTask &task);
+
+    void finished(long id);
+    void failed(long id);
+
+    // Unique among the workers, Ex: host:pid
+    const std::string& name() const { return _name; }
+
+  private:
+    bool send_line(const std::string &line);
+    bool receive_line(std::string &line);
+    void heartbeat();
+
+    int _fd;
+    std::string _name;
+    std::string _buffer;
+    double _interval;
+    bool _stopping;
+
+    std::mutex _send_mutex;
+    std::mutex _mutex;
+    std::condition_variable _stop;
+    std::thread _heartbeat;
+
+    // No copying
+    WorkClient(const WorkClient &);
+    WorkClient& operator=(const WorkClient &);
+};
+
+} // namespace MUIR
+
+#endif //MUIR_DISTRIBUTE_H
@@ -0,0 +1,322 @@
+//
+// C++ Implementation: muir-fftw
+//
+// Description: FFTW plan management for the CPU decoding process.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-fftw.h"
+#include "muir-global.h"
+
+#include <map>
+#include <tuple>
+#include <iostream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+
+// POSIX file locking
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+/// Constants
+static const std::string SectionName("FFTW");
+
+/// Plan Cache
+// A plan may be re-executed with fftwf_execute_dft() on new arrays as long as the
+// sizes, strides, in-place-ness and alignment match the arrays it was created with.
+struct PlanKey
+{
+    unsigned int fft_size;
+    unsigned int block;      // Non-zero input length per sub-transform, fft_size when not pruned
+    unsigned int batch;
+    int in_alignment;
+    int out_alignment;
+    bool in_place;
+    int direction;
+
+    bool operator<(const PlanKey &right) const
+    {
+        return std::tie(fft_size, block, batch, in_alignment, out_alignment, in_place, direction) <
+               std::tie(right.fft_size, right.block, right.batch, right.in_alignment, right.out_alignment, right.in_place, right.direction);
+    }
+};
+
+static std::map<PlanKey, fftwf_plan> plan_cache;
+
+/// Wisdom state at import, used to skip exporting when nothing was learned
+static std::string imported_wisdom;
+
+static fftwf_plan plan_cache_lookup(const PlanKey &key);
+static fftwf_plan create_plan(const PlanKey &key, fftwf_complex *in, fftwf_complex *out);
+static std::string wisdom_to_string(void);
+
+
+fftwf_plan plan_cache_get(unsigned int fft_size,
+                          unsigned int batch,
+                          float *in,
+                          float *out,
+                          int direction)
+{
+    PlanKey key;
+    key.fft_size = fft_size;
+    key.block = fft_size;
+    key.batch = batch;
+    key.in_alignment = fftwf_alignment_of(in);
+    key.out_alignment = fftwf_alignment_of(out);
+    key.in_place = (in == out);
+    key.direction = direction;
+
+    return plan_cache_lookup(key);
+}
+
+
+fftwf_plan plan_cache_get_pruned(unsigned int fft_size,
+                                 unsigned int block,
+                                 unsigned int batch,
+                                 float *in,
+                                 float *out,
+                                 int direction)
+{
+    if (block == 0 || fft_size % block != 0)
+        throw std::logic_error("plan_cache_get_pruned(): block size must divide the FFT size");
+
+    if (in == out)
+        throw std::logic_error("plan_cache_get_pruned(): pruned transforms can't be done in place");
+
+    PlanKey key;
+    key.fft_size = fft_size;
+    key.block = block;
+    key.batch = batch;
+    key.in_alignment = fftwf_alignment_of(in);
+    key.out_alignment = fftwf_alignment_of(out);
+    key.in_place = false;
+    key.direction = direction;
+
+    return plan_cache_lookup(key);
+}
+
+
+static fftwf_plan plan_cache_lookup(const PlanKey &key)
+{
+    fftwf_plan p = NULL;
+
+    // The FFTW planner is not thread safe, lookups and creation share its lock.
+    #pragma omp critical (fftw)
+    {
+        std::map<PlanKey, fftwf_plan>::const_iterator iter = plan_cache.find(key);
+
+        if (iter != plan_cache.end())
+        {
+            p = iter->second;
+        }
+        else
+        {
+            // Measuring scribbles over the arrays, so plan on scratch memory offset
+            // to the same alignment as the caller's buffers.
+            std::size_t bytes = static_cast<std::size_t>(key.fft_size) * key.batch * sizeof(fftwf_complex);
+            char *scratch_in  = static_cast<char *>(fftwf_malloc(bytes + 64));
+            char *scratch_out = key.in_place ? scratch_in : static_cast<char *>(fftwf_malloc(bytes + 64));
+
+            if (scratch_in != NULL && scratch_out != NULL)
+                p = create_plan(key,
+                                reinterpret_cast<fftwf_complex *>(scratch_in + key.in_alignment),
+                                reinterpret_cast<fftwf_complex *>(scratch_out + key.out_alignment));
+
+            if (!key.in_place)
+                fftwf_free(scratch_out);
+            fftwf_free(scratch_in);
+
+            if (p != NULL)
+                plan_cache[key] = p;
+
+            if (MUIR_Verbose)
+                std::cout << SectionName << ": New plan N=" << key.fft_size << " x " << key.batch
+                          << " (block " << key.block
+                          << ", alignment " << key.in_alignment << "/" << key.out_alignment
+                          << "), cached plans: " << plan_cache.size() << std::endl;
+        }
+    }
+
+    if (p == NULL)
+        throw std::runtime_error("plan_cache_get(): FFTW failed to create a plan");
+
+    return p;
+}
+
+
+// Caller must hold the fftw critical section
+static fftwf_plan create_plan(const PlanKey &key, fftwf_complex *in, fftwf_complex *out)
+{
+    // Input must be preserved, decoding relies on the zero padding surviving the transform.
+    unsigned int flags = MUIR_FFTWPlannerFlags | FFTW_PRESERVE_INPUT;
+
+    if (key.block == key.fft_size)
+    {
+        int N[1] = {static_cast<int>(key.fft_size)};
+
+        return fftwf_plan_many_dft(1, N, key.batch,
+                                   in, NULL, 1, key.fft_size,
+                                   out, NULL, 1, key.fft_size,
+                                   key.direction, flags);
+    }
+
+    // Pruned: frame f holds P = fft_size/block sequences y[k1][n] (n < block), and
+    // X[k1 + P*k2] = DFT_block(y[k1])[k2].  Write each sub-transform with stride P.
+    int sub_transforms = static_cast<int>(key.fft_size / key.block);
+
+    fftwf_iodim dims[1];
+    dims[0].n  = static_cast<int>(key.block);
+    dims[0].is = 1;
+    dims[0].os = sub_transforms;
+
+    fftwf_iodim howmany[2];
+    howmany[0].n  = static_cast<int>(key.batch);          // Frames
+    howmany[0].is = static_cast<int>(key.fft_size);
+    howmany[0].os = static_cast<int>(key.fft_size);
+    howmany[1].n  = sub_transforms;                       // Sub-transforms within a frame
+    howmany[1].is = static_cast<int>(key.block);
+    howmany[1].os = 1;
+
+    return fftwf_plan_guru_dft(1, dims, 2, howmany, in, out, key.direction, flags);
+}
+
+
+std::size_t plan_cache_size(void)
+{
+    std::size_t size = 0;
+
+    #pragma omp critical (fftw)
+    size = plan_cache.size();
+
+    return size;
+}
+
+
+void plan_cache_clear(void)
+{
+    #pragma omp critical (fftw)
+    {
+        for (std::map<PlanKey, fftwf_plan>::iterator iter = plan_cache.begin(); iter != plan_cache.end(); ++iter)
+            fftwf_destroy_plan(iter->second);
+
+        plan_cache.clear();
+    }
+}
+
+
+unsigned int planner_flags_from_string(const std::string &name)
+{
+    if (name == "estimate")
+        return FFTW_ESTIMATE;
+    if (name == "measure")
+        return FFTW_MEASURE;
+    if (name == "patient")
+        return FFTW_PATIENT;
+    if (name == "exhaustive")
+        return FFTW_EXHAUSTIVE;
+
+    throw std::invalid_argument("Unknown FFTW planner: " + name + " (expecting estimate, measure, patient or exhaustive)");
+}
+
+
+bool wisdom_import(const std::string &filename)
+{
+    int loaded = 0;
+
+    #pragma omp critical (fftw)
+    {
+        // Writers replace the file atomically, so readers don't need the lock.
+        FILE *fp = fopen(filename.c_str(), "r");
+        if (fp)
+        {
+            loaded = fftwf_import_wisdom_from_file(fp);
+            fclose(fp);
+        }
+
+        imported_wisdom = wisdom_to_string();
+    }
+
+    std::cout << SectionName << ": " << (loaded?"Loaded":"No") << " wisdom from " << filename << std::endl;
+
+    return loaded;
+}
+
+
+void wisdom_export(const std::string &filename)
+{
+    #pragma omp critical (fftw)
+    {
+        if (wisdom_to_string() != imported_wisdom)
+        {
+            // Serialize writers
+            std::string lockname = filename + ".lock";
+            int lockfd = open(lockname.c_str(), O_RDWR | O_CREAT, 0664);
+
+            if (lockfd < 0 || flock(lockfd, LOCK_EX) != 0)
+            {
+                std::cout << SectionName << ": WARNING! Unable to lock " << lockname << ", wisdom not saved." << std::endl;
+            }
+            else
+            {
+                // Merge in anything other processes have saved since we started
+                FILE *fp = fopen(filename.c_str(), "r");
+                if (fp)
+                {
+                    fftwf_import_wisdom_from_file(fp);
+                    fclose(fp);
+                }
+
+                // Write to a private file and move it into place
+                std::string tmpname = filename + ".tmp." + std::to_string(getpid());
+                fp = fopen(tmpname.c_str(), "w");
+                if (fp)
+                {
+                    fftwf_export_wisdom_to_file(fp);
+
+                    if (fclose(fp) == 0 && rename(tmpname.c_str(), filename.c_str()) == 0)
+                    {
+                        imported_wisdom = wisdom_to_string();
+                        std::cout << SectionName << ": Saved wisdom to " << filename << std::endl;
+                    }
+                    else
+                    {
+                        std::cout << SectionName << ": WARNING! Unable to write " << filename << ", wisdom not saved." << std::endl;
+                        unlink(tmpname.c_str());
+                    }
+                }
+                else
+                {
+                    std::cout << SectionName << ": WARNING! Unable to create " << tmpname << ", wisdom not saved." << std::endl;
+                }
+
+                flock(lockfd, LOCK_UN);
+            }
+
+            if (lockfd >= 0)
+                close(lockfd);
+        }
+    }
+}
+
+
+// Caller must hold the fftw critical section
+static std::string wisdom_to_string(void)
+{
+    std::string wisdom;
+
+    char *buffer = fftwf_export_wisdom_to_string();
+    if (buffer)
+    {
+        wisdom = buffer;
+        free(buffer);
+    }
+
+    return wisdom;
+}
@@ -0,0 +1,62 @@
+#ifndef MUIR_FFTW_H
+#define MUIR_FFTW_H
+//
+// C++ Interface: muir-fftw
+//
+// Description: FFTW plan management for the CPU decoding process.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <fftw3.h>
+
+#include <cstddef>
+#include <string>
+
+// Returns a batched 1D complex plan (batch transforms of fft_size, packed back to back)
+// matching the layout and alignment of the given buffers.  Plans are created once and
+// kept for the life of the process, so callers must NOT destroy the returned plan.
+// Execute with fftwf_execute_dft() on any buffers with the same alignment.
+// Planning is done on scratch memory, the contents of in and out are untouched.
+fftwf_plan plan_cache_get(unsigned int fft_size,
+                          unsigned int batch,
+                          float *in,
+                          float *out,
+                          int direction = FFTW_FORWARD);
+
+// Returns a plan for the second half of an input-pruned transform.  Each of the
+// batch frames of fft_size holds fft_size/block consecutive sub-sequences of length
+// block (the twiddled non-zero input), which are transformed with a stride so the
+// output frames come out in natural order.  Same caching rules as plan_cache_get().
+fftwf_plan plan_cache_get_pruned(unsigned int fft_size,
+                                 unsigned int block,
+                                 unsigned int batch,
+                                 float *in,
+                                 float *out,
+                                 int direction = FFTW_FORWARD);
+
+// Number of plans currently held by the cache.
+std::size_t plan_cache_size(void);
+
+// Destroy all cached plans.
+void plan_cache_clear(void);
+
+// Translate a planner name (estimate, measure, patient, exhaustive) into FFTW flags.
+// Throws std::invalid_argument for unknown names.
+unsigned int planner_flags_from_string(const std::string &name);
+
+// Merge wisdom from a file into the planner.  A missing file is not an error.
+// Returns true if wisdom was loaded.
+bool wisdom_import(const std::string &filename);
+
+// Merge the planner's wisdom into a file.  Writers are serialized with an
+// exclusive lock on <filename>.lock and the file is replaced atomically, so
+// concurrent processes sharing one file neither lose nor corrupt wisdom.
+// Nothing is written if no new wisdom was learned since wisdom_import().
+void wisdom_export(const std::string &filename);
+
+#endif //MUIR_FFTW_H
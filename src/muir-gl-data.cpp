@@ -12,6 +12,7 @@
 
 #include "muir-gl-data.h"
 #include "muir-constants.h"
+#include "muir-view.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -81,6 +82,8 @@ void Muirgl_Data::load3D(const MuirHD5 &file, const std::string& path)
     Muir3DArrayF::size_type dataset_width = array_dims[1];  // frames per set
     Muir3DArrayF::size_type dataset_height = array_dims[2]; // Range bins
 
+    MUIR::MuirView<const float, 3> decoded_view(decoded_data);
+
     width = dataset_width;
     height = dataset_height;
 
@@ -106,10 +109,12 @@ void Muirgl_Data::load3D(const MuirHD5 &file, const std::string& path)
         
         for (Muir3DArrayF::size_type col = 0; col < dataset_width ;col++)
         {
+            const float *column = decoded_view.row(set, col);
+
             for (Muir3DArrayF::size_type row = 0; row < dataset_height; row++)
             {
-                //float pixel = log10(decoded_data[set][col][row]+1)*10;
-                float pixel = decoded_data[set][col][row];
+                //float pixel = log10(column[row]+1)*10;
+                float pixel = column[row];
                 data[row*width + col] = pixel;
                 
                 //max = std::max(max, pixel);
@@ -158,6 +163,8 @@ void Muirgl_Data::load4D(const MuirHD5 &file, const std::string& path)
     Muir4DArrayF::size_type dataset_width = array_dims[1];  // frames per set
     Muir4DArrayF::size_type dataset_height = array_dims[2]; // Range bins
     
+    MUIR::MuirView<const float, 4> decoded_view(decoded_data);
+
     width = dataset_width;
     height = dataset_height;
     
@@ -183,10 +190,12 @@ void Muirgl_Data::load4D(const MuirHD5 &file, const std::string& path)
         
         for (Muir3DArrayF::size_type col = 0; col < dataset_width ;col++)
         {
+            const float *column = decoded_view.row(set, col, 0);
+
             for (Muir3DArrayF::size_type row = 0; row < dataset_height; row++)
             {
-                //float pixel = log10(decoded_data[set][col][row]+1)*10;
-                float pixel = sqrtf(powf(decoded_data[set][col][row][0],2) + powf(decoded_data[set][col][row][1],2));
+                //float pixel = log10(column[row*2]+1)*10;
+                float pixel = sqrtf(powf(column[row*2],2) + powf(column[row*2+1],2));
                 data[row*width + col] = pixel;
                 
                 //max = std::max(max, pixel);
@@ -12,4 +12,12 @@
 
 #include "muir-global.h"
 
+#include <fftw3.h>
+
 bool MUIR_Verbose = false;
+
+std::string  MUIR_FFTWWisdomFile("");
+unsigned int MUIR_FFTWPlannerFlags = FFTW_MEASURE;
+
+NUMA_Policy  MUIR_NumaPolicy = NUMA_NONE;
+HugePage_Policy MUIR_HugePages = HUGE_PAGES_NONE;
@@ -12,6 +12,20 @@
 //
 //
 
+#include "muir-allocator.h"
+
+#include <string>
+
 extern bool MUIR_Verbose;
 
+// FFTW wisdom file shared between CPU decoding processes (empty for none).
+extern std::string  MUIR_FFTWWisdomFile;
+// FFTW planner rigor used for new plans (FFTW_MEASURE, FFTW_PATIENT, FFTW_EXHAUSTIVE).
+extern unsigned int MUIR_FFTWPlannerFlags;
+
+// Placement of the pages of large sample and decoded arrays on NUMA machines.
+extern NUMA_Policy  MUIR_NumaPolicy;
+// Backing of large arrays (base, transparent or hugetlbfs huge pages).
+extern HugePage_Policy MUIR_HugePages;
+
 #endif //MUIR_GLOBAL_H
\ No newline at end of file
@@ -506,6 +506,66 @@ void MuirHD5::read_4D_float(const H5std_string &dataset_name, Muir4DArrayF &in)
 }
 
 
+// Read a hyperslab (count elements from offset in each dimension) of a 4D Float dataset.
+// Only the selected elements are read from the file.
+void MuirHD5::read_4D_float(const H5std_string &dataset_name,
+                            Muir4DArrayF &in,
+                            const std::array<hsize_t,4> &offset,
+                            const std::array<hsize_t,4> &count) const
+{
+
+    // Get Dataset
+    H5::DataSet dataset = openDataSet( dataset_name );
+
+    // Check to see if we are dealing with floats
+    if( dataset.getTypeClass() != H5T_FLOAT || dataset.getFloatType().getSize() != 4 )
+        throw(std::runtime_error(std::string(__FILE__) + ":" + std::string(QUOTEME(__LINE__)) + "  " +
+                std::string("Expecting H5T_FLOAT Type of size 4 (float) in ") + dataset_name + " from " + getFileName()));
+
+    // Get dataspace handle
+    H5::DataSpace dataspace = dataset.getSpace();
+
+    // Get rank and verify
+    int rank = dataspace.getSimpleExtentNdims();
+    if(rank != 4)
+        throw(std::runtime_error(std::string(__FILE__) + ":" + std::string(QUOTEME(__LINE__)) + "  " +
+                std::string("Expecting rank to be 4 dimensions in ") + dataset_name + " from " + getFileName()));
+
+    // Get dimensions and verify the hyperslab fits
+    hsize_t dimsm[4];
+    dataspace.getSimpleExtentDims( dimsm, NULL);
+
+    for (int i = 0; i < 4; i++)
+        if (count[i] == 0 || offset[i] + count[i] > dimsm[i])
+            throw(std::runtime_error(std::string(__FILE__) + ":" + std::string(QUOTEME(__LINE__)) + "  " +
+                    std::string("Hyperslab falls outside of ") + dataset_name + " from " + getFileName()));
+
+    // Select the hyperslab in the file, memory holds just the hyperslab
+    dataspace.selectHyperslab( H5S_SELECT_SET, count.data(), offset.data() );
+    H5::DataSpace memspace( rank, count.data() );
+
+    // Initialize boost multi_array;
+    in.resize(boost::extents[count[0]][count[1]][count[2]][count[3]]);
+
+    // Get data
+    dataset.read(in.data(), H5::PredType::NATIVE_FLOAT, memspace, dataspace);
+
+    return;
+}
+
+
+// Dimensions of a dataset.
+std::vector<hsize_t> MuirHD5::read_dims(const H5std_string &dataset_name) const
+{
+    H5::DataSpace dataspace = openDataSet( dataset_name ).getSpace();
+
+    std::vector<hsize_t> dims(dataspace.getSimpleExtentNdims());
+    dataspace.getSimpleExtentDims( dims.data(), NULL);
+
+    return dims;
+}
+
+
 // Write a 2D Float Array to a dataset path.
 void MuirHD5::write_2D_float(const H5std_string &dataset_name, const Muir2DArrayF &out)
 {
@@ -557,6 +617,67 @@ void MuirHD5::write_3D_float(const H5std_string &dataset_name, const Muir3DArray
 }
 
 
+// Append rows to an extendible 3D Float dataset, creating it if needed.
+void MuirHD5::append_3D_float(const H5std_string &dataset_name, const Muir3DArrayF &out)
+{
+    constexpr hsize_t rank = out.dimensionality;
+    const Muir3DArrayF::size_type *shape = out.shape();
+
+    std::array<hsize_t,rank> count  = {shape[0], shape[1], shape[2]};
+    std::array<hsize_t,rank> offset = {0, 0, 0};
+
+    H5::DataSet dataset;
+    if (H5Lexists(getId(), dataset_name.c_str(), H5P_DEFAULT) <= 0)
+    {
+        // Empty to start with, unlimited in the first dimension
+        std::array<hsize_t,rank> dimsf   = {0, shape[1], shape[2]};
+        std::array<hsize_t,rank> maxdims = {H5S_UNLIMITED, shape[1], shape[2]};
+        std::array<hsize_t,rank> chunk   = {1, shape[1], shape[2]};
+
+        H5::DataSpace dataspace( rank, dimsf.data(), maxdims.data() );
+
+        // Extendible datasets must be chunked
+        H5::DSetCreatPropList properties;
+        properties.setChunk( rank, chunk.data() );
+
+        // Define Datatype
+        H5::FloatType datatype( H5::PredType::NATIVE_FLOAT );
+        datatype.setOrder( H5T_ORDER_LE);
+
+        dataset = createDataSet( dataset_name, datatype, dataspace, properties);
+    }
+    else
+    {
+        dataset = openDataSet( dataset_name );
+    }
+
+    // Get dimensions and verify the new rows match
+    H5::DataSpace filespace = dataset.getSpace();
+    if (filespace.getSimpleExtentNdims() != static_cast<int>(rank))
+        throw(std::runtime_error(std::string(__FILE__) + ":" + std::string(QUOTEME(__LINE__)) + "  " +
+                std::string("Expecting rank to be 3 dimensions in ") + dataset_name + " from " + getFileName()));
+
+    std::array<hsize_t,rank> dimsf;
+    filespace.getSimpleExtentDims( dimsf.data(), NULL);
+
+    if (dimsf[1] != count[1] || dimsf[2] != count[2])
+        throw(std::runtime_error(std::string(__FILE__) + ":" + std::string(QUOTEME(__LINE__)) + "  " +
+                std::string("Appended data doesn't match the shape of ") + dataset_name + " from " + getFileName()));
+
+    // Grow the dataset and select the new rows
+    offset[0] = dimsf[0];
+    dimsf[0] += count[0];
+    dataset.extend( dimsf.data() );
+
+    filespace = dataset.getSpace();
+    filespace.selectHyperslab( H5S_SELECT_SET, count.data(), offset.data() );
+    H5::DataSpace memspace( rank, count.data() );
+
+    // Write data
+    dataset.write(out.data(), H5::PredType::NATIVE_FLOAT, memspace, filespace);
+}
+
+
 // Write a 4D Float Array to a dataset path.
 void MuirHD5::write_4D_float(const H5std_string &dataset_name, const Muir4DArrayF &out)
 {
@@ -709,3 +830,10 @@ void MuirHD5::write_2D_double(const H5std_string &dataset_name, const Muir2DArra
 //void MuirHD5::write_4D_double(const H5std_string &dataset_name, const Muir4DArrayD &out)
 //{
 //}
+
+
+std::mutex& hdf5_mutex(void)
+{
+    static std::mutex mutex;
+    return mutex;
+}
@@ -14,7 +14,10 @@
 #include "muir-types.h"
 
 #include <H5Cpp.h>
+#include <array>
+#include <mutex>
 #include <string>
+#include <vector>
 
 
 class MuirHD5 : public H5::H5File
@@ -32,6 +35,8 @@ class MuirHD5 : public H5::H5File
         void  write_scalar_float(const H5std_string &dataset_name, float out);
         void  write_scalar_double(const H5std_string &dataset_name, double out);
 
+        std::vector<hsize_t> read_dims(const H5std_string &dataset_name) const;
+
         std::string read_string(const H5std_string &dataset_name) const;
         void        write_string(const H5std_string &dataset_name, const std::string &out);
 
@@ -48,11 +53,17 @@ class MuirHD5 : public H5::H5File
         void read_2D_float(const H5std_string &dataset_name, Muir2DArrayF &in) const;
         void read_3D_float(const H5std_string &dataset_name, Muir3DArrayF &in) const;
         void read_4D_float(const H5std_string &dataset_name, Muir4DArrayF &in) const;
+        void read_4D_float(const H5std_string &dataset_name, Muir4DArrayF &in,
+                           const std::array<hsize_t,4> &offset, const std::array<hsize_t,4> &count) const;
 
         void write_2D_float(const H5std_string &dataset_name, const Muir2DArrayF &out);
         void write_3D_float(const H5std_string &dataset_name, const Muir3DArrayF &out);
         void write_4D_float(const H5std_string &dataset_name, const Muir4DArrayF &out);
 
+        // Append along the first dimension of an extendible dataset, which is created
+        // (chunked by one row of the first dimension) on the first call.
+        void append_3D_float(const H5std_string &dataset_name, const Muir3DArrayF &out);
+
         void read_2D_double(const H5std_string &dataset_name, Muir2DArrayD &in) const;
         void read_3D_double(const H5std_string &dataset_name, Muir3DArrayD &in) const;
         void read_4D_double(const H5std_string &dataset_name, Muir4DArrayD &in) const;
@@ -71,4 +82,8 @@ class MuirHD5 : public H5::H5File
 
 };
 
+// The HDF5 library isn't built thread safe, threads must hold this lock around any
+// HDF5 call (including opening, closing and destroying files).
+std::mutex& hdf5_mutex(void);
+
 #endif // #ifndef MUIR_HD5_H
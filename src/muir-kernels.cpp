@@ -0,0 +1,335 @@
+//
+// C++ Implementation: muir-kernels
+//
+// Description: Decode kernels specialized at compile time for common FFT sizes and
+//              phasecode lengths, with a table to pick them at runtime.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-kernels.h"
+#include "muir-peak.h"
+#include "muir-view.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/// Kernels
+// apply_phasecode() for a natural sample layout and a phasecode of CodeLength bauds.  The
+// code is expanded into a sign mask per float once per call, so each frame is a fixed
+// length XOR the compiler unrolls and vectorizes.  Frames whose code runs off the end of
+// the input take the generic path.
+template<std::size_t CodeLength>
+static std::size_t gather_fixed(const unsigned int range_offset,
+                                const unsigned int tile,
+                                const Muir4DArrayF &in_buffer,
+                                const SampleLayout &in_layout,
+                                const PhaseCode& phasecode,
+                                Muir4DArrayRefF &out_buffer,
+                                std::size_t dirty_rows)
+{
+    // Determine Strides
+    Muir4DArrayF::size_type in_sets = in_layout.sets;
+    Muir4DArrayF::size_type in_cols = in_layout.cols;
+    Muir4DArrayF::size_type in_rangebins = in_layout.rangebins;
+
+    const Muir4DArrayF::size_type *out_dims = out_buffer.shape();
+    Muir4DArrayF::size_type out_sets = out_dims[0];
+    Muir4DArrayF::size_type out_cols = out_dims[1];
+    Muir4DArrayF::size_type out_rangebins = out_dims[2];
+
+    // Check for error conditions
+    if(in_sets * tile > out_sets || in_cols != out_cols)
+        throw std::logic_error("gather_fixed(): Critical dimensions of in and out buffers do not match!");
+
+    if(tile == 0 || range_offset + tile > in_rangebins)
+        throw std::logic_error("gather_fixed(): requested range falls outside of range for input buffer");
+
+    if(phasecode.size() != CodeLength || CodeLength > out_rangebins || !in_layout.is_natural())
+        throw std::logic_error("gather_fixed(): kernel doesn't match the phasecode, output or sample layout");
+
+    dirty_rows = std::min(dirty_rows, out_rangebins);
+
+    std::uint32_t mask[CodeLength*2];
+    for(std::size_t i = 0; i < CodeLength; i++)
+        mask[i*2] = mask[i*2+1] = phasecode.negative(i) ? 0x80000000u : 0u;
+
+    // Frames past the tile keep whatever they had
+    std::size_t max_valid_rows = (in_sets * tile < out_sets)?dirty_rows:0;
+
+    const float *in_data = in_buffer.data();
+    MUIR::MuirView<float, 4> out_view(out_buffer);
+
+    for(Muir4DArrayF::size_type set = 0; set < in_sets; set++)
+        for(Muir4DArrayF::size_type col = 0; col < in_cols; col++)
+            for(unsigned int t = 0; t < tile; t++)
+            {
+                std::size_t range = range_offset + t;
+                const float *in = in_data + in_layout.offset(set*in_cols + col, range);
+                float *out = out_view.row(t*in_sets + set, col, 0);
+
+                std::size_t valid_rows = CodeLength;
+                if (range + CodeLength <= in_rangebins)
+                {
+                    for(std::size_t i = 0; i < CodeLength*2; i++)
+                        out[i] = phasecode_apply(in[i], mask[i]);
+                }
+                else
+                {
+                    // The code is truncated at the end of the input
+                    valid_rows = in_rangebins - range;
+                    phasecode.apply(0, valid_rows, in, out);
+                }
+
+                max_valid_rows = std::max(max_valid_rows, valid_rows);
+
+                // Zero out what is left over from previous rows, the rest of the padding is already zero
+                if (dirty_rows > valid_rows)
+                    std::fill(out + valid_rows*2, out + dirty_rows*2, 0.0f);
+            }
+
+    return max_valid_rows;
+}
+
+
+// apply_phasecode_pruned() for a natural sample layout and a phasecode of CodeLength
+// bauds.  Each frame is coded with the sign mask into a fixed length buffer, then
+// twiddled into each sub-sequence with a fixed length loop the compiler vectorizes.
+// Frames whose code runs off the end of the input take the generic path.
+template<std::size_t CodeLength>
+static std::size_t gather_pruned_fixed(const unsigned int range_offset,
+                                       const unsigned int tile,
+                                       const Muir4DArrayF &in_buffer,
+                                       const SampleLayout &in_layout,
+                                       const PhaseCode& phasecode,
+                                       const std::vector<std::complex<float> >& twiddles,
+                                       std::size_t block,
+                                       Muir4DArrayRefF &out_buffer,
+                                       std::size_t dirty_rows)
+{
+    // Determine Strides
+    Muir4DArrayF::size_type in_sets = in_layout.sets;
+    Muir4DArrayF::size_type in_cols = in_layout.cols;
+    Muir4DArrayF::size_type in_rangebins = in_layout.rangebins;
+
+    const Muir4DArrayF::size_type *out_dims = out_buffer.shape();
+    Muir4DArrayF::size_type out_sets = out_dims[0];
+    Muir4DArrayF::size_type out_cols = out_dims[1];
+    Muir4DArrayF::size_type out_rangebins = out_dims[2];
+
+    // Check for error conditions
+    if(in_sets * tile > out_sets || in_cols != out_cols)
+        throw std::logic_error("gather_pruned_fixed(): Critical dimensions of in and out buffers do not match!");
+
+    if(tile == 0 || range_offset + tile > in_rangebins)
+        throw std::logic_error("gather_pruned_fixed(): requested range falls outside of range for input buffer");
+
+    if(block < CodeLength || out_rangebins % block != 0 || twiddles.size() != out_rangebins)
+        throw std::logic_error("gather_pruned_fixed(): twiddles don't match the block and output sizes");
+
+    if(phasecode.size() != CodeLength || !in_layout.is_natural())
+        throw std::logic_error("gather_pruned_fixed(): kernel doesn't match the phasecode or sample layout");
+
+    std::size_t sub_sequences = out_rangebins / block;
+    dirty_rows = std::min(dirty_rows, block);
+
+    std::uint32_t mask[CodeLength*2];
+    for(std::size_t i = 0; i < CodeLength; i++)
+        mask[i*2] = mask[i*2+1] = phasecode.negative(i) ? 0x80000000u : 0u;
+
+    // Frames past the tile keep whatever they had
+    std::size_t max_valid_rows = (in_sets * tile < out_sets)?dirty_rows:0;
+
+    const float *in_data = in_buffer.data();
+    const float *twiddle_data = reinterpret_cast<const float *>(twiddles.data());
+    MUIR::MuirView<float, 4> out_view(out_buffer);
+
+    float coded[CodeLength*2];
+
+    for(Muir4DArrayF::size_type set = 0; set < in_sets; set++)
+        for(Muir4DArrayF::size_type col = 0; col < in_cols; col++)
+            for(unsigned int t = 0; t < tile; t++)
+            {
+                std::size_t range = range_offset + t;
+                const float *in = in_data + in_layout.offset(set*in_cols + col, range);
+                float *out = out_view.row(t*in_sets + set, col, 0);
+
+                std::size_t valid_rows = CodeLength;
+                if (range + CodeLength <= in_rangebins)
+                {
+                    for(std::size_t i = 0; i < CodeLength*2; i++)
+                        coded[i] = phasecode_apply(in[i], mask[i]);
+
+                    // Same products as std::complex, (a+bi)(c+di) = (ac-bd) + (ad+bc)i
+                    for(std::size_t sub = 0; sub < sub_sequences; sub++)
+                    {
+                        const float *twiddle = twiddle_data + sub*block*2;
+                        float *out_sub = out + sub*block*2;
+
+                        for(std::size_t row = 0; row < CodeLength; row++)
+                        {
+                            float a = coded[row*2], b = coded[row*2+1];
+                            float c = twiddle[row*2], d = twiddle[row*2+1];
+                            out_sub[row*2]   = a*c - b*d;
+                            out_sub[row*2+1] = a*d + b*c;
+                        }
+                    }
+                }
+                else
+                {
+                    // The code is truncated at the end of the input
+                    valid_rows = in_rangebins - range;
+                    phasecode.apply(0, valid_rows, in, coded);
+
+                    for(std::size_t sub = 0; sub < sub_sequences; sub++)
+                    {
+                        const float *twiddle = twiddle_data + sub*block*2;
+                        float *out_sub = out + sub*block*2;
+
+                        for(std::size_t row = 0; row < valid_rows; row++)
+                        {
+                            float a = coded[row*2], b = coded[row*2+1];
+                            float c = twiddle[row*2], d = twiddle[row*2+1];
+                            out_sub[row*2]   = a*c - b*d;
+                            out_sub[row*2+1] = a*d + b*c;
+                        }
+                    }
+                }
+
+                max_valid_rows = std::max(max_valid_rows, valid_rows);
+
+                // Zero out what is left over from previous rows, the rest of the padding is already zero
+                if (dirty_rows > valid_rows)
+                    for(std::size_t sub = 0; sub < sub_sequences; sub++)
+                        std::fill(out + (sub*block + valid_rows)*2, out + (sub*block + dirty_rows)*2, 0.0f);
+            }
+
+    return max_valid_rows;
+}
+
+
+// find_peak() over every bin of FFTSize bin spectra
+template<std::size_t FFTSize>
+static void peak_fixed(const unsigned int range_offset,
+                       const unsigned int tile,
+                       const Muir4DArrayRefF &in_buffer,
+                       std::size_t first_bin,
+                       std::size_t bins,
+                       Muir3DArrayF &out_buffer)
+{
+    // Determine Strides
+    const Muir4DArrayF::size_type *in_dims = in_buffer.shape();
+    Muir4DArrayF::size_type in_sets = in_dims[0];
+    Muir4DArrayF::size_type in_cols = in_dims[1];
+
+    const Muir4DArrayF::size_type *out_dims = out_buffer.shape();
+    Muir4DArrayF::size_type out_sets = out_dims[0];
+    Muir4DArrayF::size_type out_cols = out_dims[1];
+    Muir4DArrayF::size_type out_rangebins = out_dims[2];
+
+    // Check for error conditions
+    if(out_sets * tile > in_sets || in_cols != out_cols)
+        throw std::logic_error("peak_fixed(): Critical dimensions of in and out buffers do not match!");
+
+    if(tile == 0 || range_offset + tile > out_rangebins)
+        throw std::logic_error("peak_fixed(): requested range falls outside of range for output buffer");
+
+    if(in_dims[2] != FFTSize || first_bin != 0 || bins != FFTSize)
+        throw std::logic_error("peak_fixed(): kernel doesn't match the spectrum size or Doppler window");
+
+    std::vector<float> max_power(out_cols);
+    MUIR::MuirView<const float, 4> in_view(in_buffer);
+    MUIR::MuirView<float, 3> out_view(out_buffer);
+
+    for(unsigned int t = 0; t < tile; t++)
+    {
+        for(std::size_t set = 0; set < out_sets; set++)
+        {
+            peak_power_fixed<FFTSize>(in_view.row(t*out_sets + set, 0, 0), out_cols, FFTSize*2, max_power.data());
+
+            // Assign and normalize
+            for(std::size_t col = 0; col < out_cols; col++)
+                out_view(set, col, range_offset + t) = sqrtf(max_power[col])/static_cast<float>(FFTSize);
+        }
+    }
+}
+
+
+/// Dispatch Tables
+// Barker 13 and the power of two code lengths in use.  Adding a size is one line here
+// (and for peaks, an instantiation of peak_power_fixed() in muir-peak).
+struct GatherEntry
+{
+    std::size_t phasecode_size;
+    GatherKernel kernel;
+    PrunedGatherKernel pruned_kernel;
+};
+
+static const GatherEntry gather_table[] =
+{
+    {13,  gather_fixed<13>,  gather_pruned_fixed<13>},
+    {16,  gather_fixed<16>,  gather_pruned_fixed<16>},
+    {32,  gather_fixed<32>,  gather_pruned_fixed<32>},
+    {64,  gather_fixed<64>,  gather_pruned_fixed<64>},
+    {128, gather_fixed<128>, gather_pruned_fixed<128>},
+    {256, gather_fixed<256>, gather_pruned_fixed<256>}
+};
+
+struct PeakEntry
+{
+    std::size_t fft_size;
+    PeakKernel kernel;
+};
+
+static const PeakEntry peak_table[] =
+{
+    {256,  peak_fixed<256>},
+    {512,  peak_fixed<512>},
+    {1024, peak_fixed<1024>},
+    {2048, peak_fixed<2048>},
+    {4096, peak_fixed<4096>}
+};
+
+
+DecodeKernels decode_kernels(std::size_t fft_size,
+                             std::size_t phasecode_size,
+                             bool with_gather,
+                             bool with_pruned_gather,
+                             bool with_peak)
+{
+    DecodeKernels kernels = {NULL, NULL, NULL, std::string()};
+
+    if ((with_gather || with_pruned_gather) && phasecode_size <= fft_size)
+    {
+        for (std::size_t i = 0; i < sizeof(gather_table)/sizeof(gather_table[0]); i++)
+            if (gather_table[i].phasecode_size == phasecode_size)
+            {
+                if (with_gather)
+                    kernels.gather = gather_table[i].kernel;
+                else
+                    kernels.pruned_gather = gather_table[i].pruned_kernel;
+                kernels.name = std::string(with_gather ? "gather" : "pruned gather") + " L" + std::to_string(phasecode_size);
+            }
+    }
+
+    if (with_peak)
+    {
+        for (std::size_t i = 0; i < sizeof(peak_table)/sizeof(peak_table[0]); i++)
+            if (peak_table[i].fft_size == fft_size)
+            {
+                kernels.peak = peak_table[i].kernel;
+                if (!kernels.name.empty())
+                    kernels.name += ", ";
+                kernels.name += "peak N" + std::to_string(fft_size) + " " + peak_power_isa();
+            }
+    }
+
+    return kernels;
+}
@@ -0,0 +1,73 @@
+#ifndef MUIR_KERNELS_H
+#define MUIR_KERNELS_H
+//
+// C++ Interface: muir-kernels
+//
+// Description: Decode kernels specialized at compile time for common FFT sizes and
+//              phasecode lengths, with a table to pick them at runtime.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-types.h"
+#include "muir-layout.h"
+#include "muir-phasecode.h"
+
+#include <complex>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Same arguments and results as apply_phasecode() in muir-process-cpu
+typedef std::size_t (*GatherKernel)(const unsigned int range_offset,
+                                    const unsigned int tile,
+                                    const Muir4DArrayF &in_buffer,
+                                    const SampleLayout &in_layout,
+                                    const PhaseCode& phasecode,
+                                    Muir4DArrayRefF &out_buffer,
+                                    std::size_t dirty_rows);
+
+// Same arguments and results as apply_phasecode_pruned() in muir-process-cpu
+typedef std::size_t (*PrunedGatherKernel)(const unsigned int range_offset,
+                                          const unsigned int tile,
+                                          const Muir4DArrayF &in_buffer,
+                                          const SampleLayout &in_layout,
+                                          const PhaseCode& phasecode,
+                                          const std::vector<std::complex<float> >& twiddles,
+                                          std::size_t block,
+                                          Muir4DArrayRefF &out_buffer,
+                                          std::size_t dirty_rows);
+
+// Same arguments as find_peak() in muir-process-cpu
+typedef void (*PeakKernel)(const unsigned int range_offset,
+                           const unsigned int tile,
+                           const Muir4DArrayRefF &in_buffer,
+                           std::size_t first_bin,
+                           std::size_t bins,
+                           Muir3DArrayF &out_buffer);
+
+// Specialized kernels for a decode, NULL where the generic version must be used.
+struct DecodeKernels
+{
+    GatherKernel gather;
+    PrunedGatherKernel pruned_gather;
+    PeakKernel peak;
+    std::string name;     // e.g. "gather L13, peak N1024 avx2", empty if none apply
+};
+
+// Look up kernels for a decode.  with_gather: the phasecode is gathered into full
+// (unpruned) frames from the natural sample layout.  with_pruned_gather: it is gathered
+// into the twiddled sub-sequences of the pruned engine from the natural sample layout.
+// with_peak: the whole spectrum is searched for the peak.  Gather kernels need
+// phasecode_size <= fft_size.
+DecodeKernels decode_kernels(std::size_t fft_size,
+                             std::size_t phasecode_size,
+                             bool with_gather,
+                             bool with_pruned_gather,
+                             bool with_peak);
+
+#endif //MUIR_KERNELS_H
@@ -0,0 +1,72 @@
+//
+// C++ Implementation: muir-layout
+//
+// Description: In-memory layout of MUIR sample data.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-layout.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+SampleLayout::SampleLayout(void)
+: sets(0),
+  cols(0),
+  rangebins(0),
+  block(1)
+{
+}
+
+SampleLayout::SampleLayout(std::size_t sets_in, std::size_t cols_in, std::size_t rangebins_in, std::size_t block_in)
+: sets(sets_in),
+  cols(cols_in),
+  rangebins(rangebins_in),
+  block(block_in)
+{
+    // No (or an oversized) block means natural layout
+    if (block == 0 || block > rangebins)
+        block = std::max<std::size_t>(rangebins, 1);
+}
+
+SampleLayout::SampleLayout(const Muir4DArrayF &natural)
+: sets(natural.shape()[0]),
+  cols(natural.shape()[1]),
+  rangebins(natural.shape()[2]),
+  block(std::max<std::size_t>(natural.shape()[2], 1))
+{
+}
+
+
+void sample_layout_transform(const Muir4DArrayF &natural, const SampleLayout &layout, Muir4DArrayF &out)
+{
+    const Muir4DArrayF::size_type *dims = natural.shape();
+
+    if (dims[0] != layout.sets || dims[1] != layout.cols || dims[2] != layout.rangebins)
+        throw std::logic_error("sample_layout_transform(): Layout doesn't match the dimensions of the data!");
+
+    out.resize(boost::extents[layout.blocks()][layout.frames()][layout.block][2]);
+
+    const float *in = natural.data();
+    float *out_data = out.data();
+
+    // Padding of the last block
+    std::fill(out_data, out_data + out.num_elements(), 0.0f);
+
+    // Each frame is read once, in order, and scattered a block at a time
+    for(std::size_t frame = 0; frame < layout.frames(); frame++)
+    {
+        const float *in_frame = in + frame * layout.rangebins * 2;
+
+        for(std::size_t range = 0; range < layout.rangebins; range += layout.block)
+        {
+            std::size_t count = std::min(layout.block, layout.rangebins - range);
+            std::copy(in_frame + range*2, in_frame + (range + count)*2, out_data + layout.offset(frame, range));
+        }
+    }
+}
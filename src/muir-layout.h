@@ -0,0 +1,52 @@
+#ifndef MUIR_LAYOUT_H
+#define MUIR_LAYOUT_H
+//
+// C++ Interface: muir-layout
+//
+// Description: In-memory layout of MUIR sample data.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-types.h"
+
+#include <cstddef>
+
+// Describes how complex samples are laid out in memory.  Range bins are grouped in
+// blocks and stored [range block][frame][range in block][2], frame = set*cols + col.
+// A block holding every range bin is the natural [set][col][range][2] file layout.
+// The last block is padded out to the full block size.
+class SampleLayout
+{
+  public:
+    std::size_t sets;
+    std::size_t cols;
+    std::size_t rangebins;
+    std::size_t block;
+
+    SampleLayout(void);
+    SampleLayout(std::size_t sets_in, std::size_t cols_in, std::size_t rangebins_in, std::size_t block_in = 0);
+
+    // Natural layout of a [set][col][range][2] array
+    explicit SampleLayout(const Muir4DArrayF &natural);
+
+    std::size_t frames() const
+        { return sets * cols; };
+    std::size_t blocks() const
+        { return (rangebins + block - 1) / block; };
+    bool is_natural() const
+        { return block == rangebins; };
+
+    // Float offset of the real part of a sample
+    std::size_t offset(std::size_t frame, std::size_t range) const
+        { return (((range / block) * frames() + frame) * block + range % block) * 2; };
+};
+
+// Copy natural [set][col][range][2] data into the layout, shaped [blocks][frames][block][2].
+void sample_layout_transform(const Muir4DArrayF &natural, const SampleLayout &layout, Muir4DArrayF &out);
+
+#endif //MUIR_LAYOUT_H
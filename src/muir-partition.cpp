@@ -0,0 +1,299 @@
+//
+// C++ Implementation: muir-partition
+//
+// Description: Divide the machine's CPUs between concurrent decoding threads so
+//              their OpenMP teams don't oversubscribe the same cores.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-partition.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+// Linux CPU affinity
+#include <pthread.h>
+#include <sched.h>
+
+/// Macros
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_set_num_threads(threads)
+#define omp_get_thread_num() 0
+#endif
+
+/// Constants
+static const std::string SectionName("Partition");
+static const std::string NodeDir("/sys/devices/system/node/node");
+static const int MaxNodes = 1024;   // Node numbers may have gaps
+
+static std::vector<int> parse_cpu_list(const std::string &list);
+static std::string format_cpu_list(const std::vector<int> &cpus);
+static const std::map<int, int>& cpu_nodes(void);
+static std::map<int, int> read_cpu_nodes(void);
+static std::vector<int> thread_cpus(void);
+
+
+std::string CorePartition::to_string() const
+{
+    std::string out = "cpus " + format_cpu_list(cpus);
+    if (!nodes.empty())
+        out += std::string(" (node") + (nodes.size() > 1 ? "s " : " ") + format_cpu_list(nodes) + ")";
+
+    return out;
+}
+
+
+std::vector<CorePartition> core_partitions(const std::vector<bool> &host_workers)
+{
+    std::vector<CorePartition> partitions(host_workers.size());
+    if (partitions.empty())
+        return partitions;
+
+    // CPUs we may run on (respects taskset and cgroups), grouped by NUMA node
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return partitions;
+
+    std::map<int, int> nodes = cpu_nodes();
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+
+    std::stable_sort(cpus.begin(), cpus.end(), [&nodes](int a, int b) { return nodes[a] < nodes[b]; });
+
+    std::size_t workers = partitions.size();
+    std::size_t host = std::count(host_workers.begin(), host_workers.end(), true);
+    std::size_t light = workers - host;
+
+    // Nothing decodes on the host, share evenly
+    if (host == 0)
+    {
+        host = workers;
+        light = 0;
+    }
+
+    if (cpus.size() < workers)
+    {
+        std::cout << SectionName << ": WARNING! " << workers << " workers on " << cpus.size()
+                  << " CPUs, partitions will overlap." << std::endl;
+
+        for (std::size_t i = 0; i < workers; i++)
+            partitions[i].cpus.push_back(cpus[i % cpus.size()]);
+    }
+    else
+    {
+        // Device workers get one CPU each off the end, host workers split the rest
+        std::size_t pool = cpus.size() - light;
+        std::size_t next_light = pool;
+        std::size_t host_index = 0;
+
+        for (std::size_t i = 0; i < workers; i++)
+        {
+            if (light && !host_workers[i])
+            {
+                partitions[i].cpus.push_back(cpus[next_light++]);
+                continue;
+            }
+
+            std::size_t begin = host_index * pool / host;
+            std::size_t end = (host_index + 1) * pool / host;
+            partitions[i].cpus.assign(cpus.begin() + begin, cpus.begin() + end);
+            host_index++;
+        }
+    }
+
+    for (std::size_t i = 0; i < workers; i++)
+    {
+        std::sort(partitions[i].cpus.begin(), partitions[i].cpus.end());
+
+        for (std::size_t c = 0; c < partitions[i].cpus.size(); c++)
+        {
+            std::map<int, int>::const_iterator iter = nodes.find(partitions[i].cpus[c]);
+            if (iter != nodes.end())
+                partitions[i].nodes.push_back(iter->second);
+        }
+
+        std::sort(partitions[i].nodes.begin(), partitions[i].nodes.end());
+        partitions[i].nodes.erase(std::unique(partitions[i].nodes.begin(), partitions[i].nodes.end()), partitions[i].nodes.end());
+    }
+
+    return partitions;
+}
+
+
+void core_partition_bind(const CorePartition &partition)
+{
+    if (partition.cpus.empty())
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (std::size_t i = 0; i < partition.cpus.size(); i++)
+        CPU_SET(partition.cpus[i], &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cout << SectionName << ": WARNING! Unable to bind to " << partition.to_string() << std::endl;
+
+    // One OpenMP thread per CPU of the partition
+    omp_set_num_threads(static_cast<int>(partition.cpus.size()));
+}
+
+
+std::string core_affinity(void)
+{
+    return format_cpu_list(thread_cpus());
+}
+
+
+std::vector<int> numa_nodes(void)
+{
+    const std::map<int, int> &nodes = cpu_nodes();
+
+    std::vector<int> list;
+    for (std::map<int, int>::const_iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+        list.push_back(iter->second);
+
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+
+    return list;
+}
+
+
+int numa_node_of_cpu(int cpu)
+{
+    const std::map<int, int> &nodes = cpu_nodes();
+
+    std::map<int, int>::const_iterator iter = nodes.find(cpu);
+    return (iter != nodes.end()) ? iter->second : 0;
+}
+
+
+void numa_bind_team(void)
+{
+    std::vector<int> cpus = thread_cpus();
+    if (cpus.empty())
+        return;
+
+    #pragma omp parallel
+    {
+        int thread = omp_get_thread_num();
+
+        if (thread != 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[thread % cpus.size()], &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+    }
+}
+
+
+// CPUs the calling thread may run on
+static std::vector<int> thread_cpus(void)
+{
+    std::vector<int> cpus;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return cpus;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+
+    return cpus;
+}
+
+
+// Parse a kernel CPU list, Ex: "0-3,8,10-11"
+static std::vector<int> parse_cpu_list(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+
+    while (std::getline(stream, range, ','))
+    {
+        int first = 0, last = 0;
+        char dash = 0;
+        std::stringstream range_stream(range);
+
+        if (!(range_stream >> first))
+            continue;
+        if (!(range_stream >> dash >> last) || dash != '-')
+            last = first;
+
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+
+// Sorted numbers into a kernel style list
+static std::string format_cpu_list(const std::vector<int> &cpus)
+{
+    std::string list;
+
+    for (std::size_t i = 0; i < cpus.size(); )
+    {
+        std::size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+
+        if (!list.empty())
+            list += ",";
+        list += std::to_string(cpus[i]);
+        if (j > i)
+            list += "-" + std::to_string(cpus[j]);
+
+        i = j + 1;
+    }
+
+    return list;
+}
+
+
+// NUMA node of each CPU from sysfs, empty without NUMA support.  Read once.
+static const std::map<int, int>& cpu_nodes(void)
+{
+    static const std::map<int, int> nodes = read_cpu_nodes();
+    return nodes;
+}
+
+static std::map<int, int> read_cpu_nodes(void)
+{
+    std::map<int, int> nodes;
+
+    for (int node = 0; node < MaxNodes; node++)
+    {
+        std::ifstream file((NodeDir + std::to_string(node) + "/cpulist").c_str());
+        if (!file)
+            continue;
+
+        std::string list;
+        std::getline(file, list);
+
+        std::vector<int> cpus = parse_cpu_list(list);
+        for (std::size_t i = 0; i < cpus.size(); i++)
+            nodes[cpus[i]] = node;
+    }
+
+    return nodes;
+}
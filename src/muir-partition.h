@@ -0,0 +1,55 @@
+#ifndef MUIR_PARTITION_H
+#define MUIR_PARTITION_H
+//
+// C++ Interface: muir-partition
+//
+// Description: Divide the machine's CPUs between concurrent decoding threads so
+//              their OpenMP teams don't oversubscribe the same cores.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <string>
+#include <vector>
+
+// A disjoint set of CPUs, and the NUMA nodes they belong to
+struct CorePartition
+{
+    std::vector<int> cpus;
+    std::vector<int> nodes;
+
+    // Ex: "cpus 0-7 (node 0)"
+    std::string to_string() const;
+};
+
+// Split the CPUs this process may run on into one partition per worker.  Workers
+// that decode on the host share the CPUs evenly, the others (which only drive a
+// device) get a single CPU each.  CPUs are ordered by NUMA node first, so partitions
+// keep to whole nodes when the split allows.  If there are fewer CPUs than workers
+// the partitions overlap.
+std::vector<CorePartition> core_partitions(const std::vector<bool> &host_workers);
+
+// Bind the calling thread, and the OpenMP team it starts, to the partition: sets the
+// thread's CPU affinity and its OpenMP team size.  Must be called before the thread's
+// first parallel region, as OpenMP workers inherit the affinity they are created with.
+void core_partition_bind(const CorePartition &partition);
+
+// CPUs the calling thread may run on as a list, Ex: "0-3,8,10-11"
+std::string core_affinity(void);
+
+// Online NUMA nodes, empty if the kernel doesn't report any
+std::vector<int> numa_nodes(void);
+
+// NUMA node of a CPU, 0 if unknown
+int numa_node_of_cpu(int cpu);
+
+// Pin each worker of the calling thread's OpenMP team to one CPU of the calling thread's
+// affinity, in order, so workers stay next to the pages they first touched.  The calling
+// thread itself keeps its affinity.
+void numa_bind_team(void);
+
+#endif //MUIR_PARTITION_H
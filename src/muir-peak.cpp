@@ -0,0 +1,309 @@
+//
+// C++ Implementation: muir-peak
+//
+// Description: Vectorized power and peak search kernels for the CPU decoding process.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-peak.h"
+
+#include <algorithm>
+
+// The vector kernels are compiled for their own instruction set with target attributes,
+// so one binary runs everywhere and picks the best kernel at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MUIR_PEAK_X86
+#include <immintrin.h>
+#endif
+
+/// Kernels
+// Peak power of count consecutive interleaved complex values, starting from max_power
+typedef float (*PeakRangeFunc)(const float *spectrum, std::size_t count, float max_power);
+
+static float peak_range_scalar(const float *spectrum, std::size_t count, float max_power)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        float power = spectrum[i*2]*spectrum[i*2] + spectrum[i*2+1]*spectrum[i*2+1];
+
+        if (power > max_power)
+            max_power = power;
+    }
+
+    return max_power;
+}
+
+#ifdef MUIR_PEAK_X86
+// Each kernel loads pairs of vectors of interleaved values and splits them into real and
+// imaginary parts with an in-lane shuffle.  That scrambles the order of the bins, which
+// doesn't matter for a maximum.  Two accumulators keep independent max chains in flight.
+// Count is the number of values when known at compile time (0 if not), which leaves
+// fixed trip count loops with no tail for the compiler to unroll.
+
+template<std::size_t Count>
+__attribute__((target("sse2")))
+static float peak_range_sse2(const float *spectrum, std::size_t count, float max_power)
+{
+    if (Count)
+        count = Count;
+
+    __m128 acc0 = _mm_set1_ps(max_power);
+    __m128 acc1 = acc0;
+    std::size_t i = 0;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        const float *p = spectrum + i*2;
+        __m128 a0 = _mm_loadu_ps(p);
+        __m128 b0 = _mm_loadu_ps(p + 4);
+        __m128 a1 = _mm_loadu_ps(p + 8);
+        __m128 b1 = _mm_loadu_ps(p + 12);
+
+        __m128 re0 = _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2,0,2,0));
+        __m128 im0 = _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3,1,3,1));
+        __m128 re1 = _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2,0,2,0));
+        __m128 im1 = _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3,1,3,1));
+
+        acc0 = _mm_max_ps(acc0, _mm_add_ps(_mm_mul_ps(re0, re0), _mm_mul_ps(im0, im0)));
+        acc1 = _mm_max_ps(acc1, _mm_add_ps(_mm_mul_ps(re1, re1), _mm_mul_ps(im1, im1)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_max_ps(acc0, acc1));
+    max_power = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    return peak_range_scalar(spectrum + i*2, count - i, max_power);
+}
+
+template<std::size_t Count>
+__attribute__((target("avx2,fma")))
+static float peak_range_avx2(const float *spectrum, std::size_t count, float max_power)
+{
+    if (Count)
+        count = Count;
+
+    __m256 acc0 = _mm256_set1_ps(max_power);
+    __m256 acc1 = acc0;
+    std::size_t i = 0;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        const float *p = spectrum + i*2;
+        __m256 a0 = _mm256_loadu_ps(p);
+        __m256 b0 = _mm256_loadu_ps(p + 8);
+        __m256 a1 = _mm256_loadu_ps(p + 16);
+        __m256 b1 = _mm256_loadu_ps(p + 24);
+
+        __m256 re0 = _mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(2,0,2,0));
+        __m256 im0 = _mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(3,1,3,1));
+        __m256 re1 = _mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(2,0,2,0));
+        __m256 im1 = _mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(3,1,3,1));
+
+        acc0 = _mm256_max_ps(acc0, _mm256_fmadd_ps(re0, re0, _mm256_mul_ps(im0, im0)));
+        acc1 = _mm256_max_ps(acc1, _mm256_fmadd_ps(re1, re1, _mm256_mul_ps(im1, im1)));
+    }
+
+    __m256 acc = _mm256_max_ps(acc0, acc1);
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    max_power = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    return peak_range_scalar(spectrum + i*2, count - i, max_power);
+}
+
+// GCC 12 warns that '__Y' is used uninitialized wherever _mm512_max_ps is inlined, from
+// the _mm512_undefined_ps() it passes as the unused merge source (GCC bug 105593)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+template<std::size_t Count>
+__attribute__((target("avx512f")))
+static float peak_range_avx512(const float *spectrum, std::size_t count, float max_power)
+{
+    if (Count)
+        count = Count;
+
+    __m512 acc0 = _mm512_set1_ps(max_power);
+    __m512 acc1 = acc0;
+    std::size_t i = 0;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        const float *p = spectrum + i*2;
+        __m512 a0 = _mm512_loadu_ps(p);
+        __m512 b0 = _mm512_loadu_ps(p + 16);
+        __m512 a1 = _mm512_loadu_ps(p + 32);
+        __m512 b1 = _mm512_loadu_ps(p + 48);
+
+        __m512 re0 = _mm512_shuffle_ps(a0, b0, _MM_SHUFFLE(2,0,2,0));
+        __m512 im0 = _mm512_shuffle_ps(a0, b0, _MM_SHUFFLE(3,1,3,1));
+        __m512 re1 = _mm512_shuffle_ps(a1, b1, _MM_SHUFFLE(2,0,2,0));
+        __m512 im1 = _mm512_shuffle_ps(a1, b1, _MM_SHUFFLE(3,1,3,1));
+
+        acc0 = _mm512_max_ps(acc0, _mm512_fmadd_ps(re0, re0, _mm512_mul_ps(im0, im0)));
+        acc1 = _mm512_max_ps(acc1, _mm512_fmadd_ps(re1, re1, _mm512_mul_ps(im1, im1)));
+    }
+
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, _mm512_max_ps(acc0, acc1));
+    max_power = *std::max_element(lanes, lanes + 16);
+
+    return peak_range_scalar(spectrum + i*2, count - i, max_power);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // MUIR_PEAK_X86
+
+
+/// Dispatch
+enum PeakISA {PEAK_SCALAR, PEAK_SSE2, PEAK_AVX2, PEAK_AVX512};
+
+struct PeakKernel
+{
+    PeakRangeFunc range;
+    PeakISA isa;
+    std::string name;
+};
+
+static PeakKernel select_peak_kernel(void)
+{
+    PeakKernel kernel = {peak_range_scalar, PEAK_SCALAR, "scalar"};
+
+#ifdef MUIR_PEAK_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        kernel.range = peak_range_avx512<0>;
+        kernel.isa = PEAK_AVX512;
+        kernel.name = "avx512";
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        kernel.range = peak_range_avx2<0>;
+        kernel.isa = PEAK_AVX2;
+        kernel.name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        kernel.range = peak_range_sse2<0>;
+        kernel.isa = PEAK_SSE2;
+        kernel.name = "sse2";
+    }
+#endif
+
+    return kernel;
+}
+
+static const PeakKernel& peak_kernel(void)
+{
+    // Selected once, on first use
+    static const PeakKernel kernel = select_peak_kernel();
+    return kernel;
+}
+
+// Apply a contiguous range kernel to each frame, splitting windows that wrap
+static void peak_power_frames(PeakRangeFunc range,
+                              const float *spectra,
+                              std::size_t frames,
+                              std::size_t frame_stride,
+                              std::size_t fft_size,
+                              std::size_t first_bin,
+                              std::size_t bins,
+                              float *max_power)
+{
+    std::size_t first_count = std::min(bins, fft_size - first_bin);
+    std::size_t wrap_count = bins - first_count;
+
+    for(std::size_t frame = 0; frame < frames; frame++)
+    {
+        const float *spectrum = spectra + frame*frame_stride;
+
+        float power = range(spectrum + first_bin*2, first_count, 0.0f);
+        if (wrap_count)
+            power = range(spectrum, wrap_count, power);
+
+        max_power[frame] = power;
+    }
+}
+
+
+void peak_power(const float *spectra,
+                std::size_t frames,
+                std::size_t frame_stride,
+                std::size_t fft_size,
+                std::size_t first_bin,
+                std::size_t bins,
+                float *max_power)
+{
+    peak_power_frames(peak_kernel().range, spectra, frames, frame_stride, fft_size, first_bin, bins, max_power);
+}
+
+
+void peak_power_scalar(const float *spectra,
+                       std::size_t frames,
+                       std::size_t frame_stride,
+                       std::size_t fft_size,
+                       std::size_t first_bin,
+                       std::size_t bins,
+                       float *max_power)
+{
+    peak_power_frames(peak_range_scalar, spectra, frames, frame_stride, fft_size, first_bin, bins, max_power);
+}
+
+
+const std::string& peak_power_isa(void)
+{
+    return peak_kernel().name;
+}
+
+
+/// Fixed Size
+// Range kernel of the running CPU's instruction set for Count values
+template<std::size_t Count>
+static PeakRangeFunc select_fixed_range(void)
+{
+#ifdef MUIR_PEAK_X86
+    switch (peak_kernel().isa)
+    {
+        case PEAK_AVX512:
+            return peak_range_avx512<Count>;
+        case PEAK_AVX2:
+            return peak_range_avx2<Count>;
+        case PEAK_SSE2:
+            return peak_range_sse2<Count>;
+        case PEAK_SCALAR:
+            break;
+    }
+#endif
+
+    return peak_range_scalar;
+}
+
+template<std::size_t FFTSize>
+void peak_power_fixed(const float *spectra,
+                      std::size_t frames,
+                      std::size_t frame_stride,
+                      float *max_power)
+{
+    static const PeakRangeFunc range = select_fixed_range<FFTSize>();
+
+    for(std::size_t frame = 0; frame < frames; frame++)
+        max_power[frame] = range(spectra + frame*frame_stride, FFTSize, 0.0f);
+}
+
+// Sizes with a specialized kernel, see decode_kernels() in muir-kernels
+template void peak_power_fixed<256>(const float *, std::size_t, std::size_t, float *);
+template void peak_power_fixed<512>(const float *, std::size_t, std::size_t, float *);
+template void peak_power_fixed<1024>(const float *, std::size_t, std::size_t, float *);
+template void peak_power_fixed<2048>(const float *, std::size_t, std::size_t, float *);
+template void peak_power_fixed<4096>(const float *, std::size_t, std::size_t, float *);
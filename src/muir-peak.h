@@ -0,0 +1,51 @@
+#ifndef MUIR_PEAK_H
+#define MUIR_PEAK_H
+//
+// C++ Interface: muir-peak
+//
+// Description: Vectorized power and peak search kernels for the CPU decoding process.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <cstddef>
+#include <string>
+
+// Peak power (re*re + im*im, never below 0) of bins first_bin .. first_bin+bins-1 of each
+// of frames interleaved complex spectra, wrapping at fft_size.  Frame f starts at
+// spectra + f*frame_stride floats.  Writes one value per frame to max_power.
+// Uses the widest instruction set the running CPU supports.
+void peak_power(const float *spectra,
+                std::size_t frames,
+                std::size_t frame_stride,
+                std::size_t fft_size,
+                std::size_t first_bin,
+                std::size_t bins,
+                float *max_power);
+
+// Portable version of peak_power(), the reference for the vectorized kernels.
+void peak_power_scalar(const float *spectra,
+                       std::size_t frames,
+                       std::size_t frame_stride,
+                       std::size_t fft_size,
+                       std::size_t first_bin,
+                       std::size_t bins,
+                       float *max_power);
+
+// peak_power() over every bin of spectra of FFTSize bins, with the size known at compile
+// time so the kernels run fixed loops with no tail.  Only instantiated for the power of
+// two sizes 256 .. 4096.
+template<std::size_t FFTSize>
+void peak_power_fixed(const float *spectra,
+                      std::size_t frames,
+                      std::size_t frame_stride,
+                      float *max_power);
+
+// Name of the instruction set peak_power() dispatches to (scalar, sse2, avx2 or avx512).
+const std::string& peak_power_isa(void);
+
+#endif //MUIR_PEAK_H
@@ -0,0 +1,81 @@
+//
+// C++ Implementation: muir-phasecode
+//
+// Description: Compact binary phasecode representation.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-phasecode.h"
+
+#include <algorithm>
+
+// Bit of each baud within its word
+static const std::uint32_t baud_bit[32] =
+{
+    1u << 0,  1u << 1,  1u << 2,  1u << 3,  1u << 4,  1u << 5,  1u << 6,  1u << 7,
+    1u << 8,  1u << 9,  1u << 10, 1u << 11, 1u << 12, 1u << 13, 1u << 14, 1u << 15,
+    1u << 16, 1u << 17, 1u << 18, 1u << 19, 1u << 20, 1u << 21, 1u << 22, 1u << 23,
+    1u << 24, 1u << 25, 1u << 26, 1u << 27, 1u << 28, 1u << 29, 1u << 30, 1u << 31
+};
+
+PhaseCode::PhaseCode(void)
+: _words(),
+  _size(0)
+{
+}
+
+PhaseCode::PhaseCode(const std::vector<float> &signs)
+: _words(),
+  _size(0)
+{
+    for (std::size_t i = 0; i < signs.size(); i++)
+        push_back(signs[i] < 0.0f);
+}
+
+void PhaseCode::clear(void)
+{
+    _words.clear();
+    _size = 0;
+}
+
+void PhaseCode::push_back(bool negative)
+{
+    if ((_size & 31) == 0)
+        _words.push_back(0);
+
+    if (negative)
+        _words[_size >> 5] |= 1u << (_size & 31);
+
+    _size++;
+}
+
+void PhaseCode::apply(std::size_t first, std::size_t count, const float *in, float *out) const
+{
+    std::size_t i = 0;
+
+    // One code word at a time, testing each baud against a table of bits
+    // (a compare per lane) instead of shifting the word by a different amount per lane.
+    while (i < count)
+    {
+        std::size_t baud = first + i;
+        std::size_t chunk = std::min(count - i, 32 - (baud & 31));
+        std::uint32_t word = _words[baud >> 5];
+        const std::uint32_t *bits = baud_bit + (baud & 31);
+        const float *in_chunk = in + i*2;
+        float *out_chunk = out + i*2;
+
+        for (std::size_t j = 0; j < chunk; j++)
+        {
+            std::uint32_t mask = (word & bits[j]) ? 0x80000000u : 0u;
+            out_chunk[j*2]   = phasecode_apply(in_chunk[j*2],   mask);
+            out_chunk[j*2+1] = phasecode_apply(in_chunk[j*2+1], mask);
+        }
+
+        i += chunk;
+    }
+}
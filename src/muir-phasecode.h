@@ -0,0 +1,73 @@
+#ifndef MUIR_PHASECODE_H
+#define MUIR_PHASECODE_H
+//
+// C++ Interface: muir-phasecode
+//
+// Description: Compact binary phasecode representation.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// A binary (+/-) phasecode packed one bit per baud, bit i%32 of word i/32 set for '-'.
+// Applying the code is flipping the sign bit of the samples under the set bits.
+class PhaseCode
+{
+  public:
+    PhaseCode(void);
+
+    // From +1/-1 (any negative value is '-')
+    explicit PhaseCode(const std::vector<float> &signs);
+
+    void clear(void);
+    void push_back(bool negative);
+
+    std::size_t size() const
+        { return _size; };
+    bool empty() const
+        { return _size == 0; };
+
+    bool negative(std::size_t i) const
+        { return (_words[i >> 5] >> (i & 31)) & 1u; };
+
+    // Copy count interleaved complex samples from in to out, applying bauds first ..
+    // first+count-1.  Vectorizes without needing per-lane shifts.
+    void apply(std::size_t first, std::size_t count, const float *in, float *out) const;
+
+    // Baud i as +1.0f or -1.0f
+    float operator[](std::size_t i) const
+        { return negative(i) ? -1.0f : 1.0f; };
+
+    // Packed bits, (size()+31)/32 words
+    const std::vector<std::uint32_t>& words() const
+        { return _words; };
+
+    bool operator==(const PhaseCode &right) const
+        { return _size == right._size && _words == right._words; };
+    bool operator!=(const PhaseCode &right) const
+        { return !(*this == right); };
+
+  private:
+    std::vector<std::uint32_t> _words;
+    std::size_t _size;
+};
+
+// Flip the sign of a float by a baud's mask, 0x80000000 for a '-' baud, else 0
+inline float phasecode_apply(float value, std::uint32_t mask)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits ^= mask;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#endif //MUIR_PHASECODE_H
@@ -0,0 +1,322 @@
+//
+// C++ Implementation: muir-plan
+//
+// Description: Order a batch of files for decoding, largest first, and estimate how
+//              they spread over the processing devices.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-plan.h"
+#include "muir-hd5.h"
+#include "muir-constants.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+/// Constants
+static const std::string SectionName("Plan");
+
+static PlanFile plan_stat_file(const std::string &path, const DecodingConfig &config);
+
+
+std::vector<PlanFile> plan_files(const std::vector<std::string> &paths, const DecodingConfig &config)
+{
+    std::vector<PlanFile> files;
+    for (std::size_t i = 0; i < paths.size(); i++)
+        files.push_back(plan_stat_file(paths[i], config));
+
+    // Ties keep their given order
+    std::stable_sort(files.begin(), files.end(), [](const PlanFile &a, const PlanFile &b) { return a.cost > b.cost; });
+
+    return files;
+}
+
+
+std::vector<PlanEntry> plan_dispatch(const std::vector<PlanFile> &files, const std::vector<double> &throughput)
+{
+    std::vector<PlanEntry> plan;
+    if (throughput.empty())
+        return plan;
+
+    // Every free device takes the next file, the one that frees first goes first
+    std::vector<double> free_at(throughput.size(), 0.0);
+
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        std::size_t device = std::min_element(free_at.begin(), free_at.end()) - free_at.begin();
+
+        PlanEntry entry;
+        entry.file = i;
+        entry.device = static_cast<int>(device);
+        entry.start = free_at[device];
+        entry.finish = entry.start + files[i].cost / throughput[device];
+        free_at[device] = entry.finish;
+
+        plan.push_back(entry);
+    }
+
+    return plan;
+}
+
+
+void print_plan(std::ostream &out, const std::vector<PlanFile> &files, const std::vector<PlanEntry> &plan, bool measured)
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::setprecision(2);
+    out.setf(std::ios::fixed, std::ios::floatfield);
+
+    // Without measurements times are relative, in units of the largest file on one device
+    double scale = 1.0;
+    if (!measured && !files.empty() && files[0].cost > 0)
+        scale = 1.0 / files[0].cost;
+    const char *unit = measured ? "s" : "";
+
+    double makespan = 0.0;
+    double total = 0.0;
+    out << SectionName << ": " << files.size() << " files, largest first" << std::endl;
+    for (std::size_t i = 0; i < plan.size(); i++)
+    {
+        const PlanFile &file = files[plan[i].file];
+        makespan = std::max(makespan, plan[i].finish);
+        total += file.cost;
+
+        out << SectionName << ": " << std::setw(3) << i << "  device " << plan[i].device
+            << "  " << std::setw(8) << plan[i].start * scale << unit
+            << " - " << std::setw(8) << plan[i].finish * scale << unit
+            << "  " << file.sets << "x" << file.cols << "x" << file.rangebins
+            << "  cost " << std::setprecision(3) << std::scientific << file.cost
+            << std::setprecision(2) << std::fixed << "  " << file.path
+            << (file.cost > 0 ? "" : "  (unreadable)") << std::endl;
+    }
+
+    out << SectionName << ": Estimated " << (measured ? "wall time " : "relative wall time ") << makespan * scale << unit
+        << ", total cost " << std::setprecision(3) << std::scientific << total << std::endl;
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+ShardSpec shard_from_string(const std::string &text)
+{
+    ShardSpec shard;
+    std::stringstream stream(text);
+    char slash = 0;
+    long index = -1, count = 0;
+
+    if (!(stream >> index >> slash >> count) || slash != '/' || !stream.eof() || count < 1 || index < 0 || index >= count)
+        throw std::invalid_argument("Bad shard: " + text + " (expecting i/N with 0 <= i < N)");
+
+    shard.index = static_cast<unsigned int>(index);
+    shard.count = static_cast<unsigned int>(count);
+    return shard;
+}
+
+
+std::vector<unsigned int> plan_shards(const std::vector<PlanFile> &files, unsigned int count)
+{
+    std::vector<unsigned int> assignment(files.size(), 0);
+    if (count <= 1)
+        return assignment;
+
+    // Largest first, equal costs by path
+    std::vector<std::size_t> order(files.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&files](std::size_t a, std::size_t b)
+        {
+            if (files[a].cost != files[b].cost)
+                return files[a].cost > files[b].cost;
+            return files[a].path < files[b].path;
+        });
+
+    // Each to the least loaded shard, the lowest numbered on ties.  Unreadable files
+    // (no cost) count as one unit so they spread out too.
+    std::vector<double> load(count, 0.0);
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        std::size_t shard = std::min_element(load.begin(), load.end()) - load.begin();
+        assignment[order[i]] = static_cast<unsigned int>(shard);
+        load[shard] += (files[order[i]].cost > 0) ? files[order[i]].cost : 1.0;
+    }
+
+    return assignment;
+}
+
+
+std::vector<PlanFile> plan_shard(const std::vector<PlanFile> &files, const ShardSpec &shard)
+{
+    std::vector<unsigned int> assignment = plan_shards(files, shard.count);
+
+    std::vector<PlanFile> mine;
+    for (std::size_t i = 0; i < files.size(); i++)
+        if (assignment[i] == shard.index)
+            mine.push_back(files[i]);
+
+    std::cout << SectionName << ": Shard " << shard.index << "/" << shard.count << " has " << mine.size()
+              << " of " << files.size() << " files" << std::endl;
+
+    return mine;
+}
+
+
+void write_shard_manifest(const std::string &filename, const std::vector<PlanFile> &files, unsigned int count)
+{
+    std::vector<unsigned int> assignment = plan_shards(files, count);
+
+    // Sorted by shard, then path, so every process writes the same manifest
+    std::vector<std::size_t> order(files.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+        {
+            if (assignment[a] != assignment[b])
+                return assignment[a] < assignment[b];
+            return files[a].path < files[b].path;
+        });
+
+    std::ofstream out(filename.c_str());
+    if (!out)
+        throw std::runtime_error("Unable to write shard manifest: " + filename);
+
+    out << "# shard\tcost\tpath (" << count << " shards, " << files.size() << " files)" << std::endl;
+    out << std::setprecision(6) << std::scientific;
+    for (std::size_t i = 0; i < order.size(); i++)
+        out << assignment[order[i]] << "/" << count << "\t" << files[order[i]].cost << "\t" << files[order[i]].path << std::endl;
+
+    if (!out)
+        throw std::runtime_error("Unable to write shard manifest: " + filename);
+
+    std::cout << SectionName << ": Wrote shard manifest " << filename << std::endl;
+}
+
+
+std::vector<std::string> shard_paths(const std::vector<std::string> &paths, const DecodingConfig &config,
+                                     const ShardSpec &shard, const std::string &manifest)
+{
+    if (shard.count <= 1 && manifest.empty())
+        return paths;
+
+    std::vector<PlanFile> files;
+    for (std::size_t i = 0; i < paths.size(); i++)
+        files.push_back(plan_stat_file(paths[i], config));
+
+    if (!manifest.empty())
+        write_shard_manifest(manifest, files, shard.count);
+
+    if (shard.count <= 1)
+        return paths;
+
+    std::vector<PlanFile> mine = plan_shard(files, shard);
+
+    std::vector<std::string> kept;
+    for (std::size_t i = 0; i < mine.size(); i++)
+        kept.push_back(mine[i].path);
+
+    return kept;
+}
+
+
+void DeviceThroughput::record(int device, double cost, double seconds)
+{
+    if (!(cost > 0 && seconds > 0))
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    Total &total = _totals[device];
+    total.cost += cost;
+    total.seconds += seconds;
+}
+
+
+std::vector<double> DeviceThroughput::rates(std::size_t devices, bool *measured) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    double sum = 0.0;
+    std::size_t count = 0;
+    for (std::map<int, Total>::const_iterator iter = _totals.begin(); iter != _totals.end(); ++iter)
+    {
+        sum += iter->second.cost / iter->second.seconds;
+        count++;
+    }
+
+    std::vector<double> rates(devices, count ? sum / count : 1.0);
+    for (std::size_t d = 0; d < devices; d++)
+    {
+        std::map<int, Total>::const_iterator iter = _totals.find(static_cast<int>(d));
+        if (iter != _totals.end())
+            rates[d] = iter->second.cost / iter->second.seconds;
+    }
+
+    if (measured)
+        *measured = (count > 0);
+
+    return rates;
+}
+
+
+// Dimensions of the raw samples, with the time integration and range window of the
+// decode applied.  The FFT size is the same for every file.  Decoded files just count
+// their decoded values.
+static PlanFile plan_stat_file(const std::string &path, const DecodingConfig &config)
+{
+    PlanFile file;
+    file.path = path;
+    file.sets = file.cols = file.rangebins = 0;
+    file.cost = 0.0;
+
+    try
+    {
+        std::lock_guard<std::mutex> hdf5_lock(hdf5_mutex());
+        MuirHD5 h5file(path, H5F_ACC_RDONLY);
+
+        // Already decoded, Ex: muir-rti --decode-load
+        if (H5Lexists(h5file.getId(), "/Raw11", H5P_DEFAULT) <= 0 &&
+            H5Lexists(h5file.getId(), RTI_DECODEDDIR_PATH.c_str(), H5P_DEFAULT) > 0 &&
+            H5Lexists(h5file.getId(), RTI_DECODEDDATA_PATH.c_str(), H5P_DEFAULT) > 0)
+        {
+            std::vector<hsize_t> dims = h5file.read_dims(RTI_DECODEDDATA_PATH);
+            if (dims.size() == 3)
+            {
+                file.sets = dims[0];
+                file.cols = dims[1];
+                file.rangebins = dims[2];
+                file.cost = static_cast<double>(file.sets) * file.cols * file.rangebins;
+            }
+            return file;
+        }
+
+        std::vector<hsize_t> dims = h5file.read_dims(RTI_RAWSAMPLEDATA_PATH);
+        if (dims.size() != 4)
+            return file;
+
+        unsigned int integration = std::max(config.time_integration, 1u);
+        unsigned int range_start = 0;
+        unsigned int range_bins = dims[2];
+        if (config.range_start != 0 || config.range_bins != 0)
+            process_range_window(config, dims[2], range_start, range_bins);
+
+        file.sets = dims[0];
+        file.cols = dims[1] / integration;
+        file.rangebins = range_bins;
+        file.cost = static_cast<double>(file.sets) * file.cols * file.rangebins * config.fft_size;
+    }
+    catch (...)
+    {
+        // Left for the reader to report
+    }
+
+    return file;
+}
@@ -0,0 +1,112 @@
+#ifndef MUIR_PLAN_H
+#define MUIR_PLAN_H
+//
+// C++ Interface: muir-plan
+//
+// Description: Order a batch of files for decoding, largest first, and estimate how
+//              they spread over the processing devices.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-process.h"
+
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// An experiment file and the work it takes to decode it
+struct PlanFile
+{
+    std::string path;
+    std::size_t sets;
+    std::size_t cols;        // After time integration
+    std::size_t rangebins;   // After the range window
+    double      cost;        // sets * cols * rangebins * fft_size, 0 if it couldn't be read
+};
+
+// Where and when a file is expected to decode
+struct PlanEntry
+{
+    std::size_t file;        // Index into the planned files
+    int         device;
+    double      start;
+    double      finish;
+};
+
+// Read the dimensions of every file (not the samples) and sort them by cost, largest
+// first (LPT).  Files that can't be read are kept, last, so loading them reports why.
+// Decoded files (no raw samples) cost sets * cols * rangebins of their decoded data.
+std::vector<PlanFile> plan_files(const std::vector<std::string> &paths, const DecodingConfig &config);
+
+// Simulate the decoding threads taking the next file in order whenever they are free.
+// throughput[d] is device d's cost per second, or a relative speed when unmeasured.
+std::vector<PlanEntry> plan_dispatch(const std::vector<PlanFile> &files, const std::vector<double> &throughput);
+
+void print_plan(std::ostream &out, const std::vector<PlanFile> &files, const std::vector<PlanEntry> &plan, bool measured);
+
+// Shard index of count shards, Ex: "2/8" is index 2 (of 0 .. 7)
+struct ShardSpec
+{
+    unsigned int index;
+    unsigned int count;
+
+    ShardSpec() : index(0), count(1) {}
+};
+
+// Parse "i/N" with 0 <= i < N.  Throws std::invalid_argument.
+ShardSpec shard_from_string(const std::string &text);
+
+// Deal files to count shards, balancing total cost: largest first, each to the shard
+// with the least cost so far.  Depends only on the paths and costs, never on the order
+// the files were given in, so independent processes agree.  Returns each file's shard.
+std::vector<unsigned int> plan_shards(const std::vector<PlanFile> &files, unsigned int count);
+
+// Files of one shard, in the order given
+std::vector<PlanFile> plan_shard(const std::vector<PlanFile> &files, const ShardSpec &shard);
+
+// Every file with its shard and cost, one per line, so a scheduler can check that the
+// shards cover a campaign exactly once.  Throws std::runtime_error if the file can't
+// be written.
+void write_shard_manifest(const std::string &filename, const std::vector<PlanFile> &files, unsigned int count);
+
+// Shard a list of files for tools that don't plan, Ex: muir-rti.  Writes the manifest
+// first when one is named.  Returns this shard's paths in the order given.
+std::vector<std::string> shard_paths(const std::vector<std::string> &paths, const DecodingConfig &config,
+                                     const ShardSpec &shard, const std::string &manifest);
+
+// Cost per second each device achieves, measured over the files it decodes
+class DeviceThroughput
+{
+  public:
+    DeviceThroughput() {}
+
+    void record(int device, double cost, double seconds);
+
+    // Measured rates for devices 0 .. devices-1, devices without a measurement get the
+    // mean of the others (1 if none are measured).  measured is set if any were.
+    std::vector<double> rates(std::size_t devices, bool *measured) const;
+
+  private:
+    struct Total
+    {
+        double cost;
+        double seconds;
+    };
+
+    std::map<int, Total> _totals;
+    mutable std::mutex _mutex;
+
+    // No copying
+    DeviceThroughput(const DeviceThroughput &);
+    DeviceThroughput& operator=(const DeviceThroughput &);
+};
+
+#endif //MUIR_PLAN_H
@@ -12,6 +12,7 @@
 
 #include "muir-plot.h"
 #include "muir-types.h"
+#include "muir-view.h"
 
 #include <gd.h>
 #include <gdfontl.h>
@@ -109,13 +110,17 @@ void save_2dplot(const MuirData &data, const std::string &output_file)
     float data_min = log10(norm(std::complex<float>(_sample_data[0][0][0][0], _sample_data[0][0][0][1]))+1)*10;
     float data_max = log10(norm(std::complex<float>(_sample_data[0][0][0][0], _sample_data[0][0][0][1]))+1)*10;
 
+    MUIR::MuirView<const float, 4> sample_view(_sample_data);
+
     for (SampleDataArray::size_type set = 0; set < dataset_count; set++)
     {
         for (SampleDataArray::size_type col = 0; col < dataset_width; col++)
         {
+            const float *column = sample_view.row(set, col, 0);
+
             for (SampleDataArray::size_type row = 0; row < dataset_height; row++)
             {
-                float sample = log10(norm(std::complex<float>(_sample_data[set][col][row][0], _sample_data[set][col][row][1]))+1)*10;
+                float sample = log10(norm(std::complex<float>(column[row*2], column[row*2+1]))+1)*10;
                 data_min = std::min(data_min,sample);
                 data_max = std::max(data_max,sample);
             }
@@ -144,23 +149,23 @@ void save_2dplot(const MuirData &data, const std::string &output_file)
 
                 if (delta_t == 1)
                 {
-                    float sample = log10(norm(std::complex<float>(_sample_data[set][k][i][0], _sample_data[set][k][i][1]))+1)*10;
+                    float sample = log10(norm(std::complex<float>(sample_view(set, k, i, 0), sample_view(set, k, i, 1)))+1)*10;
                     unsigned char pixel = static_cast<unsigned char>((sample-data_min)/(data_max-data_min)*255);
                     gdImageSetPixel(im, (axis_y_width + border) + frameoffset + k, dataset_height-i, pixel);
                 }
                 else if (delta_t == 2)
                 {
-                    float col1 = log10(norm(std::complex<float>(_sample_data[set][delta_t*k][i][0], _sample_data[set][delta_t*k][i][1])))*10;
-                    float col2 = log10(norm(std::complex<float>(_sample_data[set][delta_t*k+1][i][0], _sample_data[set][delta_t*k+1][i][1])))*10;
+                    float col1 = log10(norm(std::complex<float>(sample_view(set, delta_t*k, i, 0), sample_view(set, delta_t*k, i, 1))))*10;
+                    float col2 = log10(norm(std::complex<float>(sample_view(set, delta_t*k+1, i, 0), sample_view(set, delta_t*k+1, i, 1))))*10;
                     unsigned char pixel = static_cast<unsigned char>((((col1 + col2)/2.0)-data_min)/(data_max-data_min)*255);
                     gdImageSetPixel(im, (axis_y_width + border) + frameoffset + k, dataset_height-i, pixel);
                 }
                 else if (delta_t == 4) // It might be better if this was a loop.....  just a thought.  It does look rather loopworthy...
                 {
-                    float col1 = log10(norm(std::complex<float>(_sample_data[set][delta_t*k][i][0], _sample_data[set][delta_t*k][i][1])))*10;
-                    float col2 = log10(norm(std::complex<float>(_sample_data[set][delta_t*k+1][i][0], _sample_data[set][delta_t*k+1][i][1])))*10;
-                    float col3 = log10(norm(std::complex<float>(_sample_data[set][delta_t*k+2][i][0], _sample_data[set][delta_t*k+2][i][1])))*10;
-                    float col4 = log10(norm(std::complex<float>(_sample_data[set][delta_t*k+3][i][0], _sample_data[set][delta_t*k+3][i][1])))*10;
+                    float col1 = log10(norm(std::complex<float>(sample_view(set, delta_t*k, i, 0), sample_view(set, delta_t*k, i, 1))))*10;
+                    float col2 = log10(norm(std::complex<float>(sample_view(set, delta_t*k+1, i, 0), sample_view(set, delta_t*k+1, i, 1))))*10;
+                    float col3 = log10(norm(std::complex<float>(sample_view(set, delta_t*k+2, i, 0), sample_view(set, delta_t*k+2, i, 1))))*10;
+                    float col4 = log10(norm(std::complex<float>(sample_view(set, delta_t*k+3, i, 0), sample_view(set, delta_t*k+3, i, 1))))*10;
                     unsigned char pixel = static_cast<unsigned char>((((col1 + col2 + col3 + col4)/4.0)-data_min)/(data_max-data_min)*255);
                     gdImageSetPixel(im, (axis_y_width + border) + frameoffset + k, dataset_height-i, pixel);
                 }
@@ -336,13 +341,17 @@ void save_fftw_2dplot(const MuirData &data, const std::string &output_file)
     float data_min = log10(_decoded_data[0][0][0]+1)*10;
     float data_max = log10(_decoded_data[0][0][0]+1)*10;
 
+    MUIR::MuirView<const float, 3> decoded_view(_decoded_data);
+
     for (SampleDataArray::size_type set = 0; set < dataset_count; set++)
     {
         for (SampleDataArray::size_type col = 0; col < dataset_width; col++)
         {
+            const float *column = decoded_view.row(set, col);
+
             for (SampleDataArray::size_type row = 0; row < dataset_height; row++)
             {
-                float sample = log10(_decoded_data[set][col][row]+1)*10;
+                float sample = log10(column[row]+1)*10;
                 data_min = std::min(data_min,sample);
                 data_max = std::max(data_max,sample);
             }
@@ -370,23 +379,23 @@ void save_fftw_2dplot(const MuirData &data, const std::string &output_file)
 
                 if (delta_t == 1)
                 {
-                    float sample = log10(_decoded_data[set][k][i]+1)*10;
+                    float sample = log10(decoded_view(set, k, i)+1)*10;
                     unsigned char pixel = static_cast<unsigned char>((sample-data_min)/(data_max-data_min)*255);
                     gdImageSetPixel(im, (axis_y_width + border) + frameoffset + k, dataset_height-i, pixel);
                 }
                 else if (delta_t == 2)
                 {
-                    float col1 = log10(_decoded_data[set][delta_t*k][i]+1)*10;
-                    float col2 = log10(_decoded_data[set][delta_t*k+1][i]+1)*10;
+                    float col1 = log10(decoded_view(set, delta_t*k, i)+1)*10;
+                    float col2 = log10(decoded_view(set, delta_t*k+1, i)+1)*10;
                     unsigned char pixel = static_cast<unsigned char>((((col1 + col2)/2.0)-data_min)/(data_max-data_min)*255);
                     gdImageSetPixel(im, (axis_y_width + border) + frameoffset + k, dataset_height-i, pixel);
                 }
                 else if (delta_t == 4) // It might be better if this was a loop.....  just a thought.  It does look rather loopworthy...
                 {
-                    float col1 = log10(_decoded_data[set][delta_t*k][i]+1)*10;
-                    float col2 = log10(_decoded_data[set][delta_t*k+1][i]+1)*10;
-                    float col3 = log10(_decoded_data[set][delta_t*k+2][i]+1)*10;
-                    float col4 = log10(_decoded_data[set][delta_t*k+3][i]+1)*10;
+                    float col1 = log10(decoded_view(set, delta_t*k, i)+1)*10;
+                    float col2 = log10(decoded_view(set, delta_t*k+1, i)+1)*10;
+                    float col3 = log10(decoded_view(set, delta_t*k+2, i)+1)*10;
+                    float col4 = log10(decoded_view(set, delta_t*k+3, i)+1)*10;
                     unsigned char pixel = static_cast<unsigned char>((((col1 + col2 + col3 + col4)/4.0)-data_min)/(data_max-data_min)*255);
                     gdImageSetPixel(im, (axis_y_width + border) + frameoffset + k, dataset_height-i, pixel);
                 }
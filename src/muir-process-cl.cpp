@@ -13,6 +13,7 @@
 #include "stage2-fft.cl.h"
 #include "stage3-power.cl.h"
 #include "stage4-findpeak.cl.h"
+#include "stage0-timeintegration.cl.h"
 #endif
 
 
@@ -24,6 +25,7 @@
 #define CL_HPP_ENABLE_EXCEPTIONS
 #include <CL/opencl.hpp>
 //#endif
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -51,22 +53,25 @@ static const std::string ProcessString("OpenCL Decoding Process");
 std::vector<cl::Platform> muir_cl_platforms;
 std::vector<cl::Device> muir_cl_devices;
 cl::Context muir_cl_context;
-cl::Program stage_program[4];
+cl::Program stage_program[5];
 
-std::string kernel_sources[4] = { std::string(reinterpret_cast<char *>(stage1_phasecode_cl), stage1_phasecode_cl_len),
+std::string kernel_sources[5] = { std::string(reinterpret_cast<char *>(stage1_phasecode_cl), stage1_phasecode_cl_len),
                                   std::string(reinterpret_cast<char *>(stage2_fft_cl), stage2_fft_cl_len),
                                   std::string(reinterpret_cast<char *>(stage3_power_cl), stage3_power_cl_len),
-                                  std::string(reinterpret_cast<char *>(stage4_findpeak_cl), stage4_findpeak_cl_len) };
+                                  std::string(reinterpret_cast<char *>(stage4_findpeak_cl), stage4_findpeak_cl_len),
+                                  std::string(reinterpret_cast<char *>(stage0_timeintegration_cl), stage0_timeintegration_cl_len) };
 
-std::string kernel_files[4] = {"stage1-phasecode.cl",
+std::string kernel_files[5] = {"stage1-phasecode.cl",
                                "stage2-fft.cl",
                                "stage3-power.cl",
-                               "stage4-findpeak.cl" };
+                               "stage4-findpeak.cl",
+                               "stage0-timeintegration.cl" };
 
-std::string kernel_function[4] = {"phasecode",
+std::string kernel_function[5] = {"phasecode",
                                   "fft0",
                                   "power",
-                                  "findpeak" };
+                                  "findpeak",
+                                  "timeintegration" };
 
 
 
@@ -148,7 +153,7 @@ void decode_cl_load_kernels(void)
     }
 
     /// Compile Kernels
-    for (unsigned int i = 0; i < 4; i++)
+    for (unsigned int i = 0; i < 5; i++)
     {
         stage_program[i] = cl::Program(muir_cl_context, kernel_sources[i]);
         try{
@@ -170,7 +175,8 @@ void decode_cl_load_kernels(void)
 
 int process_data_cl(int id,
                     const Muir4DArrayF& sample_data,
-                    const std::vector<float>& phasecode,
+                    const SampleLayout& sample_layout,
+                    const PhaseCode& phasecode,
                     Muir3DArrayF& output_data,
                     DecodingConfig &config,
                     std::vector<std::string>& timing_strings,
@@ -189,28 +195,54 @@ int process_data_cl(int id,
     if(config.fft_size != 1024)
         throw(std::logic_error("ERROR: Muir OpenCL Process can only handle N=1024 FFT"));
 
-    /// Get sizes that we are working with
-    const Muir4DArrayF::size_type *array_dims = sample_data.shape();
-
-    //std::vector<size_t> ex;
-    //ex.assign( array_dims, array_dims+sample_data.num_dimensions() );
-
+    /// Get sizes that we are working with (the layout describes how sample_data is arranged)
     unsigned int FFT_NSize = config.fft_size;;
     float normalize = 1/static_cast<float>(FFT_NSize);
 
-    Muir4DArrayF::size_type max_sets = array_dims[0];
-    Muir4DArrayF::size_type max_cols = array_dims[1];
-    Muir4DArrayF::size_type num_rangebins = array_dims[2];
+    Muir4DArrayF::size_type max_sets = sample_layout.sets;
+    Muir4DArrayF::size_type max_cols = sample_layout.cols;
+    Muir4DArrayF::size_type num_rangebins = sample_layout.rangebins;
+
+    if (sample_data.num_elements() < sample_layout.blocks() * sample_layout.frames() * sample_layout.block * 2)
+        throw std::logic_error("process_data_cl(): Sample layout doesn't fit the sample data!");
+
+    /// Configure Time Integration
+    // Each group of integration consecutive pulses (columns) of a set is averaged into one
+    // before decoding.  The intermediate stage output is in the natural layout.
+    unsigned int integration = std::max(config.time_integration, 1u);
+    SampleLayout integrated_layout = process_time_integration_layout(sample_layout, integration);
+    if (config.intermediate_stage == STAGE_TIMEINTEGRATION)
+        integrated_layout = SampleLayout(integrated_layout.sets, integrated_layout.cols, integrated_layout.rangebins);
+    bool integrate = (integration > 1 || config.intermediate_stage == STAGE_TIMEINTEGRATION);
+
+    max_cols = integrated_layout.cols;
     int  total_frames = max_sets*max_cols;
 
+    /// Configure Range Window
+    // Range gates range_start .. range_start+range_bins-1 are decoded, output_data only holds those.
+    unsigned int range_start = 0;
+    unsigned int range_bins = num_rangebins;
+    process_range_window(config, num_rangebins, range_start, range_bins);
+
+    /// Configure Doppler Window
+    // Only bins doppler_start .. doppler_start+doppler_bins-1 (mod FFT size) get their power
+    // computed and searched for the peak.
+    unsigned int doppler_start = 0;
+    unsigned int doppler_bins = FFT_NSize;
+    if (config.doppler_bins != 0 && config.doppler_bins < FFT_NSize)
+    {
+        doppler_start = config.doppler_start % FFT_NSize;
+        doppler_bins = config.doppler_bins;
+    }
+
     Muir4DArrayF prefft_data(boost::extents[max_sets][max_cols][FFT_NSize][2]);
     Muir4DArrayF postfft_data(boost::extents[max_sets][max_cols][FFT_NSize][2]);
-    output_data.resize(boost::extents[max_sets][max_cols][num_rangebins]);
+    output_data.resize(boost::extents[max_sets][max_cols][range_bins]);
 
 
     /// Setup for partial processing, if requested
-    unsigned int start_row = config.intermediate_row;
-    unsigned int end_row = num_rangebins;
+    unsigned int start_row = range_start + config.intermediate_row;
+    unsigned int end_row = range_start + range_bins;
 
     if (!(config.intermediate_stage == STAGE_ALL))
     {
@@ -222,7 +254,6 @@ int process_data_cl(int id,
         if (config.intermediate_stage == STAGE_TIMEINTEGRATION)
         {
             complex_intermediate.resize(boost::extents[max_sets][max_cols][num_rangebins][2]);
-            //post_integration_ref = complex_intermediate;
         }
         else
         {
@@ -233,7 +264,7 @@ int process_data_cl(int id,
     else
     {
         // Initialize decoded data boost multi_array;
-        output_data.resize(boost::extents[max_sets][max_cols][num_rangebins]);
+        output_data.resize(boost::extents[max_sets][max_cols][range_bins]);
     }
 
 
@@ -247,6 +278,7 @@ int process_data_cl(int id,
       cl::Kernel stage2_kernel(stage_program[1], kernel_function[1].c_str(), &err);
       cl::Kernel stage3_kernel(stage_program[2], kernel_function[2].c_str(), &err);
       cl::Kernel stage4_kernel(stage_program[3], kernel_function[3].c_str(), &err);
+      cl::Kernel stage0_kernel(stage_program[4], kernel_function[4].c_str(), &err);
 
 
       // Initialize timing structure
@@ -257,10 +289,11 @@ int process_data_cl(int id,
       timing_strings.push_back("Power Time");     // 3
       timing_strings.push_back("Peakfind Time");  // 4
       timing_strings.push_back("Row Total Time"); // 5
-      timings.resize(boost::extents[timing_strings.size()][num_rangebins]);
+      timings.resize(boost::extents[timing_strings.size()][range_bins]);
 
       size_t sample_size    = sample_data.num_elements()*sizeof(float);
-      size_t phasecode_size = phasecode.size() * sizeof(float);
+      size_t integrated_size = integrated_layout.blocks()*integrated_layout.frames()*integrated_layout.block*2*sizeof(float);
+      size_t phasecode_size = phasecode.words().size() * sizeof(cl_uint);
       size_t prefft_size    = prefft_data.num_elements()*sizeof(float);
       size_t postfft_size   = postfft_data.num_elements()*sizeof(float);
       size_t power_size     = output_data.num_elements()*sizeof(float);
@@ -279,7 +312,7 @@ int process_data_cl(int id,
         std::cout << SectionName << ": GPU[" << id << "], Output      - Size      :" << output_size << std::endl;
 
         for (unsigned int i = 0; i < phasecode.size(); i++)
-            std::cout << ((phasecode[i]>0.0f)?1:0);
+            std::cout << (phasecode.negative(i)?0:1);
 
         std::cout << std::endl;
       }
@@ -293,6 +326,9 @@ int process_data_cl(int id,
       cl::Buffer cl_buf_postfft   = cl::Buffer(muir_cl_context, CL_MEM_READ_WRITE, postfft_size, NULL, &err);
       cl::Buffer cl_buf_power     = cl::Buffer(muir_cl_context, CL_MEM_READ_WRITE, power_size, NULL, &err);
       cl::Buffer cl_buf_output    = cl::Buffer(muir_cl_context, CL_MEM_WRITE_ONLY, output_size, NULL, &err);
+      cl::Buffer cl_buf_integrated;
+      if (integrate)
+          cl_buf_integrated = cl::Buffer(muir_cl_context, CL_MEM_READ_WRITE, integrated_size, NULL, &err);
 
 
       cl::Event in_sample_event, in_phasecode_event, in_prefftdata_event, in_postfftdata_event, in_outputdata_event;
@@ -302,7 +338,7 @@ int process_data_cl(int id,
 
       //push our CPU arrays to the GPU
       err = queue.enqueueWriteBuffer(cl_buf_sample,    CL_TRUE, 0, sample_size,     sample_data.data(), NULL, &in_sample_event);
-      err = queue.enqueueWriteBuffer(cl_buf_phasecode, CL_TRUE, 0, phasecode_size,  &phasecode[0],      NULL, &in_phasecode_event);
+      err = queue.enqueueWriteBuffer(cl_buf_phasecode, CL_TRUE, 0, phasecode_size,  phasecode.words().data(), NULL, &in_phasecode_event);
       err = queue.enqueueWriteBuffer(cl_buf_prefft,    CL_TRUE, 0, prefft_size,     prefft_data.data(), NULL, &in_prefftdata_event);
       err = queue.enqueueWriteBuffer(cl_buf_postfft,   CL_TRUE, 0, postfft_size,    postfft_data.data(),NULL, &in_prefftdata_event);
       err = queue.enqueueWriteBuffer(cl_buf_output,    CL_TRUE, 0, output_size,     output_data.data(), NULL, &in_outputdata_event);
@@ -322,21 +358,47 @@ int process_data_cl(int id,
       std::vector<cl::Event> stage3_event_list;
       std::vector<cl::Event> stage4_event_list;
 
+      cl::Event stage0_event;
+      if (integrate)
+      {
+          //Setup Stage 0 (Time Integration) Kernel
+          err = stage0_kernel.setArg(0, cl_buf_sample);
+          err = stage0_kernel.setArg(1, cl_buf_integrated);
+          err = stage0_kernel.setArg(2, integration);                             // Pulses Integrated
+          err = stage0_kernel.setArg(3, (unsigned int)sample_layout.cols);        // Input Columns per Set
+          err = stage0_kernel.setArg(4, (unsigned int)num_rangebins);
+          err = stage0_kernel.setArg(5, (unsigned int)sample_layout.block);       // Input Layout Block
+          err = stage0_kernel.setArg(6, (unsigned int)sample_layout.frames());    // Input Frames
+          err = stage0_kernel.setArg(7, (unsigned int)integrated_layout.block);   // Output Layout Block
+          err = stage0_kernel.setArg(8, (unsigned int)total_frames);              // Output Frames
+
+          //Execute Stage 0 (Time Integration) Kernel, once for all rows
+          err = queue.enqueueNDRangeKernel(stage0_kernel, cl::NullRange, cl::NDRange(num_rangebins,total_frames), cl::NullRange, NULL, &stage0_event);
+
+          // Setup waiting for stage 0
+          waitevents.push_back(stage0_event);
+      }
+
       std::cout << SectionName << ": GPU[" << id << "] Processing...F:" << total_frames << std::endl;
       for(unsigned int i = start_row; i < end_row; i++)
       {
+          if(config.intermediate_stage == STAGE_TIMEINTEGRATION)
+              break;
+
 
           //Setup Stage 1 (Phasecode) Kernel
-          err = stage1_kernel.setArg(0, cl_buf_sample);
+          err = stage1_kernel.setArg(0, (integration > 1)?cl_buf_integrated:cl_buf_sample);
           err = stage1_kernel.setArg(1, cl_buf_phasecode);
           err = stage1_kernel.setArg(2, cl_buf_prefft);
           err = stage1_kernel.setArg(3, i);                              // Current Rangebin
           err = stage1_kernel.setArg(4, (unsigned int)phasecode.size()); // Phasecode Size
           err = stage1_kernel.setArg(5, (unsigned int)num_rangebins);    // Input Stride
           err = stage1_kernel.setArg(6, FFT_NSize);                      // Output Stride
+          err = stage1_kernel.setArg(7, (unsigned int)sample_layout.block); // Range bins per layout block
+          err = stage1_kernel.setArg(8, (unsigned int)total_frames);     // Frames per layout block
 
-          //Execute Stage 1 (Phasecode) Kernel  (dont wait for events on the first run!)
-          err = queue.enqueueNDRangeKernel(stage1_kernel, cl::NullRange, cl::NDRange(phasecode.size(),total_frames), cl::NullRange, (i == start_row)?NULL:&waitevents, &stage1_event);
+          //Execute Stage 1 (Phasecode) Kernel  (dont wait for events on the first run, unless integrating!)
+          err = queue.enqueueNDRangeKernel(stage1_kernel, cl::NullRange, cl::NDRange(phasecode.size(),total_frames), cl::NullRange, waitevents.empty()?NULL:&waitevents, &stage1_event);
 
           // Setup waiting for stage 1
           waitevents.clear();
@@ -367,9 +429,10 @@ int process_data_cl(int id,
           err = stage3_kernel.setArg(0, cl_buf_postfft);
           err = stage3_kernel.setArg(1, cl_buf_power);
           err = stage3_kernel.setArg(2, FFT_NSize);  // Stride
+          err = stage3_kernel.setArg(3, doppler_start); // First Doppler bin
 
           //Execute Stage 3 (Power) Kernel
-          err = queue.enqueueNDRangeKernel(stage3_kernel, cl::NullRange, cl::NDRange(FFT_NSize,total_frames), cl::NullRange, &waitevents, &stage3_event);
+          err = queue.enqueueNDRangeKernel(stage3_kernel, cl::NullRange, cl::NDRange(doppler_bins,total_frames), cl::NullRange, &waitevents, &stage3_event);
 
           // Setup waiting for stage 3
           waitevents.clear();
@@ -381,11 +444,13 @@ int process_data_cl(int id,
           //Setup Stage 4 (PeakFind) Kernel
           err = stage4_kernel.setArg(0, cl_buf_power);
           err = stage4_kernel.setArg(1, cl_buf_output);
-          err = stage4_kernel.setArg(2, i);
+          err = stage4_kernel.setArg(2, i - range_start);   // Output Row
           err = stage4_kernel.setArg(3, FFT_NSize);         // FFT Size
           err = stage4_kernel.setArg(4, FFT_NSize);         // Input Stride
-          err = stage4_kernel.setArg(5, (int)num_rangebins);// Output Stride
+          err = stage4_kernel.setArg(5, (int)range_bins);   // Output Stride
           err = stage4_kernel.setArg(6, (float)normalize);  // Normalization value
+          err = stage4_kernel.setArg(7, doppler_start);     // First Doppler bin
+          err = stage4_kernel.setArg(8, doppler_bins);      // Doppler bins searched
 
           //Execute Stage 4 (FindPeak) Kernel
           err = queue.enqueueNDRangeKernel(stage4_kernel, cl::NullRange, cl::NDRange(total_frames), cl::NullRange, &waitevents, &stage4_event);
@@ -418,8 +483,7 @@ int process_data_cl(int id,
               queue.enqueueReadBuffer(cl_buf_output, CL_TRUE, 0, output_size, output_data.data(), NULL, &out_outputdata_event);
               break;
           case STAGE_TIMEINTEGRATION:
-              //queue.enqueueReadBuffer(cl_buf_timeint, CL_TRUE, 0, output_size, complex_intermediate.data(), NULL, &out_outputdata_event);
-              throw std::logic_error("process_data_cl(): Not Handling Time Integration yet");
+              queue.enqueueReadBuffer(cl_buf_integrated, CL_TRUE, 0, integrated_size, complex_intermediate.data(), NULL, &out_outputdata_event);
               break;
           case STAGE_PHASECODE:
               queue.enqueueReadBuffer(cl_buf_prefft, CL_TRUE, 0, prefft_size, complex_intermediate.data(), NULL, &out_outputdata_event);
@@ -448,6 +512,8 @@ int process_data_cl(int id,
       }
 
       std::cout << "Transfer in time : " << get_seconds_elapsed(in_sample_event)      << std::endl;
+      if (integrate)
+          std::cout << "Integration time : " << get_seconds_elapsed(stage0_event)         << std::endl;
       std::cout << "Transfer out time: " << get_seconds_elapsed(out_outputdata_event) << std::endl;
 
       // Fill out config
@@ -458,8 +524,12 @@ int process_data_cl(int id,
       config.device = muir_cl_devices[id].getInfo<CL_DEVICE_NAME>();
       config.process = ProcessString;
       config.process_version = ProcessVersion;
+      config.doppler_start = doppler_start;
+      config.doppler_bins = doppler_bins;
+      config.range_start = range_start;
+      config.range_bins = range_bins;
       config.phasecode_muting = 0;
-      config.time_integration = 0;
+      config.time_integration = (integration > 1)?integration:0;
 
     }
     catch (cl::Error& err) {
@@ -18,7 +18,8 @@
 int process_init_cl(void* opengl_ctx);
 int process_data_cl(int id,
                     const Muir4DArrayF& sample_data,
-                    const std::vector<float>& phasecode,
+                    const SampleLayout& sample_layout,
+                    const PhaseCode& phasecode,
                     Muir3DArrayF& decoded_data,
                     DecodingConfig &config,
                     std::vector<std::string>& timing_strings,
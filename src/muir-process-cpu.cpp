@@ -3,11 +3,19 @@
 #include "muir-process.h"
 #include "muir-global.h"
 #include "muir-timer.h"
+#include "muir-fftw.h"
+#include "muir-workspace.h"
+#include "muir-peak.h"
+#include "muir-kernels.h"
+#include "muir-partition.h"
+#include "muir-taskpool.h"
+#include "muir-view.h"
 
 #include <fftw3.h>
 
 #include <iostream>
 #include <complex>
+#include <cmath>
 #include <cstring>
 #include <algorithm>
 #include <gsl/gsl>
@@ -37,32 +45,102 @@ static const std::string SectionName("CPU/OpenMP");
 static const std::string ProcessVersion("0.4");
 static const std::string ProcessString("CPU Decoding (single precision) Process");
 
-void apply_phasecode(const unsigned int range_offset,
-                     const Muir4DArrayF &in_buffer,
-                     const std::vector<float>& phasecode,
-                     Muir4DArrayF &out_buffer,
-                     unsigned int colomn_chunk_size,
-                     unsigned int column_num);
+std::size_t apply_phasecode(const unsigned int range_offset,
+                            const unsigned int tile,
+                            const Muir4DArrayF &in_buffer,
+                            const SampleLayout &in_layout,
+                            const PhaseCode& phasecode,
+                            Muir4DArrayRefF &out_buffer,
+                            std::size_t dirty_rows);
+
+std::size_t apply_phasecode_pruned(const unsigned int range_offset,
+                                   const unsigned int tile,
+                                   const Muir4DArrayF &in_buffer,
+                                   const SampleLayout &in_layout,
+                                   const PhaseCode& phasecode,
+                                   const std::vector<std::complex<float> >& twiddles,
+                                   std::size_t block,
+                                   Muir4DArrayRefF &out_buffer,
+                                   std::size_t dirty_rows);
+
+void apply_dft_bank(const unsigned int range_offset,
+                    const unsigned int tile,
+                    const Muir4DArrayF &in_buffer,
+                    const SampleLayout &in_layout,
+                    const PhaseCode& phasecode,
+                    const std::vector<float>& twiddles_re,
+                    const std::vector<float>& twiddles_im,
+                    std::size_t bins,
+                    Muir4DArrayRefF &out_buffer);
 
 void find_peak(const unsigned int range_offset,
-               const Muir4DArrayF &in_buffer,
-               Muir3DArrayF &out_buffer,
-               unsigned int colomn_chunk_size,
-               unsigned int column_num);
+               const unsigned int tile,
+               const Muir4DArrayRefF &in_buffer,
+               std::size_t first_bin,
+               std::size_t bins,
+               Muir3DArrayF &out_buffer);
+
+static void gather_phasecoded(const float *in_data,
+                              const SampleLayout &in_layout,
+                              std::size_t frame,
+                              std::size_t range,
+                              std::size_t count,
+                              const PhaseCode& phasecode,
+                              float *out);
+
+FFT_Engine select_fft_engine(FFT_Engine requested,
+                             unsigned int fft_size,
+                             std::size_t phasecode_size,
+                             std::size_t doppler_bins,
+                             unsigned int &block);
+
+std::vector<std::complex<float> > make_pruned_twiddles(unsigned int fft_size, unsigned int block);
+
+void make_dft_twiddles(unsigned int fft_size,
+                       unsigned int first_bin,
+                       unsigned int bins,
+                       std::size_t rows,
+                       std::vector<float> &twiddles_re,
+                       std::vector<float> &twiddles_im);
+
+void record_tile_timing(Muir2DArrayD& timings,
+                        std::size_t stage,
+                        unsigned int tile_start,
+                        unsigned int tile_rows,
+                        double seconds);
 
 
 
 // Initialize CPU devices for decoding
 int process_init_cpu()
 {
+    // Warm start the planner from previous runs
+    if (!MUIR_FFTWWisdomFile.empty())
+        wisdom_import(MUIR_FFTWWisdomFile);
+
     // Always return one cpu device (the decoding process is multithreaded with OpenMP)
     return 1;
 }
 
+// Release CPU decoding resources
+void process_cleanup_cpu()
+{
+    // Save anything learned for the next run
+    if (!MUIR_FFTWWisdomFile.empty())
+        wisdom_export(MUIR_FFTWWisdomFile);
+
+    // Plans are cached across rows and files, only drop them once we are done decoding.
+    plan_cache_clear();
+
+    #pragma omp critical (fftw)
+    fftwf_cleanup_threads();
+}
+
 // CPU Decoding Routine
 int process_data_cpu(int id,
                      const Muir4DArrayF& sample_data,
-                     const std::vector<float>& phasecode,
+                     const SampleLayout& sample_layout,
+                     const PhaseCode& phasecode,
                      Muir3DArrayF& decoded_data,
                      DecodingConfig &config,
                      std::vector<std::string>& timing_strings,
@@ -80,12 +158,27 @@ int process_data_cpu(int id,
     accumulator_set< double, features< tag::count, tag::min, tag::mean, tag::max > > acc_row;
 
     /// Get Data Dimensions
-    const Muir4DArrayF::size_type *array_dims = sample_data.shape();
-    assert(_sample_data.num_dimensions() == 4);
-
-    Muir4DArrayF::size_type max_sets = array_dims[0];
-    Muir4DArrayF::size_type max_cols = array_dims[1];
-    Muir4DArrayF::size_type num_rangebins = array_dims[2];
+    // The layout describes how the samples are arranged in sample_data
+    Muir4DArrayF::size_type max_sets = sample_layout.sets;
+    Muir4DArrayF::size_type max_cols = sample_layout.cols;
+    Muir4DArrayF::size_type num_rangebins = sample_layout.rangebins;
+
+    if (sample_data.num_elements() < sample_layout.blocks() * sample_layout.frames() * sample_layout.block * 2)
+        throw std::logic_error("process_data_cpu(): Sample layout doesn't fit the sample data!");
+
+    /// Configure Time Integration
+    // Each group of integration consecutive pulses (columns) of a set is averaged into one
+    // before decoding, so there are max_cols/integration columns to decode.
+    unsigned int integration = std::max(config.time_integration, 1u);
+    SampleLayout integrated_layout = process_time_integration_layout(sample_layout, integration);
+    max_cols = integrated_layout.cols;
+
+    /// Configure Range Window
+    // Range gates range_start .. range_start+range_bins-1 are decoded, decoded_data
+    // only holds those.
+    unsigned int range_start = 0;
+    unsigned int range_bins = num_rangebins;
+    process_range_window(config, num_rangebins, range_start, range_bins);
 
     /// Initialize timing structure
     timing_strings.clear();
@@ -95,17 +188,67 @@ int process_data_cpu(int id,
     timing_strings.push_back("Peakfind Time");  // 3
     timing_strings.push_back("Cleanup Time");   // 4
     timing_strings.push_back("Row Total Time"); // 5
-    timings.resize(boost::extents[timing_strings.size()][num_rangebins]);
+    timings.resize(boost::extents[timing_strings.size()][range_bins]);
 
     /// Configure FFT Size
     unsigned int fft_size = config.fft_size;  // Also used for normalization
 
+    if (MUIR_Verbose)
+        std::cout << SectionName << "[" << id << "]: Phasecode " << phasecode.size() << " bauds" << std::endl;
+
+    /// Configure Doppler Window
+    // Only bins doppler_start .. doppler_start+doppler_bins-1 (mod fft_size) are searched for the peak
+    unsigned int doppler_start = 0;
+    unsigned int doppler_bins = fft_size;
+    if (config.doppler_bins != 0 && config.doppler_bins < fft_size)
+    {
+        doppler_start = config.doppler_start % fft_size;
+        doppler_bins = config.doppler_bins;
+    }
+
+    /// Select FFT Engine
+    // The pruned engine splits the transform into fft_size/block sub-transforms of
+    // the first block (>= phasecode length) samples, skipping the zero padding.
+    // The DFT engine computes only the Doppler window bins, straight from the input.
+    unsigned int block = fft_size;
+    FFT_Engine fft_engine = select_fft_engine(config.fft_engine, fft_size, phasecode.size(), doppler_bins, block);
+
+    std::vector<std::complex<float> > pruned_twiddles;
+    if (fft_engine == FFT_ENGINE_PRUNED)
+        pruned_twiddles = make_pruned_twiddles(fft_size, block);
+
+    std::vector<float> dft_twiddles_re;
+    std::vector<float> dft_twiddles_im;
+    if (fft_engine == FFT_ENGINE_DFT)
+        make_dft_twiddles(fft_size, doppler_start, doppler_bins, std::min<std::size_t>(phasecode.size(), fft_size), dft_twiddles_re, dft_twiddles_im);
+
+    // DFT output only holds the window, packed at the start of each frame
+    unsigned int peak_start = (fft_engine == FFT_ENGINE_DFT)?0:doppler_start;
+
+    /// Select Kernels
+    // Compile-time specialized gather and peak kernels for common phasecode lengths and
+    // FFT sizes, the generic versions handle everything else.
+    DecodeKernels kernels = decode_kernels(fft_size, phasecode.size(),
+                                           fft_engine == FFT_ENGINE_FFTW && integrated_layout.is_natural(),
+                                           fft_engine == FFT_ENGINE_PRUNED && integrated_layout.is_natural(),
+                                           doppler_bins == fft_size);
+    GatherKernel gather = kernels.gather ? kernels.gather : apply_phasecode;
+    PrunedGatherKernel pruned_gather = kernels.pruned_gather ? kernels.pruned_gather : apply_phasecode_pruned;
+    PeakKernel peak = kernels.peak ? kernels.peak : find_peak;
+
+    /// Configure Range Tiling
+    // Each iteration gathers, transforms and peak-finds range_tile consecutive range
+    // offsets with a single batched FFT.  Intermediate data is only kept for one row.
+    unsigned int range_tile = std::max(config.range_tile, 1u);
+    if (!(config.intermediate_stage == STAGE_ALL))
+        range_tile = 1;
+
     /// Configure References
-    unsigned int start_row = config.intermediate_row;
-    unsigned int end_row = num_rangebins;
+    unsigned int start_row = range_start + config.intermediate_row;
+    unsigned int end_row = range_start + range_bins;
     
-    const Muir4DArrayF& sample_data_ref = sample_data;
-    //const Muir4DArrayF& post_integration_ref = sample_data;  // Since we don't Implement time integration yet.
+    Muir4DArrayF integrated_data;  // Only used when integrating
+    const Muir4DArrayF& sample_data_ref = (integration > 1)?integrated_data:sample_data;
 
     if (!(config.intermediate_stage == STAGE_ALL))
     {
@@ -117,54 +260,65 @@ int process_data_cpu(int id,
         if (config.intermediate_stage == STAGE_TIMEINTEGRATION)
         {
             complex_intermediate.resize(boost::extents[max_sets][max_cols][num_rangebins][2]);
-            //post_integration_ref = complex_intermediate;
         }
 
     }
     else
     {
         /// Initialize decoded data boost multi_array;
-        decoded_data.resize(boost::extents[max_sets][max_cols][num_rangebins]);
+        decoded_data.resize(boost::extents[max_sets][max_cols][range_bins]);
     }
 
     /// Time Integration
-    //time_integration(sample_data_ref, post_integration_ref, 0);
+    // Intermediate output is always in the natural layout
     if (config.intermediate_stage == STAGE_TIMEINTEGRATION)
+    {
+        time_integration(sample_data, sample_layout, integration, complex_intermediate, SampleLayout(complex_intermediate));
         return 0;
+    }
 
+    if (integration > 1)
+    {
+        MUIR::Timer integration_time;
+        time_integration(sample_data, sample_layout, integration, integrated_data, integrated_layout);
 
-    // Calculate each row
-    #pragma omp parallel for
-    for(unsigned int phasecode_offset = start_row; phasecode_offset < end_row; phasecode_offset++)
+        if (MUIR_Verbose)
+            std::cout << SectionName << "[" << id << "]: Integrated " << integration << " pulses, "
+                      << max_cols << " columns left, " << integration_time.elapsed() << "s" << std::endl;
+    }
+
+
+    // Gather, transform and peak-find one tile of rows
+    auto decode_tile = [&](unsigned int tile_start, bool report)
     {
         // Row Timing
         MUIR::Timer row_time;
         MUIR::Timer stage_time;
 
-        // Write number of threads in config for first pass
-        if (phasecode_offset == start_row)
-            config.threads = omp_get_num_threads();
+        // The last tile may be short
+        unsigned int tile_rows = std::min(range_tile, end_row - tile_start);
 
         /// Configure References
-        Muir4DArrayF fft_in  = Muir4DArrayF(boost::extents[1][1][1][2]);
-        Muir4DArrayF fft_out = Muir4DArrayF(boost::extents[1][1][1][2]);
-        Muir4DArrayF* fft_in_ptr = &fft_in;   // Defaults
-        Muir4DArrayF* fft_out_ptr = &fft_out; // Defaults
+        // The thread's workspace for this shape is reused from tile to tile (and file to
+        // file), each row of the tile gets max_sets consecutive sets of frames.
+        DecodeWorkspace &workspace = decode_workspace(range_tile*max_sets, max_cols, fft_size, block);
+
+        Muir4DArrayRefF* fft_in_ptr = &workspace.in();   // Defaults
+        Muir4DArrayRefF* fft_out_ptr = &workspace.out(); // Defaults
+        std::size_t *dirty_rows = &workspace.dirty_rows;
+        std::size_t intermediate_dirty_rows = fft_size;  // Intermediate buffers are cleared in full
 
         switch(config.intermediate_stage)
         {
             case STAGE_ALL:
-                fft_in_ptr = &fft_in;
-                fft_out_ptr = &fft_out;
                 break;
             case STAGE_PHASECODE:
+                complex_intermediate.resize(boost::extents[max_sets][max_cols][fft_size][2]);
                 fft_in_ptr = &complex_intermediate;
-                fft_out_ptr = &fft_out;
-
-                //complex_intermediate.resize(boost::extents[max_sets][max_cols][fft_size][2]);
+                dirty_rows = &intermediate_dirty_rows;
                 break;
             case STAGE_POSTFFT:
-                fft_in_ptr = &fft_in;
+                complex_intermediate.resize(boost::extents[max_sets][max_cols][fft_size][2]);
                 fft_out_ptr = &complex_intermediate;
                 break;
             case STAGE_POWER:
@@ -177,80 +331,107 @@ int process_data_cpu(int id,
                 break;
         }
 
-        // Allocate Memory
-        fft_in_ptr->resize(boost::extents[max_sets][max_cols][fft_size][2]);
-        fft_out_ptr->resize(boost::extents[max_sets][max_cols][fft_size][2]);
-
-        fftwf_plan p;
-
-        int N[1] = {gsl::narrow<int>(fft_size)};
-
         // Display stats from first thread
-        int th_id = omp_get_thread_num();
-        if ( th_id == 0 && MUIR_Verbose)
+        if (report && MUIR_Verbose)
             std::cout
                 << SectionName << "[" << id << "]"
-                << ": Progress:" << static_cast<float>(count(acc_row))/static_cast<float>(num_rangebins)*100.0 << "%"
+                << ": Progress:" << static_cast<float>(count(acc_row))/static_cast<float>(range_bins)*100.0 << "%"
                 << "  (Mean Timings [s]) Row TTL: " << mean(acc_row)
                 << ", Setup: " << mean(acc_setup)
                 << ", Copy/Phase/Zero: " << mean(acc_copyto)
                 << ", FFTW: " << mean(acc_fftw)
                 << ", FindPeak: " << mean(acc_copyfrom)
                 << ", Rows/Sec: " << static_cast<float>(count(acc_row))/main_time.elapsed()
-                << ", Threads: " << omp_get_num_threads()
+                << ", Threads: " << config.threads
                 << std::endl;
 
-        #pragma omp critical (fftw)
-        {
-            p = fftwf_plan_many_dft(1, N, max_sets*max_cols, (float (*)[2])fft_in_ptr->data(), NULL, 1, fft_size, (float (*)[2])fft_out_ptr->data(), NULL, 1, fft_size, FFTW_FORWARD, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-        }
+        // Fetch (or create on first use) a plan matching this thread's buffers
+        unsigned int batch = gsl::narrow<unsigned int>(tile_rows*max_sets*max_cols);
+        fftwf_plan p = NULL;  // The DFT engine doesn't use one
+        if (fft_engine == FFT_ENGINE_PRUNED)
+            p = plan_cache_get_pruned(fft_size, block, batch, fft_in_ptr->data(), fft_out_ptr->data(), FFTW_FORWARD);
+        else if (fft_engine == FFT_ENGINE_FFTW)
+            p = plan_cache_get(fft_size, batch, fft_in_ptr->data(), fft_out_ptr->data(), FFTW_FORWARD);
 
         // Timing Startup [0]
-        acc_setup(stage_time.elapsed());
-        timings[0][phasecode_offset] = stage_time.elapsed();
+        acc_setup(stage_time.elapsed()/tile_rows);
+        record_tile_timing(timings, 0, tile_start - range_start, tile_rows, stage_time.elapsed());
         stage_time.restart();
 
-        // Apply Phasecode
-        apply_phasecode(phasecode_offset, sample_data_ref, phasecode, *fft_in_ptr, 0 ,0);
+        // Apply Phasecode (STAGE_PHASECODE output is in twiddled sub-sequence order when pruned,
+        // the DFT engine applies the phasecode as part of the transform)
+        if (fft_engine == FFT_ENGINE_DFT)
+        {
+            if (config.intermediate_stage == STAGE_PHASECODE)
+                *dirty_rows = apply_phasecode(tile_start, tile_rows, sample_data_ref, integrated_layout, phasecode, *fft_in_ptr, *dirty_rows);
+        }
+        else if (fft_engine == FFT_ENGINE_PRUNED)
+            *dirty_rows = pruned_gather(tile_start, tile_rows, sample_data_ref, integrated_layout, phasecode, pruned_twiddles, block, *fft_in_ptr, *dirty_rows);
+        else
+            *dirty_rows = gather(tile_start, tile_rows, sample_data_ref, integrated_layout, phasecode, *fft_in_ptr, *dirty_rows);
 
         // Timing Phasecode [1]
-        acc_copyto(stage_time.elapsed());
-        timings[1][phasecode_offset] = stage_time.elapsed();
+        acc_copyto(stage_time.elapsed()/tile_rows);
+        record_tile_timing(timings, 1, tile_start - range_start, tile_rows, stage_time.elapsed());
         stage_time.restart();
 
-        // Execute FFTW
+        // Execute FFTW (or the DFT bank, STAGE_POSTFFT then only holds the window bins)
         if (!(config.intermediate_stage == STAGE_PHASECODE))
-            fftwf_execute(p);
+        {
+            if (fft_engine == FFT_ENGINE_DFT)
+                apply_dft_bank(tile_start, tile_rows, sample_data_ref, integrated_layout, phasecode, dft_twiddles_re, dft_twiddles_im, doppler_bins, *fft_out_ptr);
+            else
+                fftwf_execute_dft(p, reinterpret_cast<fftwf_complex *>(fft_in_ptr->data()), reinterpret_cast<fftwf_complex *>(fft_out_ptr->data()));
+        }
 
         // Timing FFT [2]
-        acc_fftw(stage_time.elapsed());
-        timings[2][phasecode_offset] = stage_time.elapsed();
+        acc_fftw(stage_time.elapsed()/tile_rows);
+        record_tile_timing(timings, 2, tile_start - range_start, tile_rows, stage_time.elapsed());
         stage_time.restart();
 
         // Execute Peak Finding
         if (!(config.intermediate_stage == STAGE_PHASECODE || config.intermediate_stage == STAGE_POSTFFT))
-            find_peak(phasecode_offset, *fft_out_ptr, decoded_data, 0 ,0);
+            peak(tile_start - range_start, tile_rows, *fft_out_ptr, peak_start, doppler_bins, decoded_data);
 
         // Timing peakfind [3]
-        acc_copyfrom(stage_time.elapsed());
-        timings[3][phasecode_offset] = stage_time.elapsed();
+        acc_copyfrom(stage_time.elapsed()/tile_rows);
+        record_tile_timing(timings, 3, tile_start - range_start, tile_rows, stage_time.elapsed());
         stage_time.restart();
 
-        #pragma omp critical (fftw)
-        {
-            fftwf_destroy_plan(p);
-        }
-
         // Timing Cleanup [4]
-        timings[4][phasecode_offset] = stage_time.elapsed();
+        record_tile_timing(timings, 4, tile_start - range_start, tile_rows, stage_time.elapsed());
 
         // Timing Row [5]
-        timings[5][phasecode_offset] = row_time.elapsed();
-        acc_row(row_time.elapsed());
+        double row_elapsed = row_time.elapsed();
+        record_tile_timing(timings, 5, tile_start - range_start, tile_rows, row_elapsed);
+        for(unsigned int row = 0; row < tile_rows; row++)
+            acc_row(row_elapsed/tile_rows);
+    };
+
+    // Calculate each tile of rows.  With a shared task pool the tiles are its tasks, so
+    // workers that run out of tiles of other files help with this one.
+    MUIR::TaskPool *pool = task_pool();
+    if (pool)
+    {
+        config.threads = pool->size();
+
+        MUIR::TaskGroup tiles;
+        for(unsigned int tile_start = start_row; tile_start < end_row; tile_start += range_tile)
+            pool->submit(tiles, [&decode_tile, tile_start]() { decode_tile(tile_start, MUIR::TaskPool::worker() == 0); });
+        tiles.wait();
     }
+    else
+    {
+        #pragma omp parallel for
+        for(unsigned int tile_start = start_row; tile_start < end_row; tile_start += range_tile)
+        {
+            // Write number of threads in config for first pass
+            if (tile_start == start_row)
+                config.threads = omp_get_num_threads();
 
-    #pragma omp critical (fftw)
-    fftwf_cleanup_threads();
+            decode_tile(tile_start, omp_get_thread_num() == 0);
+        }
+    }
 
     std::cout << "Done!" << std::endl;
     std::cout << "Rows completed: " << count(acc_row) << std::endl;
@@ -273,31 +454,121 @@ int process_data_cpu(int id,
 
     // Fill out config
     //config.threads = 1; this is done earlier in the OpenMP context.
+    config.cpus = core_affinity();
     config.fft_size = fft_size;
     config.decoding_time = main_time.elapsed();
     config.platform = SectionName;
     config.device = std::string("Unknown CPU");
     config.process = ProcessString;
     config.process_version = ProcessVersion;
+    config.fft_engine = fft_engine;
+    config.range_tile = range_tile;
+    if (fft_engine == FFT_ENGINE_PRUNED)
+        config.process_version += " (pruned FFT, block " + std::to_string(block) + ")";
+    if (fft_engine == FFT_ENGINE_DFT)
+        config.process_version += " (Doppler DFT bank)";
+    config.process_version += " (peak " + peak_power_isa() + ")";
+    if (!kernels.name.empty())
+        config.process_version += " (kernels " + kernels.name + ")";
+    if (range_tile > 1)
+        config.process_version += " (range tile " + std::to_string(range_tile) + ")";
+    if (MUIR_NumaPolicy != NUMA_NONE)
+        config.process_version += " (numa " + numa_policy_name(MUIR_NumaPolicy) + ")";
+    if (MUIR_HugePages != HUGE_PAGES_NONE)
+        config.process_version += " (huge pages " + huge_page_policy_name(MUIR_HugePages) + ")";
+    config.doppler_start = doppler_start;
+    config.doppler_bins = doppler_bins;
+    config.range_start = range_start;
+    config.range_bins = range_bins;
     config.phasecode_muting = 0;
-    config.time_integration = 0;
+    config.time_integration = (integration > 1)?integration:0;
 
     return 0;
 }
 
 
-void apply_phasecode(const unsigned int range_offset,
-                const Muir4DArrayF &in_buffer,
-                const std::vector<float>& phasecode,
-                Muir4DArrayF &out_buffer,
-                unsigned int /*colomn_chunk_size*/,
-                unsigned int /*column_num*/)
+// Coherently integrate groups of pulses consecutive columns of each set.  Output frame
+// (set, col) is the mean of input frames (set, col*pulses .. col*pulses+pulses-1), so a
+// steady target keeps its amplitude.  Columns left over at the end of a set are dropped.
+// out_buffer is shaped to out_layout, which may block the range bins differently than in_layout.
+void time_integration(const Muir4DArrayF &in_buffer,
+                      const SampleLayout &in_layout,
+                      unsigned int pulses,
+                      Muir4DArrayF &out_buffer,
+                      const SampleLayout &out_layout)
+{
+    std::size_t rangebins = in_layout.rangebins;
+
+    // Check for error conditions
+    if(pulses == 0 || out_layout.sets != in_layout.sets || out_layout.cols != in_layout.cols / pulses || out_layout.rangebins != rangebins)
+        throw std::logic_error("time_integration(): Dimensions of in and out layouts do not match the pulses integrated!");
+
+    if (out_layout.is_natural())
+        out_buffer.resize(boost::extents[out_layout.sets][out_layout.cols][rangebins][2]);
+    else
+        out_buffer.resize(boost::extents[out_layout.blocks()][out_layout.frames()][out_layout.block][2]);
+
+    const float *in_data = in_buffer.data();
+    float *out_data = out_buffer.data();
+    const float scale = 1.0f / static_cast<float>(pulses);
+    const std::size_t out_frames = out_layout.frames();
+
+    #pragma omp parallel for
+    for(std::size_t frame = 0; frame < out_frames; frame++)
+    {
+        std::size_t first_pulse = (frame / out_layout.cols) * in_layout.cols + (frame % out_layout.cols) * pulses;
+        std::size_t range = 0;
+
+        // Walk segments contiguous in both layouts
+        while (range < rangebins)
+        {
+            std::size_t count = std::min(std::min(rangebins - range,
+                                                  in_layout.block - range % in_layout.block),
+                                         out_layout.block - range % out_layout.block);
+            std::size_t floats = count*2;
+            float *out = out_data + out_layout.offset(frame, range);
+
+            const float *in = in_data + in_layout.offset(first_pulse, range);
+            #pragma omp simd
+            for(std::size_t i = 0; i < floats; i++)
+                out[i] = in[i];
+
+            for(unsigned int pulse = 1; pulse < pulses; pulse++)
+            {
+                in = in_data + in_layout.offset(first_pulse + pulse, range);
+                #pragma omp simd
+                for(std::size_t i = 0; i < floats; i++)
+                    out[i] += in[i];
+            }
+
+            #pragma omp simd
+            for(std::size_t i = 0; i < floats; i++)
+                out[i] *= scale;
+
+            range += count;
+        }
+    }
+}
+
+
+// Copy a tile of consecutive range offsets into the (zero padded) FFT input and apply the
+// phasecode.  Range offset range_offset+t is written to frames [t*sets + set][col], so the
+// output must hold at least tile*sets sets.  Neighbouring offsets read overlapping samples,
+// each input frame is visited once for the whole tile so it stays in cache.
+// Only the first dirty_rows rows of each output frame are assumed to be non-zero,
+// rows past that are left alone.  Returns the number of rows that may now be non-zero.
+std::size_t apply_phasecode(const unsigned int range_offset,
+                            const unsigned int tile,
+                            const Muir4DArrayF &in_buffer,
+                            const SampleLayout &in_layout,
+                            const PhaseCode& phasecode,
+                            Muir4DArrayRefF &out_buffer,
+                            std::size_t dirty_rows)
 {
     // Determine Strides
-    const Muir4DArrayF::size_type *in_dims = in_buffer.shape();
-    Muir4DArrayF::size_type in_sets = in_dims[0];
-    Muir4DArrayF::size_type in_cols = in_dims[1];
-    Muir4DArrayF::size_type in_rangebins = in_dims[2];
+    Muir4DArrayF::size_type in_sets = in_layout.sets;
+    Muir4DArrayF::size_type in_cols = in_layout.cols;
+    Muir4DArrayF::size_type in_rangebins = in_layout.rangebins;
 
     const Muir4DArrayF::size_type *out_dims = out_buffer.shape();
     Muir4DArrayF::size_type out_sets = out_dims[0];
@@ -307,40 +578,235 @@ void apply_phasecode(const unsigned int range_offset,
     size_t phasecode_size = phasecode.size();
 
     // Check for error conditions
-    if(in_sets != out_sets || in_cols != out_cols)
+    if(in_sets * tile > out_sets || in_cols != out_cols)
         throw std::logic_error("apply_phasecode(): Critical dimensions of in and out buffers do not match!");
 
-    if(range_offset >= in_rangebins)
+    if(tile == 0 || range_offset + tile > in_rangebins)
         throw std::logic_error("apply_phasecode(): requested range falls outside of range for input buffer");
 
-    // Zero output buffer
-    std::fill(out_buffer.data(), out_buffer.data() + out_buffer.num_elements(), 0.0f);
+    dirty_rows = std::min(dirty_rows, out_rangebins);
 
-    // Copy data into fftw vector, apply phasecode, and zero out the rest
-    for(Muir4DArrayF::size_type out_row = 0; out_row < out_rangebins; out_row++)
+    // Frames past the tile keep whatever they had
+    std::size_t max_valid_rows = (in_sets * tile < out_sets)?dirty_rows:0;
+
+    MUIR::MuirView<float, 4> out_view(out_buffer);
+
+    for(Muir4DArrayF::size_type set = 0; set < in_sets; set++)
+        for(Muir4DArrayF::size_type col = 0; col < in_cols; col++)
+            for(unsigned int t = 0; t < tile; t++)
+            {
+                // Rows that receive data, the code is truncated at the end of the input
+                std::size_t valid_rows = std::min(std::min(phasecode_size, out_rangebins), in_rangebins - (range_offset + t));
+                max_valid_rows = std::max(max_valid_rows, valid_rows);
+
+                // Copy data into fftw vector and apply phasecode
+                float *out = out_view.row(t*in_sets + set, col, 0);
+                gather_phasecoded(in_buffer.data(), in_layout, set*in_cols + col, range_offset + t, valid_rows, phasecode, out);
+
+                // Zero out what is left over from previous rows, the rest of the padding is already zero
+                if (dirty_rows > valid_rows)
+                    std::fill(out + valid_rows*2, out + dirty_rows*2, 0.0f);
+            }
+
+    return max_valid_rows;
+}
+
+
+// Read count samples of one frame starting at range, with the phasecode applied, into
+// interleaved complex out.  Samples are contiguous within each block of the layout.
+// The code is applied by flipping sign bits, no multiplies.
+static void gather_phasecoded(const float *in_data,
+                              const SampleLayout &in_layout,
+                              std::size_t frame,
+                              std::size_t range,
+                              std::size_t count,
+                              const PhaseCode& phasecode,
+                              float *out)
+{
+    std::size_t row = 0;
+
+    while (row < count)
     {
-        // Check if we are within non-zero output range
-        if (!(out_row > phasecode_size || (range_offset + out_row) > in_rangebins))
-        {
-            float phase_multiplier = phasecode[out_row];
+        std::size_t position = range + row;
+        std::size_t segment = std::min(count - row, in_layout.block - position % in_layout.block);
+        phasecode.apply(row, segment, in_data + in_layout.offset(frame, position), out + row*2);
+
+        row += segment;
+    }
+}
+
 
-            for(Muir4DArrayF::size_type set = 0; set < out_sets; set++)
-                for(Muir4DArrayF::size_type col = 0; col < out_cols; col++)
+// Pruned version of apply_phasecode().  With x[n] the phasecoded input (zero for n >= block)
+// each output frame is filled with the fft_size/block twiddled sequences
+//   y[k1][n] = x[n] * exp(-2*pi*i*n*k1/fft_size),  n < block
+// whose block-point transforms interleave into the full spectrum (see plan_cache_get_pruned()).
+std::size_t apply_phasecode_pruned(const unsigned int range_offset,
+                                   const unsigned int tile,
+                                   const Muir4DArrayF &in_buffer,
+                                   const SampleLayout &in_layout,
+                                   const PhaseCode& phasecode,
+                                   const std::vector<std::complex<float> >& twiddles,
+                                   std::size_t block,
+                                   Muir4DArrayRefF &out_buffer,
+                                   std::size_t dirty_rows)
+{
+    // Determine Strides
+    Muir4DArrayF::size_type in_sets = in_layout.sets;
+    Muir4DArrayF::size_type in_cols = in_layout.cols;
+    Muir4DArrayF::size_type in_rangebins = in_layout.rangebins;
+
+    const Muir4DArrayF::size_type *out_dims = out_buffer.shape();
+    Muir4DArrayF::size_type out_sets = out_dims[0];
+    Muir4DArrayF::size_type out_cols = out_dims[1];
+    Muir4DArrayF::size_type out_rangebins = out_dims[2];
+
+    size_t phasecode_size = phasecode.size();
+
+    // Check for error conditions
+    if(in_sets * tile > out_sets || in_cols != out_cols)
+        throw std::logic_error("apply_phasecode_pruned(): Critical dimensions of in and out buffers do not match!");
+
+    if(tile == 0 || range_offset + tile > in_rangebins)
+        throw std::logic_error("apply_phasecode_pruned(): requested range falls outside of range for input buffer");
+
+    if(block == 0 || out_rangebins % block != 0 || twiddles.size() != out_rangebins)
+        throw std::logic_error("apply_phasecode_pruned(): twiddles don't match the block and output sizes");
+
+    std::size_t sub_sequences = out_rangebins / block;
+    dirty_rows = std::min(dirty_rows, block);
+
+    // Frames past the tile keep whatever they had
+    std::size_t max_valid_rows = (in_sets * tile < out_sets)?dirty_rows:0;
+
+    std::vector<std::complex<float> > coded(std::min(phasecode_size, block));
+    MUIR::MuirView<float, 4> out_view(out_buffer);
+
+    for(Muir4DArrayF::size_type set = 0; set < in_sets; set++)
+        for(Muir4DArrayF::size_type col = 0; col < in_cols; col++)
+            for(unsigned int t = 0; t < tile; t++)
+            {
+                // Rows of each sub-sequence that receive data, the code is truncated at the end of the input
+                std::size_t valid_rows = std::min(std::min(phasecode_size, block), in_rangebins - (range_offset + t));
+                max_valid_rows = std::max(max_valid_rows, valid_rows);
+
+                // Apply phasecode once per frame
+                gather_phasecoded(in_buffer.data(), in_layout, set*in_cols + col, range_offset + t, valid_rows, phasecode,
+                                  reinterpret_cast<float *>(coded.data()));
+
+                // Then twiddle it into each sub-sequence
+                float *out = out_view.row(t*in_sets + set, col, 0);
+                for(std::size_t sub = 0; sub < sub_sequences; sub++)
                 {
-                    out_buffer[set][col][out_row][0] = in_buffer[set][col][out_row+range_offset][0] * phase_multiplier;
-                    out_buffer[set][col][out_row][1] = in_buffer[set][col][out_row+range_offset][1] * phase_multiplier;
+                    const std::complex<float> *twiddle = &twiddles[sub*block];
+                    float *out_sub = out + sub*block*2;
+
+                    for(std::size_t row = 0; row < valid_rows; row++)
+                    {
+                        std::complex<float> value = coded[row] * twiddle[row];
+                        out_sub[row*2]   = value.real();
+                        out_sub[row*2+1] = value.imag();
+                    }
+
+                    // Zero out what is left over from previous rows
+                    if (dirty_rows > valid_rows)
+                        std::fill(out_sub + valid_rows*2, out_sub + dirty_rows*2, 0.0f);
                 }
-        }
-    }
+            }
 
+    return max_valid_rows;
 }
 
 
+// Phasecode a tile of range offsets and compute only the requested Doppler bins with a direct
+// DFT, which for a whole file is the product of the [frames][rows] coded input and the
+// [rows][bins] twiddle matrix.  Bin k of the window is written to row k of each output
+// frame (laid out as in apply_phasecode()), the remaining rows are left alone.  Twiddles
+// are stored [bin][row].
+void apply_dft_bank(const unsigned int range_offset,
+                    const unsigned int tile,
+                    const Muir4DArrayF &in_buffer,
+                    const SampleLayout &in_layout,
+                    const PhaseCode& phasecode,
+                    const std::vector<float>& twiddles_re,
+                    const std::vector<float>& twiddles_im,
+                    std::size_t bins,
+                    Muir4DArrayRefF &out_buffer)
+{
+    // Determine Strides
+    Muir4DArrayF::size_type in_sets = in_layout.sets;
+    Muir4DArrayF::size_type in_cols = in_layout.cols;
+    Muir4DArrayF::size_type in_rangebins = in_layout.rangebins;
+
+    const Muir4DArrayF::size_type *out_dims = out_buffer.shape();
+    Muir4DArrayF::size_type out_sets = out_dims[0];
+    Muir4DArrayF::size_type out_cols = out_dims[1];
+    Muir4DArrayF::size_type out_rangebins = out_dims[2];
+
+    // Check for error conditions
+    if(in_sets * tile > out_sets || in_cols != out_cols)
+        throw std::logic_error("apply_dft_bank(): Critical dimensions of in and out buffers do not match!");
+
+    if(tile == 0 || range_offset + tile > in_rangebins)
+        throw std::logic_error("apply_dft_bank(): requested range falls outside of range for input buffer");
+
+    if(bins == 0 || bins > out_rangebins || twiddles_re.size() % bins != 0 || twiddles_re.size() != twiddles_im.size())
+        throw std::logic_error("apply_dft_bank(): twiddles don't match the number of bins");
+
+    // Twiddle rows cover the phasecode
+    std::size_t rows = twiddles_re.size() / bins;
+    std::size_t code_rows = std::min(rows, phasecode.size());
+
+    std::vector<float> coded(code_rows*2);
+    std::vector<float> coded_re(code_rows);
+    std::vector<float> coded_im(code_rows);
+    MUIR::MuirView<float, 4> out_view(out_buffer);
+
+    for(Muir4DArrayF::size_type set = 0; set < in_sets; set++)
+        for(Muir4DArrayF::size_type col = 0; col < in_cols; col++)
+            for(unsigned int t = 0; t < tile; t++)
+            {
+                // The code is truncated at the end of the input
+                std::size_t valid_rows = std::min(code_rows, in_rangebins - (range_offset + t));
+
+                // Apply phasecode once per frame, then split real/imaginary
+                gather_phasecoded(in_buffer.data(), in_layout, set*in_cols + col, range_offset + t, valid_rows, phasecode, coded.data());
+                for(std::size_t row = 0; row < valid_rows; row++)
+                {
+                    coded_re[row] = coded[row*2];
+                    coded_im[row] = coded[row*2+1];
+                }
+
+                // One dot product per bin, split real/imaginary so the inner loop vectorizes
+                float *out = out_view.row(t*in_sets + set, col, 0);
+                for(std::size_t bin = 0; bin < bins; bin++)
+                {
+                    const float *tw_re = &twiddles_re[bin*rows];
+                    const float *tw_im = &twiddles_im[bin*rows];
+                    float sum_re = 0.0f;
+                    float sum_im = 0.0f;
+
+                    for(std::size_t row = 0; row < valid_rows; row++)
+                    {
+                        sum_re += coded_re[row]*tw_re[row] - coded_im[row]*tw_im[row];
+                        sum_im += coded_re[row]*tw_im[row] + coded_im[row]*tw_re[row];
+                    }
+
+                    out[bin*2]   = sum_re;
+                    out[bin*2+1] = sum_im;
+                }
+            }
+}
+
+
+// Search bins first_bin .. first_bin+bins-1 (wrapping at fft_size) of each spectrum in a tile
+// of range offsets (laid out as in apply_phasecode()) for the peak power.  The peak is
+// normalized by fft_size whatever the number of bins searched.
 void find_peak(const unsigned int range_offset,
-                     const Muir4DArrayF &in_buffer,
-                     Muir3DArrayF &out_buffer,
-                     unsigned int /*colomn_chunk_size*/,
-                     unsigned int /*column_num*/)
+               const unsigned int tile,
+               const Muir4DArrayRefF &in_buffer,
+               std::size_t first_bin,
+               std::size_t bins,
+               Muir3DArrayF &out_buffer)
 {
     // Determine Strides
     const Muir4DArrayF::size_type *in_dims = in_buffer.shape();
@@ -354,36 +820,141 @@ void find_peak(const unsigned int range_offset,
     Muir4DArrayF::size_type out_rangebins = out_dims[2];
 
     // Check for error conditions
-    if(in_sets != out_sets || in_cols != out_cols)
+    if(out_sets * tile > in_sets || in_cols != out_cols)
         throw std::logic_error("find_peak(): Critical dimensions of in and out buffers do not match!");
 
-    if(range_offset >= out_rangebins)
+    if(tile == 0 || range_offset + tile > out_rangebins)
         throw std::logic_error("find_peak(): requested range falls outside of range for output buffer");
 
-    // Loop through each pulse frame (set and col)
-    for(std::size_t set = 0; set < in_sets; set++)
+    if(first_bin >= fft_size || bins > fft_size)
+        throw std::logic_error("find_peak(): Doppler window falls outside of the spectrum");
+
+    std::vector<float> max_power(out_cols);
+    MUIR::MuirView<const float, 4> in_view(in_buffer);
+    MUIR::MuirView<float, 3> out_view(out_buffer);
+
+    // Loop through each set of each range offset, the column spectra of a set are contiguous
+    for(unsigned int t = 0; t < tile; t++)
     {
-        for(std::size_t col = 0; col < in_cols; col++)
+        for(std::size_t set = 0; set < out_sets; set++)
         {
-            float max_power = 0.0f;
+            // Find the max power of every column at once
+            peak_power(in_view.row(t*out_sets + set, 0, 0), out_cols, fft_size*2, fft_size, first_bin, bins, max_power.data());
 
-            // Iterate through the column spectra and find the max value
-            for(std::size_t row = 0; row < fft_size; row++)
-            {
-                float power = powf(in_buffer[set][col][row][0],2) + powf(in_buffer[set][col][row][1],2);
+            // Assign and normalize
+            for(std::size_t col = 0; col < out_cols; col++)
+                out_view(set, col, range_offset + t) = sqrtf(max_power[col])/static_cast<float>(fft_size);
+        }
+    }
 
-                if (power > max_power)
-                {
-                    max_power = power;
-                }
+}
 
-            }
 
-            // Assign and normalize
-            out_buffer[set][col][range_offset] = sqrtf(max_power)/static_cast<float>(fft_size);
 
-        }
+// Resolve the FFT engine for a decode.  block is set to the pruned sub-transform
+// length (the smallest divisor of fft_size that is a power of two and holds the
+// whole phasecode), or fft_size if the full transform is used.
+FFT_Engine select_fft_engine(FFT_Engine requested,
+                             unsigned int fft_size,
+                             std::size_t phasecode_size,
+                             std::size_t doppler_bins,
+                             unsigned int &block)
+{
+    block = fft_size;
+
+    if (requested == FFT_ENGINE_FFTW)
+        return FFT_ENGINE_FFTW;
+
+    // The DFT bank costs ~8 flops per code sample per bin against ~5*N*log2(N) for the FFT
+    bool windowed = (doppler_bins < fft_size);
+    double dft_cost = 8.0 * static_cast<double>(std::min<std::size_t>(phasecode_size, fft_size)) * static_cast<double>(doppler_bins);
+    double fft_cost = 5.0 * static_cast<double>(fft_size) * std::log2(static_cast<double>(fft_size));
+
+    if (requested == FFT_ENGINE_DFT)
+    {
+        if (windowed)
+            return FFT_ENGINE_DFT;
+
+        std::cout << SectionName << ": DFT bank needs a Doppler window, using full FFT." << std::endl;
+        return FFT_ENGINE_FFTW;
+    }
+
+    if (requested == FFT_ENGINE_AUTO && windowed && dft_cost <= fft_cost)
+        return FFT_ENGINE_DFT;
+
+    unsigned int pruned_block = 1;
+    while (pruned_block < phasecode_size && pruned_block < fft_size)
+        pruned_block *= 2;
+
+    bool possible = (pruned_block < fft_size) && (fft_size % pruned_block == 0);
+
+    if (requested == FFT_ENGINE_PRUNED && !possible)
+    {
+        std::cout << SectionName << ": Pruned FFT not possible (N=" << fft_size << ", code length " << phasecode_size
+                  << "), using full FFT." << std::endl;
+        return FFT_ENGINE_FFTW;
     }
 
+    // Automatic selection only prunes when at least 3/4 of the input is padding
+    if (requested == FFT_ENGINE_AUTO && !(possible && pruned_block * 4 <= fft_size))
+        return FFT_ENGINE_FFTW;
+
+    block = pruned_block;
+    return FFT_ENGINE_PRUNED;
+}
+
+
+// Twiddles for apply_phasecode_pruned(), [sub-sequence][row] = exp(-2*pi*i*row*sub/fft_size)
+std::vector<std::complex<float> > make_pruned_twiddles(unsigned int fft_size, unsigned int block)
+{
+    std::vector<std::complex<float> > twiddles(fft_size);
+    unsigned int sub_sequences = fft_size / block;
+
+    for(unsigned int sub = 0; sub < sub_sequences; sub++)
+        for(unsigned int row = 0; row < block; row++)
+        {
+            // Reduce the exponent first so large products don't lose precision
+            double angle = -2.0 * M_PI * static_cast<double>((static_cast<unsigned long>(row) * sub) % fft_size) / static_cast<double>(fft_size);
+            twiddles[sub*block + row] = std::complex<float>(static_cast<float>(cos(angle)), static_cast<float>(sin(angle)));
+        }
+
+    return twiddles;
+}
+
+
+// Twiddles for apply_dft_bank(), [bin][row] = exp(-2*pi*i*row*(first_bin+bin)/fft_size)
+void make_dft_twiddles(unsigned int fft_size,
+                       unsigned int first_bin,
+                       unsigned int bins,
+                       std::size_t rows,
+                       std::vector<float> &twiddles_re,
+                       std::vector<float> &twiddles_im)
+{
+    twiddles_re.resize(bins * rows);
+    twiddles_im.resize(bins * rows);
+
+    for(unsigned int bin = 0; bin < bins; bin++)
+    {
+        unsigned long k = (first_bin + bin) % fft_size;
+
+        for(std::size_t row = 0; row < rows; row++)
+        {
+            // Reduce the exponent first so large products don't lose precision
+            double angle = -2.0 * M_PI * static_cast<double>((row * k) % fft_size) / static_cast<double>(fft_size);
+            twiddles_re[bin*rows + row] = static_cast<float>(cos(angle));
+            twiddles_im[bin*rows + row] = static_cast<float>(sin(angle));
+        }
+    }
 }
 
+
+// Spread the time taken by a tile evenly over its rows
+void record_tile_timing(Muir2DArrayD& timings,
+                        std::size_t stage,
+                        unsigned int tile_start,
+                        unsigned int tile_rows,
+                        double seconds)
+{
+    for(unsigned int row = 0; row < tile_rows; row++)
+        timings[stage][tile_start + row] = seconds / tile_rows;
+}
@@ -16,9 +16,11 @@
 #include "muir-process.h"
 
 int process_init_cpu(void);
+void process_cleanup_cpu(void);
 int process_data_cpu(int id,
                      const Muir4DArrayF& sample_data,
-                     const std::vector<float>& phasecode,
+                     const SampleLayout& sample_layout,
+                     const PhaseCode& phasecode,
                      Muir3DArrayF& decoded_data,
                      DecodingConfig &config,
                      std::vector<std::string>& timing_strings,
@@ -26,4 +28,12 @@ int process_data_cpu(int id,
                      Muir4DArrayF& complex_intermediate
                     );
 
+// Average groups of pulses consecutive columns of each set, out_buffer is shaped to out_layout
+// (see process_time_integration_layout()).
+void time_integration(const Muir4DArrayF &in_buffer,
+                      const SampleLayout &in_layout,
+                      unsigned int pulses,
+                      Muir4DArrayF &out_buffer,
+                      const SampleLayout &out_layout);
+
 #endif //MUIR_PROCESS_CPU_H
@@ -3,6 +3,11 @@
 //#include "muir-process-cuda.h"
 #include "muir-process-cpu.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
 int opencl_initialized = 0;
 int cuda_initialized = 0;
 int cpu_initialized = 1;
@@ -59,7 +64,8 @@ int process_init(unsigned int method, void* opengl_ctx)
 
 int process_data(int id,
                  const Muir4DArrayF& sample_data,
-                 const std::vector<float>& phasecode,
+                 const SampleLayout& sample_layout,
+                 const PhaseCode& phasecode,
                  Muir3DArrayF& decoded_data,
                  DecodingConfig &config,
                  std::vector<std::string>& timing_strings,
@@ -74,6 +80,7 @@ int process_data(int id,
         // Use OpenCL Decoding
         err = process_data_cl(id,
                               sample_data,
+                              sample_layout,
                               phasecode,
                               decoded_data,
                               config,
@@ -89,6 +96,7 @@ int process_data(int id,
         // Use CPU Decoding
         err = process_data_cpu(id - (opencl_initialized + cuda_initialized),
                                sample_data,
+                               sample_layout,
                                phasecode,
                                decoded_data,
                                config,
@@ -105,3 +113,133 @@ int process_get_num_devices()
     return num_devices;
 }
 
+// True if device id decodes straight out of host memory (the CPU), false if the
+// samples are copied to it.
+bool process_device_is_host(int id)
+{
+    return (id - (opencl_initialized + cuda_initialized)) >= 0;
+}
+
+
+// Convert the Doppler window in Hz (config.doppler_low_hz to doppler_high_hz) into the
+// FFT bins covering it.  sample_period is the time between range samples in seconds.
+void process_doppler_window_hz(DecodingConfig &config, double sample_period)
+{
+    if (!(config.doppler_low_hz < config.doppler_high_hz))
+        return;
+
+    if (sample_period <= 0.0 || config.fft_size == 0)
+        throw std::invalid_argument("process_doppler_window_hz(): sample period and FFT size must be positive");
+
+    double bin_width = 1.0 / (static_cast<double>(config.fft_size) * sample_period);
+    long low_bin  = static_cast<long>(std::floor(config.doppler_low_hz / bin_width));
+    long high_bin = static_cast<long>(std::ceil(config.doppler_high_hz / bin_width));
+    long fft_size = config.fft_size;
+
+    // Negative frequencies live at the top of the spectrum
+    config.doppler_start = static_cast<unsigned int>(((low_bin % fft_size) + fft_size) % fft_size);
+    config.doppler_bins  = static_cast<unsigned int>(std::min(high_bin - low_bin + 1, fft_size));
+}
+
+
+// Range gates to decode out of rangebins gates of sample data: the config's window clipped
+// to the data, or everything when it has none.  Intermediate stages decode single rows
+// by index and ignore the window.
+void process_range_window(const DecodingConfig &config, std::size_t rangebins, unsigned int &range_start, unsigned int &range_bins)
+{
+    range_start = 0;
+    range_bins = static_cast<unsigned int>(rangebins);
+
+    if (!(config.intermediate_stage == STAGE_ALL))
+        return;
+
+    if (config.range_start >= rangebins)
+        throw std::invalid_argument("process_range_window(): first range gate " + std::to_string(config.range_start) +
+                                    " is past the " + std::to_string(rangebins) + " gates of sample data");
+
+    range_start = config.range_start;
+    range_bins -= range_start;
+    if (config.range_bins != 0)
+        range_bins = std::min(range_bins, config.range_bins);
+}
+
+
+// Convert the range window in km (config.range_low_km to range_high_km) into the gates
+// covering it.  range[0][i] is the range of gate first_gate + i in meters.
+void process_range_window_km(DecodingConfig &config, const Muir2DArrayF &range, unsigned int first_gate)
+{
+    if (!(config.range_low_km < config.range_high_km))
+        return;
+
+    const float *meters = range.data();
+    std::size_t gates = range.shape()[1];
+    std::size_t first = gates;
+    std::size_t last = 0;
+
+    for (std::size_t i = 0; i < gates; i++)
+    {
+        double km = meters[i] / 1000.0;
+        if (km >= config.range_low_km && km <= config.range_high_km)
+        {
+            first = std::min(first, i);
+            last = i;
+        }
+    }
+
+    if (first == gates)
+        throw std::invalid_argument("process_range_window_km(): no range gates between " + std::to_string(config.range_low_km) +
+                                    " and " + std::to_string(config.range_high_km) + " km");
+
+    config.range_start = first_gate + static_cast<unsigned int>(first);
+    config.range_bins  = static_cast<unsigned int>(last - first + 1);
+}
+
+
+// Layout of the data left after integrating groups of pulses consecutive columns of each
+// set, with the same range blocking.  Columns left over at the end of a set are dropped.
+SampleLayout process_time_integration_layout(const SampleLayout &layout, unsigned int pulses)
+{
+    if (pulses == 0 || pulses > layout.cols)
+        throw std::invalid_argument("process_time_integration_layout(): can't integrate " + std::to_string(pulses) +
+                                    " pulses of " + std::to_string(layout.cols) + " per set");
+
+    return SampleLayout(layout.sets, layout.cols / pulses, layout.rangebins, layout.block);
+}
+
+
+FFT_Engine fft_engine_from_string(const std::string &name)
+{
+    if (name == "auto")
+        return FFT_ENGINE_AUTO;
+    if (name == "fftw")
+        return FFT_ENGINE_FFTW;
+    if (name == "pruned")
+        return FFT_ENGINE_PRUNED;
+    if (name == "dft")
+        return FFT_ENGINE_DFT;
+
+    throw std::invalid_argument("Unknown FFT engine: " + name + " (expecting auto, fftw, pruned or dft)");
+}
+
+
+std::string fft_engine_name(FFT_Engine engine)
+{
+    switch (engine)
+    {
+        case FFT_ENGINE_FFTW:
+            return "fftw";
+        case FFT_ENGINE_PRUNED:
+            return "pruned";
+        case FFT_ENGINE_DFT:
+            return "dft";
+        default:
+            return "auto";
+    }
+}
+
+
+void process_cleanup()
+{
+    if (cpu_initialized)
+        process_cleanup_cpu();
+}
@@ -13,6 +13,8 @@
 //
 
 #include "muir-types.h"
+#include "muir-layout.h"
+#include "muir-phasecode.h"
 
 #include <string>
 
@@ -29,13 +31,22 @@ enum Decoding_Stage
     STAGE_POWER
 };
 
+enum FFT_Engine
+{
+    FFT_ENGINE_AUTO,    // Pruned when the phasecode is much shorter than the FFT
+    FFT_ENGINE_FFTW,    // Full length FFTW transform of the zero padded input
+    FFT_ENGINE_PRUNED,  // Input-pruned transform that skips the zero padding (CPU only)
+    FFT_ENGINE_DFT      // Direct DFT of only the Doppler window bins (CPU only)
+};
+
 class DecodingConfig
 {
   public:
     unsigned int fft_size;
     unsigned int phasecode_muting;
-    unsigned int time_integration;
+    unsigned int time_integration; // Pulses coherently integrated before decoding, 0 or 1 for none
     unsigned int threads;
+    std::string  cpus;             // CPUs the decoding threads could run on, Ex: "0-7"
     std::string  platform;
     std::string  device;
     std::string  process;
@@ -43,19 +54,46 @@ class DecodingConfig
     double decoding_time;
     Decoding_Stage intermediate_stage;
     unsigned int intermediate_row;
+    FFT_Engine   fft_engine;
+    unsigned int doppler_start;    // First Doppler bin searched for the peak
+    unsigned int doppler_bins;     // Number of bins searched (wrapping past fft_size), 0 for all
+    double doppler_low_hz;         // Doppler window in Hz, used instead of the bins when low < high
+    double doppler_high_hz;
+    unsigned int range_tile;       // Range offsets decoded together per batched FFT (CPU only)
+    unsigned int range_start;      // First range gate decoded
+    unsigned int range_bins;       // Number of range gates decoded, 0 for the rest of the samples
+    double range_low_km;           // Range window in km, used instead of the gates when low < high
+    double range_high_km;
+    double time_start;             // Only load sets overlapping this window of RADAC time
+    double time_end;               // (microseconds since the epoch), used when start < end
+    bool schedule_rows;            // Decode blocks of rows on every device at once (muir-schedule)
 
     DecodingConfig(void) :
     fft_size(1024),
     phasecode_muting(0),
     time_integration(0),
     threads(0),
+    cpus(""),
     platform(""),
     device(""),
     process(""),
     process_version(""),
     decoding_time(0.0),
     intermediate_stage(STAGE_ALL),
-    intermediate_row(0)
+    intermediate_row(0),
+    fft_engine(FFT_ENGINE_AUTO),
+    doppler_start(0),
+    doppler_bins(0),
+    doppler_low_hz(0.0),
+    doppler_high_hz(0.0),
+    range_tile(1),
+    range_start(0),
+    range_bins(0),
+    range_low_km(0.0),
+    range_high_km(0.0),
+    time_start(0.0),
+    time_end(0.0),
+    schedule_rows(false)
     {}
 };
 
@@ -63,7 +101,8 @@ class DecodingConfig
 int process_init(unsigned int method, void* opengl_ctx = NULL);
 int process_data(int id,
                  const Muir4DArrayF& sample_data,
-                 const std::vector<float>& phasecode,
+                 const SampleLayout& sample_layout,
+                 const PhaseCode& phasecode,
                  Muir3DArrayF& decoded_data,
                  DecodingConfig &config,
                  std::vector<std::string>& timing_strings,
@@ -71,5 +110,15 @@ int process_data(int id,
                  Muir4DArrayF& complex_intermediate
                 );
 int process_get_num_devices();
+bool process_device_is_host(int id);
+void process_doppler_window_hz(DecodingConfig &config, double sample_period);
+void process_range_window(const DecodingConfig &config, std::size_t rangebins, unsigned int &range_start, unsigned int &range_bins);
+void process_range_window_km(DecodingConfig &config, const Muir2DArrayF &range, unsigned int first_gate = 0);
+SampleLayout process_time_integration_layout(const SampleLayout &layout, unsigned int pulses);
+void process_cleanup(void);
+
+// FFT engine by name: auto, fftw, pruned or dft.  Throws std::invalid_argument.
+FFT_Engine fft_engine_from_string(const std::string &name);
+std::string fft_engine_name(FFT_Engine engine);
 
 #endif //MUIR_PROCESS_H
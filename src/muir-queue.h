@@ -0,0 +1,88 @@
+#ifndef MUIR_QUEUE_H
+#define MUIR_QUEUE_H
+//
+// C++ Interface: muir-queue
+//
+// Description: Bounded blocking queue joining the stages of a processing pipeline.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace MUIR
+{
+
+// Producers block while capacity items are queued, so a fast stage can only run
+// that far ahead of a slow one.  Any number of threads may push and pop.
+template<typename T>
+class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(std::size_t capacity)
+    : _capacity(std::max<std::size_t>(capacity, 1)),
+      _closed(false)
+    {}
+
+    // Blocks while the queue is full.  Returns false, without queueing item, once closed.
+    bool push(const T &item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this]{ return _closed || _items.size() < _capacity; });
+
+        if (_closed)
+            return false;
+
+        _items.push_back(item);
+        _not_empty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty.  Returns false once it is closed and drained.
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [this]{ return _closed || !_items.empty(); });
+
+        if (_items.empty())
+            return false;
+
+        item = _items.front();
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    // No more items will be pushed, wakes everyone waiting.
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _not_empty.notify_all();
+        _not_full.notify_all();
+    }
+
+  private:
+    std::size_t             _capacity;
+    bool                    _closed;
+    std::deque<T>           _items;
+    std::mutex              _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+
+    // No copying
+    BoundedQueue(const BoundedQueue &in);
+    BoundedQueue& operator= (const BoundedQueue &right);
+};
+
+} // Namespace MUIR
+
+#endif // MUIR_QUEUE_H
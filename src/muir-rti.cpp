@@ -6,7 +6,10 @@
 #include "muir-utility.h"
 #include "muir-plot.h"
 #include "muir-process.h"
+#include "muir-global.h"
+#include "muir-fftw.h"
 #include "muir-config.h"
+#include "muir-plan.h"
 
 #include <cstdio>
 #include <iostream>
@@ -34,6 +37,8 @@ struct Flags
     bool option_decode_plot;
     bool option_range;
     BST_PT::time_period range;
+    ShardSpec shard;
+    std::string shard_manifest;
 
     Flags()
     :option_plot(false),
@@ -50,6 +55,7 @@ void print_help (void);
 void process_expfiles(std::vector<fs::path> files, const Flags& flags);  // No reference, want copies
 void process_decfiles(std::vector<fs::path> files, const Flags& flags);  // No reference, want copies
 void cull_files_range(std::vector<fs::path> &files, const Flags& flags);
+void shard_files(std::vector<fs::path> &files, const Flags& flags);
 
 int main (const int argc, const char * argv[])
 {
@@ -133,6 +139,46 @@ int main (const int argc, const char * argv[])
 
            continue;
        }
+       if (!strcmp(argv[argi],"--shard"))
+       {
+           argi++;
+           try
+           {
+               flags.shard = shard_from_string(argv[argi]);
+           }
+           catch(std::invalid_argument &e)
+           {
+               std::cout << "ERROR! " << e.what() << std::endl;
+               return 1;
+           }
+           continue;
+       }
+       if (!strcmp(argv[argi],"--shard-manifest"))
+       {
+           argi++;
+           flags.shard_manifest = argv[argi];
+           continue;
+       }
+       if (!strcmp(argv[argi],"--fftw-wisdom"))
+       {
+           argi++;
+           MUIR_FFTWWisdomFile = argv[argi];
+           continue;
+       }
+       if (!strcmp(argv[argi],"--fftw-planner"))
+       {
+           argi++;
+           try
+           {
+               MUIR_FFTWPlannerFlags = planner_flags_from_string(argv[argi]);
+           }
+           catch(std::invalid_argument &e)
+           {
+               std::cout << "ERROR! " << e.what() << std::endl;
+               return 1;
+           }
+           continue;
+       }
        if (!strcmp(argv[argi],"--help") || !strcmp(argv[argi],"-h"))
        {
            print_help();
@@ -183,6 +229,8 @@ void process_expfiles(std::vector<fs::path> files, const Flags& flags)
         cull_files_range(files, flags);
     }
 
+    shard_files(files, flags);
+
     for (int i = 0; i < static_cast<int>(files.size()); i++)
     {
         std::string expfile =  files[i].string();
@@ -219,6 +267,9 @@ void process_expfiles(std::vector<fs::path> files, const Flags& flags)
             save_fftw_2dplot(data, plotfile);
         }
     }
+
+    // Release decoding context
+    process_cleanup();
 }
 
 
@@ -229,6 +280,8 @@ void process_decfiles(std::vector<fs::path> files, const Flags& flags)
         cull_files_range(files, flags);
     }
 
+    shard_files(files, flags);
+
     for (int i = 0; i < static_cast<int>(files.size()); i++)
     {
         std::string decfile =  files[i].string();
@@ -277,13 +330,41 @@ void cull_files_range(std::vector<fs::path> &files, const Flags& flags)
 }
 
 
+void shard_files(std::vector<fs::path> &files, const Flags& flags)
+{
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; i < files.size(); i++)
+        paths.push_back(files[i].string());
+
+    // Estimated with the default decoding, the same in every process
+    try
+    {
+        paths = shard_paths(paths, DecodingConfig(), flags.shard, flags.shard_manifest);
+    }
+    catch(std::runtime_error &e)
+    {
+        // Not knowing the shard, process none rather than all
+        std::cout << "ERROR! " << e.what() << std::endl;
+        paths.clear();
+    }
+
+    files.assign(paths.begin(), paths.end());
+}
+
+
 void print_help ()
 {
     std::cout << "usage: readdata [--range yyyymmddThhmmss yyyymmddThhmmss] [--plot] " << std::endl;
+    std::cout << "                [--shard i/N [--shard-manifest file]]" << std::endl;
     std::cout << "                [--decode-load | --decode [--decode-plot]] hdf5files " << std::endl;
     std::cout << "  --plot        : Generate a PNG file from data." << std::endl;
     std::cout << "  --decode      : Decode data and save to a HDF5 file." << std::endl;
     std::cout << "  --decode-load : Load decoded data from HDF5 file." << std::endl;
     std::cout << "  --decode-plot : Generate a PNG file from decoded data." << std::endl;
     std::cout << "  --range       : Only process files that fall within a specified ISO date range in GMT." << std::endl;
+    std::cout << "  --shard       : Process only shard i of N (Ex: 0/4 .. 3/4), for N processes given the same files." << std::endl;
+    std::cout << "                  Files are shared out by their size, the same way in every process." << std::endl;
+    std::cout << "  --shard-manifest: Write every file's shard and cost to the specified file." << std::endl;
+    std::cout << "  --fftw-wisdom : Load FFTW wisdom from, and save new wisdom to, the specified file." << std::endl;
+    std::cout << "  --fftw-planner: FFTW planner rigor: estimate, measure (default), patient or exhaustive." << std::endl;
 }
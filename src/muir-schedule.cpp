@@ -0,0 +1,461 @@
+//
+// C++ Implementation: muir-schedule
+//
+// Description: Decode one file on every processing device at once, in blocks of
+//              range rows handed out by a work-stealing scheduler.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-schedule.h"
+#include "muir-process-cpu.h"
+#include "muir-global.h"
+#include "muir-timer.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include <omp.h>
+
+/// Constants
+static const std::string SectionName("Schedule");
+
+// Blocks are sized to take about this long on their device, short enough that
+// stealing evens out the tail and long enough to hide the per-call setup.
+static const double BlockSeconds = 0.25;
+
+// Smallest block sent to a device that gets its samples copied to it
+static const unsigned int CopiedMinRows = 64;
+
+/// Measured throughput
+// Rows per second of each device, carried over from one file to the next
+static std::map<int, double> device_rows_per_second;
+static std::mutex device_rate_mutex;
+
+// State shared by the device threads decoding one file
+struct ScheduledDecode
+{
+    const Muir4DArrayF *samples;
+    const SampleLayout *layout;
+    const PhaseCode    *phasecode;
+    DecodingConfig      config;       // Starting config for each block
+    unsigned int        range_start;  // First row of the window, decoded_data row 0
+    RowScheduler       *scheduler;
+
+    Muir3DArrayF             *decoded_data;
+    Muir2DArrayD             *timings;
+    std::vector<std::string> *timing_strings;
+    std::mutex                merge_mutex;
+};
+
+// What one device did
+struct DeviceResult
+{
+    int            err;
+    std::size_t    rows;
+    std::size_t    blocks;
+    double         rows_per_second;
+    DecodingConfig config;            // From the last block decoded
+    std::exception_ptr error;
+
+    DeviceResult() : err(0), rows(0), blocks(0), rows_per_second(0), config(), error() {}
+};
+
+static void decode_device(int device, std::size_t worker, ScheduledDecode *decode, DeviceResult *result);
+static void copy_sample_rows(const Muir4DArrayF &in,
+                             const SampleLayout &layout,
+                             std::size_t first,
+                             std::size_t count,
+                             Muir4DArrayF &out);
+static void append_unique(std::string &list, const std::string &item);
+
+
+RowScheduler::RowScheduler(unsigned int first_row, unsigned int rows, const std::vector<double> &weights)
+: _spans(weights.size()),
+  _steals(0),
+  _mutex()
+{
+    if (weights.empty())
+        throw std::invalid_argument("RowScheduler::RowScheduler(): Need at least one worker");
+
+    // Without any usable weights split evenly
+    std::vector<double> shares(weights);
+    double total = std::accumulate(shares.begin(), shares.end(), 0.0);
+    if (!(total > 0))
+    {
+        std::fill(shares.begin(), shares.end(), 1.0);
+        total = static_cast<double>(shares.size());
+    }
+
+    unsigned int begin = first_row;
+    double cumulative = 0;
+    for (std::size_t i = 0; i < shares.size(); i++)
+    {
+        cumulative += std::max(shares[i], 0.0);
+
+        unsigned int end = first_row + rows;
+        if (i + 1 < shares.size())
+            end = std::min(end, first_row + static_cast<unsigned int>(rows * (cumulative / total)));
+
+        _spans[i].begin = begin;
+        _spans[i].end = std::max(begin, end);
+        begin = _spans[i].end;
+    }
+}
+
+
+bool RowScheduler::next(std::size_t worker, unsigned int max_rows, unsigned int &first, unsigned int &count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Span &own = _spans.at(worker);
+
+    if (own.begin == own.end)
+    {
+        // Steal the back half of the largest span left, its owner keeps the front
+        std::size_t victim = worker;
+        unsigned int largest = 0;
+        for (std::size_t i = 0; i < _spans.size(); i++)
+        {
+            if (_spans[i].end - _spans[i].begin > largest)
+            {
+                victim = i;
+                largest = _spans[i].end - _spans[i].begin;
+            }
+        }
+
+        if (largest == 0)
+            return false;
+
+        unsigned int stolen = (largest + 1) / 2;
+        own.end = _spans[victim].end;
+        own.begin = own.end - stolen;
+        _spans[victim].end = own.begin;
+        _steals++;
+    }
+
+    first = own.begin;
+    count = std::min(std::max(max_rows, 1u), own.end - own.begin);
+    own.begin += count;
+
+    return true;
+}
+
+
+int process_data_scheduled(const Muir4DArrayF& sample_data,
+                           const SampleLayout& sample_layout,
+                           const PhaseCode& phasecode,
+                           Muir3DArrayF& decoded_data,
+                           DecodingConfig &config,
+                           std::vector<std::string>& timing_strings,
+                           Muir2DArrayD& timings,
+                           Muir4DArrayF& complex_intermediate
+                          )
+{
+    int devices = process_get_num_devices();
+
+    // Nothing to share
+    if (devices < 2 || !(config.intermediate_stage == STAGE_ALL))
+        return process_data(0, sample_data, sample_layout, phasecode, decoded_data, config, timing_strings, timings, complex_intermediate);
+
+    MUIR::Timer main_time;
+
+    /// Time Integration
+    // Done once up front, the blocks then decode the integrated samples
+    unsigned int integration = std::max(config.time_integration, 1u);
+    Muir4DArrayF integrated_data;
+    SampleLayout integrated_layout = process_time_integration_layout(sample_layout, integration);
+    if (integration > 1)
+        time_integration(sample_data, sample_layout, integration, integrated_data, integrated_layout);
+
+    /// Configure Range Window
+    unsigned int range_start = 0;
+    unsigned int range_bins = integrated_layout.rangebins;
+    process_range_window(config, integrated_layout.rangebins, range_start, range_bins);
+
+    /// Initialize outputs
+    decoded_data.resize(boost::extents[integrated_layout.sets][integrated_layout.cols][range_bins]);
+    timing_strings.clear();
+    timings.resize(boost::extents[0][0]);
+
+    /// Split the window by each device's throughput so far
+    std::vector<double> weights(devices, 0.0);
+    {
+        std::lock_guard<std::mutex> lock(device_rate_mutex);
+
+        double known = 0;
+        int known_devices = 0;
+        for (int device = 0; device < devices; device++)
+        {
+            std::map<int, double>::const_iterator iter = device_rows_per_second.find(device);
+            if (iter != device_rows_per_second.end())
+            {
+                weights[device] = iter->second;
+                known += iter->second;
+                known_devices++;
+            }
+        }
+
+        // Devices not measured yet are assumed to be average
+        for (int device = 0; device < devices; device++)
+            if (weights[device] == 0.0)
+                weights[device] = known_devices ? known / known_devices : 1.0;
+    }
+
+    RowScheduler scheduler(range_start, range_bins, weights);
+
+    ScheduledDecode decode;
+    decode.samples = (integration > 1) ? &integrated_data : &sample_data;
+    decode.layout = &integrated_layout;
+    decode.phasecode = &phasecode;
+    decode.config = config;
+    decode.config.time_integration = 0;
+    decode.config.range_low_km = 0.0;
+    decode.config.range_high_km = 0.0;
+    decode.range_start = range_start;
+    decode.scheduler = &scheduler;
+    decode.decoded_data = &decoded_data;
+    decode.timings = &timings;
+    decode.timing_strings = &timing_strings;
+
+    /// Decode on every device at once
+    std::vector<DeviceResult> results(devices);
+    std::vector<std::thread> threads;
+    for (int device = 1; device < devices; device++)
+        threads.push_back(std::thread(decode_device, device, device, &decode, &results[device]));
+
+    decode_device(0, 0, &decode, &results[0]);
+
+    for (std::size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    /// Collect results
+    int err = 0;
+    bool first = true;
+    for (int device = 0; device < devices; device++)
+    {
+        const DeviceResult &result = results[device];
+
+        if (result.error)
+            std::rethrow_exception(result.error);
+        if (result.err)
+            err = result.err;
+
+        std::cout << SectionName << ": Device[" << device << "] " << result.rows << " rows in " << result.blocks << " blocks, "
+                  << static_cast<unsigned long>(result.rows_per_second) << " rows/s" << std::endl;
+
+        if (result.rows == 0)
+            continue;
+
+        // The config of every device that took part, process details joined with " + "
+        if (first)
+        {
+            config = result.config;
+            config.platform = config.device = config.process = config.process_version = "";
+            config.threads = 0;
+            first = false;
+        }
+
+        append_unique(config.platform, result.config.platform);
+        append_unique(config.device, result.config.device);
+        append_unique(config.process, result.config.process);
+        append_unique(config.process_version, result.config.process_version);
+        config.threads += result.config.threads;
+    }
+
+    if (MUIR_Verbose)
+        std::cout << SectionName << ": " << range_bins << " rows on " << devices << " devices, "
+                  << scheduler.steals() << " steals" << std::endl;
+
+    config.decoding_time = main_time.elapsed();
+    config.range_start = range_start;
+    config.range_bins = range_bins;
+    config.time_integration = (integration > 1)?integration:0;
+
+    return err;
+}
+
+
+// Take blocks from the scheduler and decode them on device until there are none left
+static void decode_device(int device, std::size_t worker, ScheduledDecode *decode, DeviceResult *result)
+{
+    try
+    {
+        const SampleLayout &layout = *decode->layout;
+
+        // Devices decoding straight out of host memory read the samples in place, the
+        // others get a copy of just the rows their block reads
+        bool in_place = process_device_is_host(device);
+        unsigned int range_tile = std::max(decode->config.range_tile, 1u);
+        unsigned int min_rows = in_place ? std::max(omp_get_max_threads(), 1) * range_tile : CopiedMinRows;
+
+        double rate = 0;
+        {
+            std::lock_guard<std::mutex> lock(device_rate_mutex);
+            std::map<int, double>::const_iterator iter = device_rows_per_second.find(device);
+            if (iter != device_rows_per_second.end())
+                rate = iter->second;
+        }
+
+        Muir4DArrayF copied_samples;
+        Muir3DArrayF block_decoded;
+        Muir2DArrayD block_timings;
+        std::vector<std::string> block_strings;
+        Muir4DArrayF complex_intermediate;
+
+        unsigned int first, count;
+        while (true)
+        {
+            unsigned int max_rows = std::max(min_rows, static_cast<unsigned int>(rate * BlockSeconds));
+            if (!decode->scheduler->next(worker, max_rows, first, count))
+                break;
+
+            MUIR::Timer block_time;
+
+            DecodingConfig block_config = decode->config;
+            block_config.range_bins = count;
+
+            if (in_place)
+            {
+                block_config.range_start = first;
+                result->err = process_data(device, *decode->samples, layout, *decode->phasecode,
+                                           block_decoded, block_config, block_strings, block_timings, complex_intermediate);
+            }
+            else
+            {
+                // Range gate g reads samples g .. g+phasecode-1
+                std::size_t samples = std::min<std::size_t>(count + std::max<std::size_t>(decode->phasecode->size(), 1) - 1,
+                                                            layout.rangebins - first);
+                copy_sample_rows(*decode->samples, layout, first, samples, copied_samples);
+
+                block_config.range_start = 0;
+                result->err = process_data(device, copied_samples, SampleLayout(copied_samples), *decode->phasecode,
+                                           block_decoded, block_config, block_strings, block_timings, complex_intermediate);
+            }
+
+            if (result->err)
+                break;
+
+            /// Merge into the file's output, blocks never overlap
+            Muir3DArrayF &decoded_data = *decode->decoded_data;
+            const Muir3DArrayF::size_type *dims = block_decoded.shape();
+            std::size_t row = first - decode->range_start;
+            for (std::size_t set = 0; set < dims[0]; set++)
+                for (std::size_t col = 0; col < dims[1]; col++)
+                    std::copy(&block_decoded[set][col][0], &block_decoded[set][col][0] + dims[2], &decoded_data[set][col][row]);
+
+            {
+                // Backends name their stages differently, keep the columns that match the
+                // first block merged and note which device decoded each row
+                std::lock_guard<std::mutex> lock(decode->merge_mutex);
+
+                std::vector<std::string> &timing_strings = *decode->timing_strings;
+                Muir2DArrayD &timings = *decode->timings;
+                if (timing_strings.empty())
+                {
+                    timing_strings = block_strings;
+                    timing_strings.push_back("Device");
+                    timings.resize(boost::extents[timing_strings.size()][decoded_data.shape()[2]]);
+                }
+
+                for (std::size_t stage = 0; stage < block_strings.size(); stage++)
+                {
+                    std::vector<std::string>::const_iterator iter = std::find(timing_strings.begin(), timing_strings.end(), block_strings[stage]);
+                    if (iter == timing_strings.end())
+                        continue;
+
+                    std::size_t column = iter - timing_strings.begin();
+                    for (std::size_t i = 0; i < count; i++)
+                        timings[column][row + i] = block_timings[stage][i];
+                }
+
+                for (std::size_t i = 0; i < count; i++)
+                    timings[timing_strings.size() - 1][row + i] = device;
+            }
+
+            /// Adapt the block size to this device
+            double seconds = block_time.elapsed();
+            if (seconds > 0)
+            {
+                double block_rate = count / seconds;
+                rate = (rate > 0) ? 0.5 * rate + 0.5 * block_rate : block_rate;
+            }
+
+            result->rows += count;
+            result->blocks++;
+            result->config = block_config;
+        }
+
+        result->rows_per_second = rate;
+
+        if (rate > 0)
+        {
+            std::lock_guard<std::mutex> lock(device_rate_mutex);
+            device_rows_per_second[device] = rate;
+        }
+    }
+    catch (...)
+    {
+        result->error = std::current_exception();
+    }
+}
+
+
+// Copy samples first .. first+count-1 of every frame into natural [set][col][range][2] order
+static void copy_sample_rows(const Muir4DArrayF &in,
+                             const SampleLayout &layout,
+                             std::size_t first,
+                             std::size_t count,
+                             Muir4DArrayF &out)
+{
+    if (first + count > layout.rangebins)
+        throw std::logic_error("copy_sample_rows(): Rows fall outside of the sample data");
+
+    out.resize(boost::extents[layout.sets][layout.cols][count][2]);
+
+    const float *in_data = in.data();
+    float *out_data = out.data();
+    const std::size_t frames = layout.frames();
+
+    #pragma omp parallel for
+    for (std::size_t frame = 0; frame < frames; frame++)
+    {
+        float *out_frame = out_data + frame * count * 2;
+        for (std::size_t range = 0; range < count; range++)
+        {
+            const float *sample = in_data + layout.offset(frame, first + range);
+            out_frame[range*2]   = sample[0];
+            out_frame[range*2+1] = sample[1];
+        }
+    }
+}
+
+
+static void append_unique(std::string &list, const std::string &item)
+{
+    if (item.empty())
+        return;
+
+    // Already listed?
+    std::size_t begin = 0;
+    while (!list.empty() && begin <= list.size())
+    {
+        std::size_t end = std::min(list.find(" + ", begin), list.size());
+        if (list.compare(begin, end - begin, item) == 0)
+            return;
+        begin = end + 3;
+    }
+
+    if (!list.empty())
+        list += " + ";
+    list += item;
+}
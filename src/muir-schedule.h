@@ -0,0 +1,71 @@
+#ifndef MUIR_SCHEDULE_H
+#define MUIR_SCHEDULE_H
+//
+// C++ Interface: muir-schedule
+//
+// Description: Decode one file on every processing device at once, in blocks of
+//              range rows handed out by a work-stealing scheduler.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-types.h"
+#include "muir-process.h"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hands out rows first_row .. first_row+rows-1 in blocks.  Each worker starts with a
+// contiguous span sized by its weight and takes blocks off the front of it; once its
+// own span is empty it steals the back half of the largest span left.
+class RowScheduler
+{
+  public:
+    RowScheduler(unsigned int first_row, unsigned int rows, const std::vector<double> &weights);
+
+    // Next block of at most max_rows rows for worker.  Returns false when every row
+    // has been handed out.
+    bool next(std::size_t worker, unsigned int max_rows, unsigned int &first, unsigned int &count);
+
+    // Blocks taken from other workers' spans
+    std::size_t steals() const
+        { return _steals; };
+
+  private:
+    struct Span
+    {
+        unsigned int begin;
+        unsigned int end;
+    };
+
+    std::vector<Span> _spans;
+    std::size_t       _steals;
+    std::mutex        _mutex;
+
+    // No copying
+    RowScheduler(const RowScheduler &in);
+    RowScheduler& operator= (const RowScheduler &right);
+};
+
+// Same as process_data(), but the range window is split into row blocks decoded on all
+// devices concurrently and merged into one decoded_data.  Block sizes follow each
+// device's measured rows per second (kept across files).  Devices that decode out
+// of host memory read sample_data in place, the others are sent just the samples
+// their block needs.  Intermediate stages are done by device 0 alone.
+int process_data_scheduled(const Muir4DArrayF& sample_data,
+                           const SampleLayout& sample_layout,
+                           const PhaseCode& phasecode,
+                           Muir3DArrayF& decoded_data,
+                           DecodingConfig &config,
+                           std::vector<std::string>& timing_strings,
+                           Muir2DArrayD& timings,
+                           Muir4DArrayF& complex_intermediate
+                          );
+
+#endif //MUIR_SCHEDULE_H
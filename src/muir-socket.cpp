@@ -0,0 +1,167 @@
+//
+// C++ Implementation: muir-socket
+//
+// Description: Line oriented TCP and Unix socket connections between MUIR processes.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+// POSIX sockets
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+bool socket_unix_path(const std::string &address, std::string &path)
+{
+    if (address.compare(0, 5, "unix:") == 0)
+        path = address.substr(5);
+    else if (address.find('/') != std::string::npos)
+        path = address;
+    else
+        return false;
+
+    return true;
+}
+
+
+int socket_open(const std::string &address, bool listening)
+{
+    std::string path;
+    if (socket_unix_path(address, path))
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("Bad Unix socket path: " + address);
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Unable to create socket: ") + strerror(errno));
+
+        if (listening)
+        {
+            // Left behind by one of our processes that didn't exit cleanly, never anything else
+            struct stat info;
+            if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode) && info.st_uid == getuid())
+                unlink(path.c_str());
+
+            // Only this user may connect
+            if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 &&
+                chmod(path.c_str(), S_IRUSR | S_IWUSR) == 0 && listen(fd, 64) == 0)
+                return fd;
+        }
+        else if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+        {
+            return fd;
+        }
+
+        std::string error = strerror(errno);
+        close(fd);
+        throw std::runtime_error("Unable to " + std::string(listening ? "listen on " : "connect to ") + address + ": " + error);
+    }
+
+    std::size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size())
+        throw std::runtime_error("Bad address: " + address + " (expecting host:port, :port or unix:/path)");
+
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    if (host.empty())
+        host = "localhost";
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    addrinfo *results = NULL;
+    int status = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &results);
+    if (status != 0)
+        throw std::runtime_error("Unable to resolve " + address + ": " + gai_strerror(status));
+
+    std::string error = "no addresses";
+    for (addrinfo *result = results; result; result = result->ai_next)
+    {
+        int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        if (listening)
+        {
+            int reuse = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            if (bind(fd, result->ai_addr, result->ai_addrlen) == 0 && listen(fd, 64) == 0)
+            {
+                freeaddrinfo(results);
+                return fd;
+            }
+        }
+        else if (connect(fd, result->ai_addr, result->ai_addrlen) == 0)
+        {
+            freeaddrinfo(results);
+            return fd;
+        }
+
+        error = strerror(errno);
+        close(fd);
+    }
+
+    freeaddrinfo(results);
+    throw std::runtime_error("Unable to " + std::string(listening ? "listen on " : "connect to ") + address + ": " + error);
+}
+
+
+bool socket_send(int fd, const std::string &line)
+{
+    std::size_t sent = 0;
+    while (sent < line.size())
+    {
+        ssize_t bytes = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+
+        sent += bytes;
+    }
+
+    return true;
+}
+
+
+bool socket_receive_line(int fd, std::string &buffer, std::string &line)
+{
+    std::size_t end;
+    while ((end = buffer.find('\n')) == std::string::npos)
+    {
+        char received[4096];
+        ssize_t bytes = recv(fd, received, sizeof(received), 0);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+
+        buffer.append(received, bytes);
+    }
+
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return true;
+}
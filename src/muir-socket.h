@@ -0,0 +1,36 @@
+#ifndef MUIR_SOCKET_H
+#define MUIR_SOCKET_H
+//
+// C++ Interface: muir-socket
+//
+// Description: Line oriented TCP and Unix socket connections between MUIR processes.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <string>
+
+// Addresses are "host:port" or ":port" (TCP, localhost) or "unix:/path" or any path with
+// a '/' (Unix socket).  Listening for other machines takes an explicit host, Ex: 0.0.0.0:port,
+// and nothing authenticates them, so only on a trusted network.
+
+// True, with the socket's path, for a Unix socket address
+bool socket_unix_path(const std::string &address, std::string &path);
+
+// A listening or connected socket for the address.  A listening Unix socket is made
+// usable by this user only (0600), and a stale one this user left behind is replaced.
+// Throws std::runtime_error.
+int socket_open(const std::string &address, bool listening);
+
+// Sends all of text.  Never raises SIGPIPE, a peer that has gone is just a failed send.
+bool socket_send(int fd, const std::string &text);
+
+// Next line, without its newline.  buffer keeps what was received past it between calls.
+// False once the peer has gone.
+bool socket_receive_line(int fd, std::string &buffer, std::string &line);
+
+#endif //MUIR_SOCKET_H
@@ -0,0 +1,223 @@
+//
+// C++ Implementation: muir-taskpool
+//
+// Description: Work stealing task pool shared by every file being decoded on the CPU.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-taskpool.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Linux CPU affinity
+#include <sched.h>
+
+/// Constants
+static const std::string SectionName("TaskPool");
+
+static thread_local int worker_index = -1;
+static std::unique_ptr<MUIR::TaskPool> pool;
+
+namespace MUIR
+{
+
+TaskGroup::TaskGroup()
+: _pending(0)
+{}
+
+
+void TaskGroup::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _finished.wait(lock, [this]{ return _pending == 0; });
+
+    if (_error)
+    {
+        std::exception_ptr error = _error;
+        _error = NULL;
+        std::rethrow_exception(error);
+    }
+}
+
+
+void TaskGroup::add()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending++;
+}
+
+
+void TaskGroup::done(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (error && !_error)
+        _error = error;
+
+    if (--_pending == 0)
+        _finished.notify_all();
+}
+
+
+TaskPool::TaskPool(std::size_t threads)
+: _queued(0),
+  _next(0),
+  _steals(0),
+  _stopping(false)
+{
+    threads = std::max<std::size_t>(threads, 1);
+
+    for (std::size_t i = 0; i < threads; i++)
+        _workers.push_back(std::unique_ptr<Worker>(new Worker));
+
+    for (std::size_t i = 0; i < threads; i++)
+        _threads.push_back(std::thread(&TaskPool::work, this, i));
+}
+
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+
+    for (std::size_t i = 0; i < _threads.size(); i++)
+        _threads[i].join();
+}
+
+
+void TaskPool::submit(TaskGroup &group, std::function<void()> task)
+{
+    group.add();
+
+    // Counted under the sleep lock so a worker about to sleep can't miss it, and before
+    // it is queued so a worker that takes it at once can't count it down below zero
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _queued++;
+    }
+
+    std::size_t index = (worker_index >= 0) ? static_cast<std::size_t>(worker_index) : _next++ % _workers.size();
+    {
+        std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+        Task item = { task, &group };
+        _workers[index]->tasks.push_back(item);
+    }
+    _wake.notify_one();
+}
+
+
+int TaskPool::worker()
+{
+    return worker_index;
+}
+
+
+void TaskPool::work(std::size_t index)
+{
+    worker_index = static_cast<int>(index);
+
+    while (true)
+    {
+        Task task;
+        if (pop(index, task) || steal(index, task))
+        {
+            _queued--;
+
+            std::exception_ptr error;
+            try
+            {
+                task.run();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            task.group->done(error);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _wake.wait(lock, [this]{ return _stopping || _queued > 0; });
+
+        if (_stopping && _queued == 0)
+            return;
+    }
+}
+
+
+// Newest task of our own deque
+bool TaskPool::pop(std::size_t index, Task &task)
+{
+    Worker &worker = *_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    if (worker.tasks.empty())
+        return false;
+
+    task = worker.tasks.back();
+    worker.tasks.pop_back();
+    return true;
+}
+
+
+// Oldest task of the next worker that has one
+bool TaskPool::steal(std::size_t index, Task &task)
+{
+    for (std::size_t i = 1; i < _workers.size(); i++)
+    {
+        Worker &victim = *_workers[(index + i) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (victim.tasks.empty())
+            continue;
+
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        _steals++;
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace MUIR
+
+
+void task_pool_start(std::size_t threads)
+{
+    if (threads == 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            threads = CPU_COUNT(&set);
+    }
+
+    pool.reset(new MUIR::TaskPool(threads));
+    std::cout << SectionName << ": " << pool->size() << " worker threads" << std::endl;
+}
+
+
+void task_pool_stop(void)
+{
+    if (!pool)
+        return;
+
+    std::cout << SectionName << ": " << pool->steals() << " tasks stolen" << std::endl;
+    pool.reset();
+}
+
+
+MUIR::TaskPool* task_pool(void)
+{
+    return pool.get();
+}
@@ -0,0 +1,118 @@
+#ifndef MUIR_TASKPOOL_H
+#define MUIR_TASKPOOL_H
+//
+// C++ Interface: muir-taskpool
+//
+// Description: Work stealing task pool shared by every file being decoded on the CPU.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MUIR
+{
+
+// Tasks submitted together, Ex: the row tiles of one file.  The submitting thread
+// waits on the group for all of them.
+class TaskGroup
+{
+  public:
+    TaskGroup();
+
+    // Blocks until every task of the group has run, then rethrows the first exception
+    // any of them threw
+    void wait();
+
+  private:
+    friend class TaskPool;
+
+    void add();
+    void done(std::exception_ptr error);
+
+    std::mutex _mutex;
+    std::condition_variable _finished;
+    std::size_t _pending;
+    std::exception_ptr _error;
+
+    // No copying
+    TaskGroup(const TaskGroup &);
+    TaskGroup& operator=(const TaskGroup &);
+};
+
+// Fixed set of worker threads, each with its own deque of tasks.  Workers run their own
+// deque newest first and, when it is empty, steal the oldest task of another worker, so
+// tasks of every submitted group share all the workers and the last group left running
+// gets all of them.
+class TaskPool
+{
+  public:
+    explicit TaskPool(std::size_t threads);
+    ~TaskPool();  // Runs what is queued, then joins the workers
+
+    std::size_t size() const { return _workers.size(); }
+
+    // Queue a task.  Tasks from outside the pool are dealt round robin over the workers,
+    // tasks from a worker go on its own deque.
+    void submit(TaskGroup &group, std::function<void()> task);
+
+    std::size_t steals() const { return _steals; }
+
+    // Index of the calling worker, -1 outside the pool
+    static int worker();
+
+  private:
+    struct Task
+    {
+        std::function<void()> run;
+        TaskGroup *group;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work(std::size_t index);
+    bool pop(std::size_t index, Task &task);
+    bool steal(std::size_t index, Task &task);
+
+    std::vector<std::unique_ptr<Worker> > _workers;
+    std::vector<std::thread> _threads;
+
+    std::mutex _sleep_mutex;
+    std::condition_variable _wake;
+    std::atomic<std::size_t> _queued;
+    std::atomic<std::size_t> _next;
+    std::atomic<std::size_t> _steals;
+    bool _stopping;
+
+    // No copying
+    TaskPool(const TaskPool &);
+    TaskPool& operator=(const TaskPool &);
+};
+
+} // namespace MUIR
+
+// Process wide pool used by process_data_cpu() for its row tiles.  While none is started
+// each file is decoded by its own OpenMP team.  threads 0 starts one worker per CPU the
+// process may run on.
+void task_pool_start(std::size_t threads);
+void task_pool_stop(void);
+MUIR::TaskPool* task_pool(void);
+
+#endif //MUIR_TASKPOOL_H
@@ -5,17 +5,22 @@
 #define BOOST_DISABLE_ASSERTS TRUE
 #include "boost/multi_array.hpp"
 
-typedef boost::multi_array<unsigned int , 2> Muir2DArrayUI;
-typedef boost::multi_array<unsigned int , 3> Muir3DArrayUI;
-typedef boost::multi_array<unsigned int , 4> Muir4DArrayUI;
+#include "muir-allocator.h"
 
-typedef boost::multi_array<float , 2> Muir2DArrayF;
-typedef boost::multi_array<float , 3> Muir3DArrayF;
-typedef boost::multi_array<float , 4> Muir4DArrayF;
+typedef boost::multi_array<unsigned int , 2, MuirAllocator<unsigned int> > Muir2DArrayUI;
+typedef boost::multi_array<unsigned int , 3, MuirAllocator<unsigned int> > Muir3DArrayUI;
+typedef boost::multi_array<unsigned int , 4, MuirAllocator<unsigned int> > Muir4DArrayUI;
 
-typedef boost::multi_array<double , 2> Muir2DArrayD;
-typedef boost::multi_array<double , 3> Muir3DArrayD;
-typedef boost::multi_array<double , 4> Muir4DArrayD;
+typedef boost::multi_array<float , 2, MuirAllocator<float> > Muir2DArrayF;
+typedef boost::multi_array<float , 3, MuirAllocator<float> > Muir3DArrayF;
+typedef boost::multi_array<float , 4, MuirAllocator<float> > Muir4DArrayF;
+
+typedef boost::multi_array<double , 2, MuirAllocator<double> > Muir2DArrayD;
+typedef boost::multi_array<double , 3, MuirAllocator<double> > Muir3DArrayD;
+typedef boost::multi_array<double , 4, MuirAllocator<double> > Muir4DArrayD;
+
+// Views over externally owned memory (multi_arrays convert to these without copying)
+typedef boost::multi_array_ref<float , 4> Muir4DArrayRefF;
 
 typedef std::vector<int> PhaseCodeT;
 
@@ -14,7 +14,9 @@
 #include "muir-constants.h"
 #include "muir-types.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <cassert>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -28,24 +30,47 @@ bool have_range(const MuirHD5 &file, boost::posix_time::time_period range)
     Muir2DArrayD time;
     file.read_2D_double(RTI_RADACTIME_PATH, time);
 
-    // Get shape of time array
-    const Muir2DArrayUI::size_type *shape = time.shape();
+    // Check for intersection with any set
+    std::size_t first_set, sets;
+    return sets_in_range(time, radac_time(range.begin()), radac_time(range.end()), first_set, sets);
+}
+
+
+bool sets_in_range(const Muir2DArrayD &time, double start, double end, std::size_t &first_set, std::size_t &sets)
+{
+    const Muir2DArrayD::size_type *shape = time.shape();
 
-    // Convert time extents to ptime
-    BST_PT::ptime t1 = BST_PT::from_time_t(static_cast<int>(time[0][0]/1000000));
-    BST_PT::ptime t2 = BST_PT::from_time_t(static_cast<int>(time[shape[0]-1][shape[1]-1]/1000000));
+    first_set = shape[0];
+    sets = 0;
 
-    // Put ptimes into a range
-    BST_PT::time_period file_range(t1,t2);
+    for (std::size_t set = 0; set < shape[0]; set++)
+    {
+        if (time[set][0] < end && time[set][shape[1]-1] >= start)
+        {
+            first_set = std::min(first_set, set);
+            sets = set - first_set + 1;
+        }
+    }
+
+    return sets != 0;
+}
+
+
+double radac_time(const boost::posix_time::ptime &t)
+{
+    if (t.is_neg_infinity())
+        return -std::numeric_limits<double>::infinity();
+    if (t.is_pos_infinity())
+        return std::numeric_limits<double>::infinity();
 
-    // Check for intersection
-    return range.intersects(file_range);
+    static const BST_PT::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return static_cast<double>((t - epoch).total_microseconds());
 }
 
 
 // Reads and parses the phasecode
 // Return false if the the file doesn't contain a phasecode.
-bool read_phasecode(const MuirHD5 &file_in, std::vector<float> &phasecode)
+bool read_phasecode(const MuirHD5 &file_in, PhaseCode &phasecode)
 {
     std::string experimentfile = file_in.read_string(RTI_EXPERIMENTFILE_PATH);
 
@@ -64,21 +89,21 @@ bool read_phasecode(const MuirHD5 &file_in, std::vector<float> &phasecode)
     if(size == 0)
         return false;
 
-    // Prepare the phasecode vector.
+    // Prepare the phasecode.
     phasecode.clear();
 
-    // Get values for phasecode and dump them into the vector.
+    // Get values for phasecode and pack them.
     for (std::size_t i = 0; i < size; i++)
     {
         if (phasecode_bulk[i] == '+')
         {
-            phasecode.push_back(1.0f);
+            phasecode.push_back(false);
             continue;
         }
 
         if (phasecode_bulk[i] == '-')
         {
-            phasecode.push_back(-1.0f);
+            phasecode.push_back(true);
             continue;
         }
     }
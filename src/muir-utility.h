@@ -13,14 +13,23 @@
 //
 
 #include "muir-hd5.h"
+#include "muir-phasecode.h"
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 // Checks to see if a given time range intersects with that in the file.
 bool have_range(const MuirHD5 &file, boost::posix_time::time_period range);
 
+// Finds the sets whose RADAC times ([set][begin, end], microseconds since the epoch)
+// overlap start .. end.  Sets are in time order, so they are consecutive.
+// Return false if there are none.
+bool sets_in_range(const Muir2DArrayD &time, double start, double end, std::size_t &first_set, std::size_t &sets);
+
+// RADAC time (microseconds since the epoch) of a ptime
+double radac_time(const boost::posix_time::ptime &t);
+
 // Reads and parses the phasecode from an HDF5 file.
 // Return false if the the file doesn't contain a phasecode.
-bool read_phasecode(const MuirHD5 &file_in, std::vector<float> &phasecode);
+bool read_phasecode(const MuirHD5 &file_in, PhaseCode &phasecode);
 
 // Load a textfile into a string
 void load_file (const std::string &path, std::string &file_contents);
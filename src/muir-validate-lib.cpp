@@ -12,6 +12,7 @@
 
 #include "muir-validate-lib.h"
 #include "muir-constants.h"
+#include "muir-view.h"
 
 #include <cassert>
 #include <limits>
@@ -30,14 +31,23 @@ double diff_sum(const Muir3DArrayF &standard, const Muir3DArrayF &test, Muir3DAr
     // Resize output
     output.resize(boost::extents[dim1_size][dim2_size][dim3_size]);
     
+    MUIR::MuirView<const float, 3> standard_view(standard);
+    MUIR::MuirView<const float, 3> test_view(test);
+    MUIR::MuirView<float, 3> output_view(output);
+
     float max_standard = -std::numeric_limits<float>::infinity( ), max_test = -std::numeric_limits<float>::infinity( );
     for (size_t dim1 = 0; dim1 < dim1_size; dim1++)
         for (size_t dim2 = 0; dim2 < dim2_size; dim2++)
+        {
+            const float *standard_row = standard_view.row(dim1, dim2);
+            const float *test_row = test_view.row(dim1, dim2);
+
             for (size_t dim3 = 0; dim3 < dim3_size; dim3++)
             {
-                max_standard = std::max(max_standard, standard[dim1][dim2][dim3]);
-                max_test = std::max(max_test, test[dim1][dim2][dim3]);
+                max_standard = std::max(max_standard, standard_row[dim3]);
+                max_test = std::max(max_test, test_row[dim3]);
             }
+        }
             
     std::cout << "Maximums found, standard: " << max_standard << std::endl;
     std::cout << "                test    : " << max_test << std::endl;
@@ -47,13 +57,19 @@ double diff_sum(const Muir3DArrayF &standard, const Muir3DArrayF &test, Muir3DAr
     double accumulator = 0.0 ,sc_accumulator = 0.0;
     for (size_t dim1 = 0; dim1 < dim1_size; dim1++)
         for (size_t dim2 = 0; dim2 < dim2_size; dim2++)
+        {
+            const float *standard_row = standard_view.row(dim1, dim2);
+            const float *test_row = test_view.row(dim1, dim2);
+            float *output_row = output_view.row(dim1, dim2);
+
             for (size_t dim3 = 0; dim3 < dim3_size; dim3++)
             {
-                double abs_diff = abs(standard[dim1][dim2][dim3] - test[dim1][dim2][dim3]);
+                double abs_diff = abs(standard_row[dim3] - test_row[dim3]);
                 accumulator += abs_diff;
-                output[dim1][dim2][dim3] = abs_diff;
-                sc_accumulator += abs(standard[dim1][dim2][dim3]/max_standard - test[dim1][dim2][dim3]/max_test);
+                output_row[dim3] = abs_diff;
+                sc_accumulator += abs(standard_row[dim3]/max_standard - test_row[dim3]/max_test);
             }
+        }
 
     std::cout << "       Sum Difference: " << accumulator << std::endl;
     std::cout << "Scaled Sum Difference: " << sc_accumulator << std::endl;
@@ -74,15 +90,25 @@ double diff_sum(const Muir4DArrayF &standard, const Muir4DArrayF &test, Muir4DAr
     // Resize output
     output.resize(boost::extents[dim1_size][dim2_size][dim3_size][dim4_size]);
     
+    // The [dim3][dim4] plane of each frame is contiguous, walk it as one row
+    MUIR::MuirView<const float, 4> standard_view(standard);
+    MUIR::MuirView<const float, 4> test_view(test);
+    MUIR::MuirView<float, 4> output_view(output);
+    size_t plane_size = dim3_size * dim4_size;
+
     float max_standard = -std::numeric_limits<float>::infinity( ), max_test = -std::numeric_limits<float>::infinity( );
     for (size_t dim1 = 0; dim1 < dim1_size; dim1++)
         for (size_t dim2 = 0; dim2 < dim2_size; dim2++)
-            for (size_t dim3 = 0; dim3 < dim3_size; dim3++)
-                for (size_t dim4 = 0; dim4 < dim4_size; dim4++)
-                {
-                    max_standard = std::max(max_standard, standard[dim1][dim2][dim3][dim4]);
-                    max_test = std::max(max_test, test[dim1][dim2][dim3][dim4]);
-                }
+        {
+            const float *standard_plane = standard_view.row(dim1, dim2, 0);
+            const float *test_plane = test_view.row(dim1, dim2, 0);
+
+            for (size_t i = 0; i < plane_size; i++)
+            {
+                max_standard = std::max(max_standard, standard_plane[i]);
+                max_test = std::max(max_test, test_plane[i]);
+            }
+        }
 
     std::cout << "Maximums found, standard: " << max_standard << std::endl;
     std::cout << "                test    : " << max_test << std::endl;
@@ -92,14 +118,19 @@ double diff_sum(const Muir4DArrayF &standard, const Muir4DArrayF &test, Muir4DAr
     double accumulator = 0.0 ,sc_accumulator = 0.0;
     for (size_t dim1 = 0; dim1 < dim1_size; dim1++)
         for (size_t dim2 = 0; dim2 < dim2_size; dim2++)
-            for (size_t dim3 = 0; dim3 < dim3_size; dim3++)
-                for (size_t dim4 = 0; dim4 < dim4_size; dim4++)
-                {
-                    double abs_diff = abs(standard[dim1][dim2][dim3][dim4] - test[dim1][dim2][dim3][dim4]);
-                    accumulator += abs_diff;
-                    output[dim1][dim2][dim3][dim4] = abs_diff;
-                    sc_accumulator += abs(standard[dim1][dim2][dim3][dim4]/max_standard - test[dim1][dim2][dim3][dim4]/max_test);
-                }
+        {
+            const float *standard_plane = standard_view.row(dim1, dim2, 0);
+            const float *test_plane = test_view.row(dim1, dim2, 0);
+            float *output_plane = output_view.row(dim1, dim2, 0);
+
+            for (size_t i = 0; i < plane_size; i++)
+            {
+                double abs_diff = abs(standard_plane[i] - test_plane[i]);
+                accumulator += abs_diff;
+                output_plane[i] = abs_diff;
+                sc_accumulator += abs(standard_plane[i]/max_standard - test_plane[i]/max_test);
+            }
+        }
 
     std::cout << "       Sum Difference: " << accumulator << std::endl;
     std::cout << "Scaled Sum Difference: " << sc_accumulator << std::endl;
@@ -19,6 +19,9 @@
 #include "muir-process.h"
 #include "muir-process-cl.h"
 #include "muir-process-cpu.h"
+#include "muir-global.h"
+#include "muir-fftw.h"
+#include "muir-plan.h"
 
 #include <string>
 #include <iostream>
@@ -30,6 +33,7 @@ namespace fs = boost::filesystem;
 
 // Prototypes
 void print_help (void);
+int validate_file(const fs::path& file, bool option_cpu_pruned, double tolerance, const std::string& dump_filename);
 void dump_to_file(const std::string& filename,
                   const MuirHD5& unprocessed_file,
                   const Muir4DArrayF& complex_intermediate_1,
@@ -40,7 +44,7 @@ int main (const int argc, const char * argv[])
 {
     std::cout << "MUIR Validate, Version " << PACKAGE_VERSION << std::endl;
 
-    // There must be only one file specified
+    // There must at least be a file specified
     if ( argc < 2 )
     {
         print_help();
@@ -48,9 +52,64 @@ int main (const int argc, const char * argv[])
     }
 
     std::vector<fs::path> files;
+    bool option_cpu_pruned = false;  // Compare the CPU FFTW and pruned FFT engines instead of OpenCL and CPU
+    double tolerance = 0.0;          // Largest sum difference accepted per row
+    ShardSpec shard;                 // This process's share of the files
+    std::string shard_manifest;      // Where to write every file's shard, empty for none
 
     for (int argi = 1; argi < argc; argi++)
     {
+        if (!strcmp(argv[argi],"--cpu-pruned"))
+        {
+            option_cpu_pruned = true;
+            continue;
+        }
+        if (!strcmp(argv[argi],"--tolerance"))
+        {
+            argi++;
+            tolerance = atof(argv[argi]);
+            continue;
+        }
+        if (!strcmp(argv[argi],"--shard"))
+        {
+            argi++;
+            try
+            {
+                shard = shard_from_string(argv[argi]);
+            }
+            catch(std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (!strcmp(argv[argi],"--shard-manifest"))
+        {
+            argi++;
+            shard_manifest = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fftw-wisdom"))
+        {
+            argi++;
+            MUIR_FFTWWisdomFile = argv[argi];
+            continue;
+        }
+        if (!strcmp(argv[argi],"--fftw-planner"))
+        {
+            argi++;
+            try
+            {
+                MUIR_FFTWPlannerFlags = planner_flags_from_string(argv[argi]);
+            }
+            catch(std::invalid_argument &e)
+            {
+                std::cout << "ERROR! " << e.what() << std::endl;
+                return 1;
+            }
+            continue;
+        }
 
         fs::path path1(argv[argi]);
 
@@ -67,18 +126,65 @@ int main (const int argc, const char * argv[])
         }
     }
 
+    if (files.empty())
+    {
+        print_help();
+        return 1;
+    }
+
+    // Validate this shard's files, estimated with the default decoding like every other process
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; i < files.size(); i++)
+        paths.push_back(files[i].string());
+
+    try
+    {
+        paths = shard_paths(paths, DecodingConfig(), shard, shard_manifest);
+    }
+    catch(std::runtime_error &e)
+    {
+        std::cout << "ERROR! " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Setup For Processing
+    process_init(0);
+
+    int status = 0;
+    for (std::size_t i = 0; i < paths.size(); i++)
+    {
+        // One file keeps the old dump name, otherwise one dump per file
+        std::string dump_filename("row-dump.h5");
+        if (files.size() > 1)
+            dump_filename = fs::basename(fs::path(paths[i])) + std::string("-row-dump.h5");
+
+        if (validate_file(fs::path(paths[i]), option_cpu_pruned, tolerance, dump_filename))
+            status = 1;
+    }
+
+    // Release decoding context
+    process_cleanup();
+
+    return status;
+}
+
+// Compare the two methods row by row, dumping the first row that differs.  Returns 1 if the
+// file can't be decoded.
+int validate_file(const fs::path& file, bool option_cpu_pruned, double tolerance, const std::string& dump_filename)
+{
     // Open file
-    MuirHD5 unprocessed_file( files[0].string(), H5F_ACC_RDONLY );
+    MuirHD5 unprocessed_file( file.string(), H5F_ACC_RDONLY );
 
 
     // Get data
     std::cout << "Reading file: " << unprocessed_file.getFileName() << std::endl;
     Muir4DArrayF unprocessed_data;
     unprocessed_file.read_4D_float(RTI_RAWSAMPLEDATA_PATH, unprocessed_data);
+    SampleLayout unprocessed_layout(unprocessed_data);
 
 
     // Get Phasecode
-    std::vector<float> phasecode;
+    PhaseCode phasecode;
     read_phasecode(unprocessed_file, phasecode);
 
     if(phasecode.empty())
@@ -88,9 +194,6 @@ int main (const int argc, const char * argv[])
     }
 
 
-    // Setup For Processing
-    int contexts_avail = process_init(0);
-
     // Create Arrays
     Muir4DArrayF complex_intermediate_1(boost::extents[1][1][1][2]);
     Muir4DArrayF complex_intermediate_2(boost::extents[1][1][1][2]);
@@ -115,6 +218,12 @@ int main (const int argc, const char * argv[])
     config_1.intermediate_stage = stage;
     config_2.intermediate_stage = stage;
 
+    if (option_cpu_pruned)
+    {
+        config_1.fft_engine = FFT_ENGINE_FFTW;
+        config_2.fft_engine = FFT_ENGINE_PRUNED;
+    }
+
     for (unsigned int i = 0; i < 1100; i++)
     {
         row = i;
@@ -123,27 +232,36 @@ int main (const int argc, const char * argv[])
         config_1.intermediate_stage = stage;
         config_2.intermediate_stage = stage;
 
-        // OpenCL Method
-        std::cout << "Processing using OpenCL Method..." << std::endl;
-        process_data_cl(0, unprocessed_data, phasecode, processed_data_1, config_1, timing_strings_1, timings_1, complex_intermediate_1);
+        if (option_cpu_pruned)
+        {
+            // CPU FFTW Method (reference)
+            std::cout << "Processing using CPU FFTW Method..." << std::endl;
+            process_data_cpu(0, unprocessed_data, unprocessed_layout, phasecode, processed_data_1, config_1, timing_strings_1, timings_1, complex_intermediate_1);
+        }
+        else
+        {
+            // OpenCL Method
+            std::cout << "Processing using OpenCL Method..." << std::endl;
+            process_data_cl(0, unprocessed_data, unprocessed_layout, phasecode, processed_data_1, config_1, timing_strings_1, timings_1, complex_intermediate_1);
+        }
         print_dimensions(complex_intermediate_1);
         print_dimensions(processed_data_1);
 
         // CPU Method
-        std::cout << "Processing using CPU Method..." << std::endl;
-        process_data_cpu(0, unprocessed_data, phasecode, processed_data_2, config_2, timing_strings_2, timings_2, complex_intermediate_2);
+        std::cout << "Processing using CPU Method (" << (option_cpu_pruned?"pruned FFT":"default FFT engine") << ")..." << std::endl;
+        process_data_cpu(0, unprocessed_data, unprocessed_layout, phasecode, processed_data_2, config_2, timing_strings_2, timings_2, complex_intermediate_2);
         print_dimensions(complex_intermediate_2);
         print_dimensions(processed_data_2);
 
 
-        if (diff_sum(complex_intermediate_1, complex_intermediate_2, difference4D) > 0.0)
+        if (diff_sum(complex_intermediate_1, complex_intermediate_2, difference4D) > tolerance)
         {
-            dump_to_file(std::string("row-dump.h5"), unprocessed_file, complex_intermediate_1, complex_intermediate_2, difference4D);
+            dump_to_file(dump_filename, unprocessed_file, complex_intermediate_1, complex_intermediate_2, difference4D);
             break;
         }
     }
 
-    return 0;  // successfully terminated
+    return 0;
 }
 
 void dump_to_file(const std::string& filename,
@@ -192,6 +310,14 @@ void dump_to_file(const std::string& filename,
 
 void print_help ()
 {
-    std::cout << "usage: muir-validate unprocessed.h5" << std::endl;
+    std::cout << "usage: muir-validate [--cpu-pruned] [--tolerance sum] [--fftw-wisdom file] [--fftw-planner name]" << std::endl;
+    std::cout << "                     [--shard i/N [--shard-manifest file]] unprocessed.h5..." << std::endl;
+    std::cout << "  --cpu-pruned   : Compare the CPU pruned FFT engine against CPU FFTW instead of OpenCL against CPU." << std::endl;
+    std::cout << "  --tolerance    : Largest sum of absolute differences accepted for a row (default 0)." << std::endl;
+    std::cout << "  --shard        : Validate only shard i of N (Ex: 0/4 .. 3/4) of the files, shared out by their size" << std::endl;
+    std::cout << "                   the same way in every process.  Each file that fails is dumped to <file>-row-dump.h5." << std::endl;
+    std::cout << "  --shard-manifest: Write every file's shard and cost to the specified file." << std::endl;
+    std::cout << "  --fftw-wisdom  : Load FFTW wisdom from, and save new wisdom to, the specified file." << std::endl;
+    std::cout << "  --fftw-planner : FFTW planner rigor: estimate, measure (default), patient or exhaustive." << std::endl;
 
 }
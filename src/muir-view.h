@@ -0,0 +1,126 @@
+#ifndef MUIR_VIEW_H
+#define MUIR_VIEW_H
+//
+// C++ Interface: muir-view
+//
+// Description: Strided view over the elements of a Muir multi_array, for hot loops.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+namespace MUIR
+{
+
+// A pointer, N extents and N strides (in elements), nothing else.  Indexing is plain
+// arithmetic the compiler can hoist, unlike multi_array's operator[] chains which
+// build a sub-array proxy per level.  The view doesn't own its elements; resizing or
+// destroying the array it was made from invalidates it.
+template<typename T, std::size_t N>
+class MuirView
+{
+  public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t index;
+
+    MuirView(T *data, const std::array<size_type, N> &extents, const std::array<index, N> &strides)
+    : _data(data), _extents(extents), _strides(strides)
+    {}
+
+    // From any boost::multi_array or multi_array_ref with zero index bases, without copying
+    template<typename Array>
+    explicit MuirView(Array &array)
+    : _data(array.data())
+    {
+        static_assert(Array::dimensionality == N, "MuirView rank must match the array");
+        for (std::size_t d = 0; d < N; d++)
+        {
+            _extents[d] = array.shape()[d];
+            _strides[d] = array.strides()[d];
+        }
+    }
+
+    static constexpr std::size_t rank() { return N; }
+
+    T* data() const { return _data; }
+    size_type extent(std::size_t d) const { return _extents[d]; }
+    index stride(std::size_t d) const { return _strides[d]; }
+
+    size_type size() const
+    {
+        size_type count = 1;
+        for (std::size_t d = 0; d < N; d++)
+            count *= _extents[d];
+        return count;
+    }
+
+    // The last dimension is unit stride, so rows can be walked with a plain pointer
+    bool contiguous_rows() const { return _strides[N-1] == 1; }
+
+    // Element at N indices, Ex: view(set, col, row)
+    template<typename... Indices>
+    T& operator()(Indices... indices) const
+    {
+        static_assert(sizeof...(Indices) == N, "MuirView needs one index per dimension");
+        const index list[N] = { static_cast<index>(indices)... };
+
+        index offset = 0;
+        for (std::size_t d = 0; d < N; d++)
+            offset += list[d] * _strides[d];
+        return _data[offset];
+    }
+
+    // Start of the innermost row at N-1 indices, Ex: view.row(set, col)[range].  Only
+    // contiguous when contiguous_rows().
+    template<typename... Indices>
+    T* row(Indices... indices) const
+    {
+        static_assert(sizeof...(Indices) == N - 1, "MuirView::row() needs one index per outer dimension");
+        const index list[N > 1 ? N - 1 : 1] = { static_cast<index>(indices)... };
+
+        index offset = 0;
+        for (std::size_t d = 0; d + 1 < N; d++)
+            offset += list[d] * _strides[d];
+        return _data + offset;
+    }
+
+    // Sub-view with the first index fixed, Ex: view[set] is the [col][row] plane of a set
+    MuirView<T, N - 1> operator[](size_type i) const
+    {
+        static_assert(N > 1, "Index a rank 1 MuirView with operator()");
+
+        std::array<size_type, N - 1> extents;
+        std::array<index, N - 1> strides;
+        for (std::size_t d = 1; d < N; d++)
+        {
+            extents[d-1] = _extents[d];
+            strides[d-1] = _strides[d];
+        }
+        return MuirView<T, N - 1>(_data + static_cast<index>(i) * _strides[0], extents, strides);
+    }
+
+  private:
+    T *_data;
+    std::array<size_type, N> _extents;
+    std::array<index, N> _strides;
+};
+
+// View of a whole array, const when the array is: make_view(decoded_data)(set, col, row)
+template<typename Array>
+MuirView<typename std::remove_pointer<decltype(std::declval<Array &>().data())>::type, Array::dimensionality>
+make_view(Array &array)
+{
+    return MuirView<typename std::remove_pointer<decltype(std::declval<Array &>().data())>::type, Array::dimensionality>(array);
+}
+
+} // namespace MUIR
+
+#endif //MUIR_VIEW_H
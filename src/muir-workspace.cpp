@@ -0,0 +1,122 @@
+//
+// C++ Implementation: muir-workspace
+//
+// Description: Reusable per-thread scratch buffers for the CPU decoding process.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-workspace.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <vector>
+
+DecodeWorkspace::DecodeWorkspace()
+: dirty_rows(0),
+  _in(NULL),
+  _out(NULL),
+  _sets(0),
+  _cols(0),
+  _fft_size(0),
+  _block(0),
+  _in_ref(),
+  _out_ref()
+{
+    reserve(1, 1, 1, 1);
+}
+
+DecodeWorkspace::~DecodeWorkspace()
+{
+    release();
+}
+
+bool DecodeWorkspace::reserve(std::size_t sets, std::size_t cols, std::size_t fft_size, std::size_t block)
+{
+    if (sets == _sets && cols == _cols && fft_size == _fft_size)
+    {
+        if (block == _block)
+            return false;
+
+        // Same shape, but the zero padding is in different places
+        std::fill(_in, _in + sets * cols * fft_size * 2, 0.0f);
+        dirty_rows = 0;
+        _block = block;
+
+        return true;
+    }
+
+    release();
+
+    std::size_t elements = sets * cols * fft_size * 2;
+
+    // aligned_alloc() wants a multiple of the alignment
+    std::size_t bytes = elements * sizeof(float);
+    bytes = (bytes + Alignment - 1) / Alignment * Alignment;
+
+    _in  = static_cast<float *>(std::aligned_alloc(Alignment, bytes));
+    _out = static_cast<float *>(std::aligned_alloc(Alignment, bytes));
+
+    if (_in == NULL || _out == NULL)
+    {
+        release();
+        throw std::bad_alloc();
+    }
+
+    // Zero padding is only written here, decoding rewrites just the dirty prefix.
+    std::fill(_in,  _in  + elements, 0.0f);
+    std::fill(_out, _out + elements, 0.0f);
+    dirty_rows = 0;
+
+    _sets = sets;
+    _cols = cols;
+    _fft_size = fft_size;
+    _block = block;
+
+    _in_ref.reset(new Muir4DArrayRefF(_in, boost::extents[sets][cols][fft_size][2]));
+    _out_ref.reset(new Muir4DArrayRefF(_out, boost::extents[sets][cols][fft_size][2]));
+
+    return true;
+}
+
+void DecodeWorkspace::release()
+{
+    _in_ref.reset();
+    _out_ref.reset();
+
+    std::free(_in);
+    std::free(_out);
+
+    _in = NULL;
+    _out = NULL;
+    _sets = _cols = _fft_size = _block = 0;
+    dirty_rows = 0;
+}
+
+DecodeWorkspace& decode_workspace(std::size_t sets, std::size_t cols, std::size_t fft_size, std::size_t block)
+{
+    // Live as long as the (OpenMP or pool worker) thread, so they are reused across files.
+    // Most recently used first.
+    static thread_local std::vector<std::unique_ptr<DecodeWorkspace> > workspaces;
+
+    std::size_t i = 0;
+    while (i < workspaces.size() && !workspaces[i]->has_shape(sets, cols, fft_size, block))
+        i++;
+
+    if (i == workspaces.size())
+    {
+        if (workspaces.size() < DecodeWorkspaceCache)
+            workspaces.push_back(std::unique_ptr<DecodeWorkspace>(new DecodeWorkspace));
+        i = workspaces.size() - 1;
+
+        workspaces[i]->reserve(sets, cols, fft_size, block);
+    }
+
+    std::rotate(workspaces.begin(), workspaces.begin() + i, workspaces.begin() + i + 1);
+    return *workspaces.front();
+}
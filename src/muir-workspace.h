@@ -0,0 +1,71 @@
+#ifndef MUIR_WORKSPACE_H
+#define MUIR_WORKSPACE_H
+//
+// C++ Interface: muir-workspace
+//
+// Description: Reusable per-thread scratch buffers for the CPU decoding process.
+//
+//
+// Author: Beau V.C. Bellamy <bvbellamy@arsc.edu>
+//         Arctic Region Supercomputing Center
+//
+//
+//
+
+#include "muir-types.h"
+
+#include <cstddef>
+#include <memory>
+
+// Complex FFT input and output buffers shaped [sets][cols][fft_size][2], 64-byte
+// aligned.  A few workspaces are kept per thread (see decode_workspace()) and reused
+// for every row and file that thread decodes; memory is only reallocated (and zeroed)
+// when the shape changes.
+class DecodeWorkspace
+{
+  public:
+    static const std::size_t Alignment = 64;
+
+    DecodeWorkspace();
+    ~DecodeWorkspace();
+
+    // Shape the buffers, returns true if they were reallocated or cleared.  Each input
+    // frame is made of fft_size/block sub-sequences of length block which only have
+    // non-zero data at the start (block == fft_size unless the FFT is pruned).
+    bool reserve(std::size_t sets, std::size_t cols, std::size_t fft_size, std::size_t block);
+
+    bool has_shape(std::size_t sets, std::size_t cols, std::size_t fft_size, std::size_t block) const
+        { return sets == _sets && cols == _cols && fft_size == _fft_size && block == _block; };
+
+    Muir4DArrayRefF& in()  { return *_in_ref; };
+    Muir4DArrayRefF& out() { return *_out_ref; };
+
+    // Number of leading rows in each input sub-sequence that may be non-zero.  Rows
+    // past this point are known to be zero and don't need to be cleared again.
+    std::size_t dirty_rows;
+
+  private:
+    float *_in;
+    float *_out;
+    std::size_t _sets;
+    std::size_t _cols;
+    std::size_t _fft_size;
+    std::size_t _block;
+
+    std::unique_ptr<Muir4DArrayRefF> _in_ref;
+    std::unique_ptr<Muir4DArrayRefF> _out_ref;
+
+    void release();
+
+    // No copying
+    DecodeWorkspace(const DecodeWorkspace &in);
+    DecodeWorkspace& operator= (const DecodeWorkspace &right);
+};
+
+// Workspace of the calling thread with this shape.  Task pool workers interleave tiles
+// of files (and stream chunks) of different shapes, so each thread keeps the last
+// DecodeWorkspaceCache shapes it used and only reshapes the least recently used one.
+static const std::size_t DecodeWorkspaceCache = 4;
+DecodeWorkspace& decode_workspace(std::size_t sets, std::size_t cols, std::size_t fft_size, std::size_t block);
+
+#endif //MUIR_WORKSPACE_H
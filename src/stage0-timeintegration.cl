@@ -0,0 +1,31 @@
+__kernel void
+timeintegration(__global float2* sample_data,
+                __global float2* integrated_data,
+                         uint    pulses,
+                         uint    num_cols,
+                         uint    num_rangebins,
+                         uint    in_block,
+                         uint    in_frames,
+                         uint    out_block,
+                         uint    out_frames
+               )
+{
+  unsigned int range = get_global_id(0);
+  unsigned int out_frame = get_global_id(1);
+
+  if (range >= num_rangebins)
+      return;
+
+  // Output frame (set, col) averages input frames (set, col*pulses ..), both stored
+  // [range block][frame][range in block]
+  unsigned int out_cols = num_cols / pulses;
+  unsigned int first_frame = mad24(out_frame / out_cols, num_cols, (out_frame % out_cols) * pulses);
+  unsigned int in_idx = mad24(mad24(range / in_block, in_frames, first_frame), in_block, range % in_block);
+  unsigned int out_idx = mad24(mad24(range / out_block, out_frames, out_frame), out_block, range % out_block);
+
+  float2 sum = 0.0f;
+  for (unsigned int pulse = 0; pulse < pulses; pulse++)
+      sum += sample_data[in_idx + pulse * in_block];
+
+  integrated_data[out_idx] = sum / (float)pulses;
+}
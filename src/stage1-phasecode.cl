@@ -1,26 +1,33 @@
 __kernel void
 phasecode(__global float2* sample_data,
-          __constant float*  phasecode_data,
+          __constant uint*   phasecode_bits,
           __global float2* prefft_data,
                    uint    phasecode_offset, 
                    uint    phasecode_size, 
                    uint    num_rangebins,
-                   uint    num_fft
+                   uint    num_fft,
+                   uint    block,
+                   uint    num_frames
          )
 {
   unsigned int range = get_global_id(0);
   unsigned int frame_id = get_global_id(1);
-  unsigned int inframe_idx  = mad24(frame_id, num_rangebins, range);
   unsigned int outframe_idx = mad24(frame_id, num_fft, range);
 
-  if (range > phasecode_size || (phasecode_offset + range) > num_rangebins)
+  // Samples are stored [range block][frame][range in block], block == num_rangebins
+  // is the natural [frame][range] layout
+  unsigned int sample = phasecode_offset + range;
+  unsigned int in_idx = mad24(mad24(sample / block, num_frames, frame_id), block, sample % block);
+
+  if (range >= phasecode_size || (phasecode_offset + range) >= num_rangebins)
   {
       prefft_data[outframe_idx]   = 0.0f;
   }
   else
   {
-      float phase = phasecode_data[range];
-      prefft_data[outframe_idx]   = phase * sample_data[inframe_idx + phasecode_offset];
+      // Bit set for '-', applied by flipping the sign bits
+      uint mask = ((phasecode_bits[range >> 5] >> (range & 31)) & 1u) << 31;
+      prefft_data[outframe_idx]   = as_float2(as_uint2(sample_data[in_idx]) ^ (uint2)(mask));
   }
 } 
 
@@ -1,9 +1,11 @@
 __kernel void
 power(__global float2* postfft_data,
       __global float*  power_data,
-               uint    num_rangebins)
+               uint    num_rangebins,
+               uint    first_bin)
 {
-  unsigned int range = get_global_id(0);
+  // Work items cover the Doppler window, which may wrap past the end of the spectrum
+  unsigned int range = (get_global_id(0) + first_bin) % num_rangebins;
   unsigned int frameidx = get_global_id(1)*num_rangebins;
 
   float data = pown(postfft_data[frameidx + range].s0,2) + pown(postfft_data[frameidx + range].s1,2);
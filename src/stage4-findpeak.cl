@@ -5,16 +5,19 @@ findpeak(__global float*  power_data,
            const  uint    fft_size,
            const  uint    in_stride,
            const  uint    out_stride,
-           const  float   normalize)
+           const  float   normalize,
+           const  uint    first_bin,
+           const  uint    bins)
 {
   uint inframe  = get_global_id(0)*in_stride;
   uint outframe = get_global_id(0)*out_stride;
   
   float max_sample = -INFINITY;
 
-  for(uint i = 0; i < fft_size; i++)
+  // Only search the Doppler window, wrapping at the end of the spectrum
+  for(uint i = 0; i < bins; i++)
   {
-    max_sample = max(power_data[inframe + i], max_sample);
+    max_sample = max(power_data[inframe + (first_bin + i) % fft_size], max_sample);
   }
 
   // Output data